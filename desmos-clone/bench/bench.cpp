@@ -0,0 +1,1451 @@
+// Micro and macro benchmarks for the parser, evaluator and plot sampling.
+//
+//   desmos_bench [--min-time SECONDS] [FILTER...]
+//
+// Each benchmark is run in 5 timed samples of at least min-time/5 seconds
+// and the median is reported, both per call and per unit of work (an
+// evaluation, an AST node, a frame). FILTER arguments select benchmarks
+// whose name contains any of them.
+//
+// accuracy/* entries are checks rather than timings: they print the worst
+// error found and make the program exit with status 1 if it is too large.
+
+#include "../parser/parser.h"
+#include "../evaluator/evaluator.h"
+#include "../evaluator/compiler.h"
+#include "../evaluator/sampler.h"
+#include "../evaluator/region.h"
+#include "../evaluator/heatmap.h"
+#include "../evaluator/analysis.h"
+#include "../evaluator/fit.h"
+#include "../evaluator/complex.h"
+#include "../evaluator/special.h"
+#include "../evaluator/symbolic.h"
+#include "../evaluator/metrics.h"
+#include "../evaluator/shared.h"
+#include "../session/session.h"
+#include "corpus.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+double minTime = 1.0;
+std::vector<std::string> filters;
+volatile double sink;
+bool failed = false;
+
+bool selected(const char* name) {
+    if (filters.empty()) return true;
+    for (const auto& f : filters)
+        if (std::strstr(name, f.c_str())) return true;
+    return false;
+}
+
+// Times fn and prints the median cost per call and per unit of work
+template <typename Fn>
+void run(const char* name, double unitsPerCall, const char* unit, Fn fn) {
+    if (!selected(name)) return;
+    using Clock = std::chrono::steady_clock;
+
+    fn();   // warm-up
+    size_t iters = 1;
+    double sampleTime = minTime / 5;
+    for (;;) {
+        auto t0 = Clock::now();
+        for (size_t i = 0; i < iters; ++i) fn();
+        double dt = std::chrono::duration<double>(Clock::now() - t0).count();
+        if (dt >= sampleTime / 4 || iters >= (1u << 30)) {
+            iters = std::max<size_t>(1, (size_t)(iters * sampleTime / std::max(dt, 1e-9)));
+            break;
+        }
+        iters *= 4;
+    }
+
+    std::vector<double> perCall;
+    for (int s = 0; s < 5; ++s) {
+        auto t0 = Clock::now();
+        for (size_t i = 0; i < iters; ++i) fn();
+        double dt = std::chrono::duration<double>(Clock::now() - t0).count();
+        perCall.push_back(dt / iters);
+    }
+    std::sort(perCall.begin(), perCall.end());
+    double median = perCall[2];
+
+    std::printf("%-32s %12.3f us/call %10.2f ns/%s\n", name, median * 1e6, median * 1e9 / unitsPerCall, unit);
+}
+
+int countNodes(ASTNode* node) {
+    if (!node) return 0;
+    int n = 1;
+    for (ASTNode* c : node->children) n += countNodes(c);
+    return n;
+}
+
+ASTNode* parse(const std::string& src) {
+    return buildAST(toPostfix(tokenize(src)));
+}
+
+struct Curve {
+    ExprKind kind;
+    CompiledExpr fx, fy;
+};
+
+// --- Parser ---
+void benchParser() {
+    std::vector<std::string> sources(std::begin(EXPLICIT_CORPUS), std::end(EXPLICIT_CORPUS));
+    std::vector<std::vector<Token>> tokens, postfix;
+    for (const auto& s : sources) {
+        tokens.push_back(tokenize(s));
+        postfix.push_back(toPostfix(tokens.back()));
+    }
+    double n = (double)sources.size();
+
+    run("parse/tokenize", n, "expr", [&] {
+        for (const auto& s : sources) sink = (double)tokenize(s).size();
+    });
+    run("parse/toPostfix", n, "expr", [&] {
+        for (const auto& t : tokens) sink = (double)toPostfix(t).size();
+    });
+    run("parse/buildAST", n, "expr", [&] {
+        for (const auto& p : postfix) freeAST(buildAST(p));
+    });
+    run("parse/full", n, "expr", [&] {
+        for (const auto& s : sources) freeAST(parse(s));
+    });
+    run("parse/compile", n, "expr", [&] {
+        for (const auto& s : sources) {
+            ASTNode* a = parse(s);
+            sink = (double)compileExpression(a, {"x"}).code.size();
+            freeAST(a);
+        }
+    });
+
+    // Every prefix of each expression, as if parsed on each keystroke while
+    // typing it; most are incomplete and end in a diagnostic
+    std::vector<std::string> prefixes;
+    for (const auto& s : sources)
+        for (size_t len = 1; len <= s.size(); ++len) prefixes.push_back(s.substr(0, len));
+    ParseDiagnostics diagnostics;
+    run("parse/keystrokes", (double)prefixes.size(), "prefix", [&] {
+        for (const auto& s : prefixes) {
+            diagnostics.clear();
+            freeAST(buildAST(toPostfix(tokenize(s, &diagnostics), &diagnostics), &diagnostics));
+        }
+        sink = (double)diagnostics.total();
+    });
+}
+
+// Each malformed input must report the right error at the right place,
+// and valid ones none
+struct DiagnosticCase {
+    const char* source;
+    ParseError code;
+    uint32_t begin, end;
+};
+
+const DiagnosticCase DIAGNOSTIC_CASES[] = {
+    {"sin(x", ParseError::UNMATCHED_OPEN, 3, 4},
+    {"(x+1)*(x-2", ParseError::UNMATCHED_OPEN, 6, 7},
+    {"x+1)", ParseError::UNMATCHED_CLOSE, 3, 4},
+    {"2 # x", ParseError::UNKNOWN_CHARACTER, 2, 3},
+    {"1.2.3", ParseError::EXTRA_DECIMAL_POINT, 3, 4},
+    {"x + ", ParseError::MISSING_OPERAND, 2, 3},
+    {"*x", ParseError::MISSING_OPERAND, 0, 1},
+    {"-", ParseError::MISSING_OPERAND, 0, 1},
+    {"1, 2", ParseError::MISPLACED_COMMA, 1, 2},
+    {"max(,)", ParseError::MISSING_ARGUMENT, 0, 6},
+    {"sin()", ParseError::MISSING_ARGUMENT, 0, 5},
+    {"x*max(1,)", ParseError::MISSING_ARGUMENT, 2, 9},
+    {"max(,x)+1", ParseError::MISSING_ARGUMENT, 0, 7},
+    {"x = 2", ParseError::MISSING_OPERATOR, 4, 5},
+    {"", ParseError::EMPTY, 0, 0},
+};
+
+void checkDiagnostics() {
+    if (!selected("accuracy/diagnostics")) return;
+    size_t wrong = 0, spurious = 0;
+    ParseDiagnostics diagnostics;
+    for (const auto& c : DIAGNOSTIC_CASES) {
+        diagnostics.clear();
+        ASTNode* ast = buildAST(toPostfix(tokenize(c.source, &diagnostics), &diagnostics), &diagnostics);
+        freeAST(ast);
+        bool ok = !diagnostics.empty() && diagnostics[0].code == c.code && diagnostics[0].span.begin == c.begin &&
+                  diagnostics[0].span.end == c.end;
+        if (!ok) {
+            std::printf("# \"%s\": expected %s at [%u, %u)\n", c.source, parseErrorMessage(c.code), c.begin, c.end);
+            ++wrong;
+        }
+    }
+    for (const char* s : EXPLICIT_CORPUS) {
+        diagnostics.clear();
+        freeAST(buildAST(toPostfix(tokenize(s, &diagnostics), &diagnostics), &diagnostics));
+        spurious += !diagnostics.empty();
+    }
+
+    bool ok = wrong == 0 && spurious == 0;
+    std::printf("%-32s %s: %zu of %zu malformed inputs misreported, %zu valid ones with diagnostics\n",
+                "accuracy/diagnostics", ok ? "ok" : "FAILED", wrong, std::size(DIAGNOSTIC_CASES), spurious);
+    if (!ok) failed = true;
+}
+
+// --- Evaluator ---
+void benchEvaluator() {
+    const int POINTS = 1000;
+    std::vector<double> xs(POINTS), ys(POINTS);
+    for (int i = 0; i < POINTS; ++i) xs[i] = -10 + 20.0 * i / (POINTS - 1);
+
+    std::vector<ASTNode*> asts;
+    std::vector<CompiledExpr> progs;
+    double nodes = 0, instructions = 0;
+    for (const char* s : EXPLICIT_CORPUS) {
+        asts.push_back(parse(s));
+        progs.push_back(compileExpression(asts.back(), {"x"}));
+        nodes += countNodes(asts.back());
+        instructions += progs.back().code.size();
+    }
+    if (selected("eval/")) std::printf("# corpus: %zu expressions, %.0f AST nodes, %.0f instructions after folding\n",
+                asts.size(), nodes, instructions);
+
+    run("eval/evaluate", nodes * POINTS, "node", [&] {
+        for (ASTNode* a : asts)
+            for (double x : xs) {
+                try { sink = evaluate(a, x); } catch (...) {}
+            }
+    });
+    run("eval/compiled_scalar", nodes * POINTS, "node", [&] {
+        for (const auto& p : progs)
+            for (double x : xs) sink = evaluateCompiled(p, &x);
+    });
+    run("eval/compiled_batch", nodes * POINTS, "node", [&] {
+        for (const auto& p : progs) {
+            evaluateBatch(p, xs.data(), xs.size(), ys.data());
+            sink = ys[0];
+        }
+    });
+    run("eval/compiled_batch_float", nodes * POINTS, "node", [&] {
+        for (const auto& p : progs) {
+            evaluateBatch(p, xs.data(), xs.size(), ys.data(), Precision::FLOAT);
+            sink = ys[0];
+        }
+    });
+
+    for (ASTNode* a : asts) freeAST(a);
+
+    // integral(f, 0, x) plotted across the window: the batch path reuses
+    // each sample's integral for the next, scalar integrates every point
+    ASTNode* integral = parse("integral(exp(-x^2)*cos(3x),0,x)");
+    CompiledExpr integralProg = compileExpression(integral, {"x"});
+    run("eval/integral_scalar", POINTS, "eval", [&] {
+        for (double x : xs) sink = evaluateCompiled(integralProg, &x);
+    });
+    run("eval/integral_batch", POINTS, "eval", [&] {
+        evaluateBatch(integralProg, xs.data(), xs.size(), ys.data());
+        sink = ys[0];
+    });
+    freeAST(integral);
+
+    // 200-term Fourier square wave: batch runs the body across all points
+    // once per n, scalar walks every term at every point
+    ASTNode* fourier = parse("sum(n,1,200,sin((2n-1)x)/(2n-1))");
+    CompiledExpr fourierProg = compileExpression(fourier, {"x"});
+    run("eval/fourier_scalar", POINTS, "eval", [&] {
+        for (double x : xs) sink = evaluateCompiled(fourierProg, &x);
+    });
+    run("eval/fourier_batch", POINTS, "eval", [&] {
+        evaluateBatch(fourierProg, xs.data(), xs.size(), ys.data());
+        sink = ys[0];
+    });
+    freeAST(fourier);
+
+    // exp(-x^2)*cos(x) does not depend on n and is computed once per point
+    ASTNode* hoisted = parse("sum(n,1,200,n*exp(-x^2)*cos(x))");
+    CompiledExpr hoistedProg = compileExpression(hoisted, {"x"});
+    run("eval/sum_hoisted_batch", POINTS, "eval", [&] {
+        evaluateBatch(hoistedProg, xs.data(), xs.size(), ys.data());
+        sink = ys[0];
+    });
+    freeAST(hoisted);
+}
+
+// sum/prod bounds are rounded and limited per lane: batch lanes with far
+// apart ranges each get their own sum, and indices past 2^53 give NaN
+// instead of a loop that never ends
+void checkLoopAccuracy() {
+    if (!selected("accuracy/loops")) return;
+    struct LoopCase {
+        const char* source;
+        double expected;   // at every x in 0, 1, ..., 4
+    };
+    const LoopCase cases[] = {
+        {"sum(n, 1000*x, 1000*x+2, 1)", 3},
+        {"sum(n, 10^6*x, 10^6*x+5*10^5, 1)", 500001},
+        {"prod(n, x, x+2, 2)", 8},
+        {"sum(n, 10^17, 10^17+100, n)", NAN},
+        {"sum(n, 2^53*(x+1), 2^53*(x+1)+3, 1)", NAN},
+    };
+    std::vector<double> xs = {0, 1, 2, 3, 4}, ys(xs.size());
+    size_t wrong = 0;
+    for (const auto& c : cases) {
+        ASTNode* a = parse(c.source);
+        CompiledExpr prog = compileExpression(a, {"x"});
+        freeAST(a);
+        evaluateBatch(prog, xs.data(), xs.size(), ys.data());
+        for (size_t i = 0; i < xs.size(); ++i) {
+            double scalar = evaluateCompiled(prog, &xs[i]);
+            bool ok = std::isnan(c.expected) ? std::isnan(ys[i]) && std::isnan(scalar) : ys[i] == c.expected && scalar == c.expected;
+            if (!ok) {
+                std::printf("# %s at x = %g: batch %g, scalar %g\n", c.source, xs[i], ys[i], scalar);
+                ++wrong;
+            }
+        }
+    }
+    bool ok = wrong == 0;
+    std::printf("%-32s %s: %zu of %zu values wrong\n", "accuracy/loops", ok ? "ok" : "FAILED", wrong,
+                std::size(cases) * xs.size());
+    if (!ok) failed = true;
+}
+
+// --- Special functions versus their std:: equivalents ---
+struct SpecialCase {
+    const char* name;
+    double (*ours)(double);
+    double (*reference)(double);     // std:: implementation, if there is one
+    long double (*exact)(long double);
+    double lo, hi;
+    bool relative;                   // relative (else absolute) error bound
+    double bound;
+};
+
+const long double LD_PI = 3.141592653589793238462643383279502884L;
+
+// No libm has digamma: shift up to x >= 30 by psi(x) = psi(x + 1) - 1/x,
+// then the asymptotic series, all in long double
+long double digammaReference(long double x) {
+    long double shift = 0;
+    for (; x < 30; x += 1) shift -= 1 / x;
+    long double w = 1 / (x * x);
+    return shift + std::log(x) - 0.5L / x -
+           w * (1.0L / 12 - w * (1.0L / 120 - w * (1.0L / 252 - w * (1.0L / 240 - w * (1.0L / 132)))));
+}
+
+// Likewise for trigamma, with psi'(x) = psi'(x + 1) + 1/x^2
+long double trigammaReference(long double x) {
+    long double shift = 0;
+    for (; x < 30; x += 1) shift += 1 / (x * x);
+    long double w = 1 / (x * x);
+    return shift + (1 + 0.5L / x + w * (1.0L / 6 - w * (1.0L / 30 - w * (1.0L / 42 - w * (1.0L / 30))))) / x;
+}
+
+const SpecialCase SPECIAL_CASES[] = {
+    {"gamma", specialGamma, [](double x) { return std::tgamma(x); },
+     [](long double x) { return std::tgamma(x); }, -20.5, 40, true, 2e-13},
+    {"lgamma", specialLgamma, [](double x) { return std::lgamma(x); },
+     [](long double x) { return std::lgamma(x); }, 0.5, 3, false, 5e-15},
+    {"erf", specialErf, [](double x) { return std::erf(x); },
+     [](long double x) { return std::erf(x); }, -6, 6, true, 1e-15},
+    {"erfc", specialErfc, [](double x) { return std::erfc(x); },
+     [](long double x) { return std::erfc(x); }, -6, 26, true, 2e-15},
+    {"normpdf", specialNormPdf, [](double x) { return std::exp(-0.5 * x * x) / std::sqrt(2 * M_PI); },
+     [](long double x) { return std::exp(-x * x / 2) / std::sqrt(2 * LD_PI); }, -5, 5, true, 4e-15},
+    {"normcdf", specialNormCdf, [](double x) { return 0.5 * std::erfc(-x * M_SQRT1_2); },
+     [](long double x) { return std::erfc(-x / std::sqrt(2.0L)) / 2; }, -5, 5, true, 4e-15},
+    {"besselj0", specialBesselJ0, [](double x) { return std::cyl_bessel_j(0.0, x); },
+     [](long double x) { return std::cyl_bessel_j(0.0L, x); }, 0, 50, false, 2e-15},
+    {"besselj1", specialBesselJ1, [](double x) { return std::cyl_bessel_j(1.0, x); },
+     [](long double x) { return std::cyl_bessel_j(1.0L, x); }, 0, 50, false, 2e-15},
+    {"digamma", specialDigamma, nullptr, digammaReference, 0.5, 50, false, 4e-15},
+    {"trigamma", specialTrigamma, nullptr, trigammaReference, 0.5, 50, false, 4e-15},
+};
+
+void benchSpecial() {
+    const int POINTS = 1000;
+    std::vector<double> xs(POINTS), ys(POINTS);
+    char name[64];
+    for (const auto& c : SPECIAL_CASES) {
+        for (int i = 0; i < POINTS; ++i) xs[i] = c.lo + (c.hi - c.lo) * (i + 0.5) / POINTS;
+        std::snprintf(name, sizeof(name), "special/%s", c.name);
+        run(name, POINTS, "eval", [&] {
+            for (int i = 0; i < POINTS; ++i) ys[i] = c.ours(xs[i]);
+            sink = ys[0];
+        });
+        if (!c.reference) continue;
+        std::snprintf(name, sizeof(name), "special/%s_std", c.name);
+        run(name, POINTS, "eval", [&] {
+            for (int i = 0; i < POINTS; ++i) ys[i] = c.reference(xs[i]);
+            sink = ys[0];
+        });
+    }
+    run("special/beta", POINTS, "eval", [&] {
+        for (int i = 0; i < POINTS; ++i) ys[i] = specialBeta(0.5 + i * 0.01, 2.5);
+        sink = ys[0];
+    });
+    run("special/beta_std", POINTS, "eval", [&] {
+        for (int i = 0; i < POINTS; ++i) ys[i] = std::beta(0.5 + i * 0.01, 2.5);
+        sink = ys[0];
+    });
+}
+
+// Checks each function against its long double libm counterpart at the
+// accuracy documented in special.h
+void checkSpecialAccuracy() {
+    if (!selected("accuracy/special")) return;
+    const int POINTS = 100000;
+    for (const auto& c : SPECIAL_CASES) {
+        double worst = 0, at = 0;
+        for (int i = 0; i < POINTS; ++i) {
+            double x = c.lo + (c.hi - c.lo) * (i + 0.5) / POINTS;
+            long double exact = c.exact(x);
+            long double err = std::fabs(c.ours(x) - exact);
+            if (c.relative && exact != 0) err /= std::fabs(exact);
+            if (!(err <= worst)) { worst = (double)err; at = x; }
+        }
+        bool ok = worst <= c.bound;
+        std::printf("accuracy/special/%-15s %s: max %s error %.3g at x = %.6g (bound %.0e)\n", c.name,
+                    ok ? "ok" : "FAILED", c.relative ? "relative" : "absolute", worst, at, c.bound);
+        if (!ok) failed = true;
+    }
+}
+
+// --- Full frame (what DrawGraphArea computes, without drawing) ---
+void benchFrame() {
+    const int NUM_POINTS = 1000;   // DrawGraphArea samples per explicit curve
+    const int GRAPH_W = 790, GRAPH_H = 700;
+
+    std::vector<ASTNode*> asts;
+    std::vector<Curve> curves;
+    std::vector<AnalysisCurve> analysisCurves;
+    for (const char* s : EXPLICIT_CORPUS) {
+        asts.push_back(parse(s));
+        curves.push_back({ExprKind::EXPLICIT, compileExpression(asts.back(), {"x"}), {}});
+    }
+    for (const char* s : CURVE_CORPUS) {
+        ExprDefinition def = classifyExpression(s);
+        const char* var = def.kind == ExprKind::POLAR ? "theta" : "t";
+        ASTNode* a = parse(def.body);
+        Curve c{def.kind, compileExpression(a, {var}), {}};
+        freeAST(a);
+        if (def.kind == ExprKind::PARAMETRIC) {
+            a = parse(def.bodyY);
+            c.fy = compileExpression(a, {var});
+            freeAST(a);
+        }
+        curves.push_back(c);
+    }
+
+    for (size_t i = 0; i < asts.size(); ++i)
+        analysisCurves.push_back({EXPLICIT_CORPUS[i], &curves[i].fx});
+
+    std::vector<double> ys;
+    std::vector<Point2> pts;
+    PolylineStats polyStats;
+    auto sampleAll = [&](const PlotWindow& w) {
+        for (const auto& c : curves) {
+            if (c.kind == ExprKind::EXPLICIT) {
+                sampleFunction(c.fx, w.xMin, w.xMax, NUM_POINTS, ys, plotPrecision(w));
+                buildExplicitPolyline(c.fx, ys, w, pts, &polyStats);
+            } else if (c.kind == ExprKind::PARAMETRIC) {
+                sampleParametric(c.fx, c.fy, PARAMETRIC_T_MIN, PARAMETRIC_T_MAX, w, pts);
+            } else {
+                samplePolar(c.fx, POLAR_THETA_MIN, POLAR_THETA_MAX, w, pts);
+            }
+        }
+    };
+
+    PlotWindow window{-10, 10, -10, 10, GRAPH_W, GRAPH_H};
+    if (selected("frame/sampling")) {
+        sampleAll(window);
+        std::printf("# polylines: %zu explicit curves split at %zu jumps for %zu extra evaluations (%d samples each)\n",
+                    asts.size(), polyStats.breaks, polyStats.evaluations, NUM_POINTS + 1);
+    }
+    run("frame/sampling", 1, "frame", [&] { sampleAll(window); });
+    PlotWindow fastWindow = window;
+    fastWindow.fastMath = true;
+    run("frame/sampling_float", 1, "frame", [&] { sampleAll(fastWindow); });
+
+    CurveAnalyzer staticAnalyzer;
+    run("frame/static", 1, "frame", [&] {
+        sampleAll(window);
+        sink = (double)staticAnalyzer.update(analysisCurves, window.xMin, window.xMax, NUM_POINTS).size();
+    });
+
+    // Panning moves the window every frame; the analysis only covers the
+    // range that came into view
+    CurveAnalyzer panAnalyzer;
+    double offset = 0;
+    run("frame/panning", 1, "frame", [&] {
+        offset += 0.01;
+        PlotWindow w{-10 + offset, 10 + offset, -10, 10, GRAPH_W, GRAPH_H};
+        sampleAll(w);
+        sink = (double)panAnalyzer.update(analysisCurves, w.xMin, w.xMax, NUM_POINTS).size();
+    });
+
+    for (ASTNode* a : asts) freeAST(a);
+}
+
+// Explicit polylines must not draw a segment across a known jump or pole,
+// must find each one, and must not break continuous curves however steep.
+// Every point lies inside the window and the search stays within its bound.
+struct PolylineCase {
+    const char* source;
+    double firstJump, period;   // jumps at firstJump + k * period; period 0 for one jump, NaN for none
+};
+
+const PolylineCase POLYLINE_CASES[] = {
+    {"tan(x)", M_PI / 2, M_PI},
+    {"floor(x)", 0, 1},
+    {"mod(x + 20, 2)", 0, 2},   // mod keeps the sign of x, so shift it off 0
+    {"1/x", 0, 0},
+    {"sign(x - 1) * 3", 1, 0},
+    {"x^3", NAN, 0},
+    {"exp(x)", NAN, 0},
+    {"sqrt(9 - x^2)", NAN, 0},
+    {"erf(50x)", NAN, 0},
+    {"5sin(50x)", NAN, 0},
+};
+
+void checkPolylineAccuracy() {
+    if (!selected("accuracy/polyline")) return;
+    const int NUM_POINTS = 1000;
+    const size_t MAX_EXTRA = (size_t)MAX_JUMP_CHECKS * JUMP_BISECTIONS;
+
+    std::vector<double> ys;
+    std::vector<Point2> pts;
+    size_t crossed = 0, missed = 0, spurious = 0, outside = 0, overBudget = 0, found = 0;
+    // No sample lands on a jump in either window
+    for (const PlotWindow& w : {PlotWindow{-9.65, 10.35, -10, 10, 790, 700}, PlotWindow{-2.35, 2.95, -3, 3, 790, 700}}) {
+        for (const auto& c : POLYLINE_CASES) {
+            ASTNode* ast = parse(c.source);
+            CompiledExpr f = compileExpression(ast, {"x"});
+            freeAST(ast);
+            sampleFunction(f, w.xMin, w.xMax, NUM_POINTS, ys);
+            PolylineStats stats;
+            buildExplicitPolyline(f, ys, w, pts, &stats);
+
+            std::vector<double> jumps;
+            if (!std::isnan(c.firstJump)) {
+                if (c.period == 0) jumps.push_back(c.firstJump);
+                else
+                    for (double k = std::ceil((w.xMin - c.firstJump) / c.period); c.firstJump + k * c.period < w.xMax; ++k)
+                        jumps.push_back(c.firstJump + k * c.period);
+            }
+            for (size_t i = 0; i < pts.size(); ++i) {
+                const Point2& q = pts[i];
+                if (std::isnan(q.x)) continue;
+                double tol = 1e-9 * (w.xMax - w.xMin);
+                if (q.x < w.xMin - tol || q.x > w.xMax + tol || q.y < w.yMin - tol || q.y > w.yMax + tol) ++outside;
+                if (i == 0 || std::isnan(pts[i - 1].x)) continue;
+                for (double j : jumps) crossed += pts[i - 1].x < j && j < q.x;
+            }
+            if (jumps.empty()) spurious += stats.breaks;
+            else if (stats.breaks < jumps.size()) missed += jumps.size() - stats.breaks;
+            found += stats.breaks;
+            overBudget += stats.evaluations > MAX_EXTRA;
+        }
+    }
+
+    bool ok = crossed == 0 && missed == 0 && spurious == 0 && outside == 0 && overBudget == 0;
+    std::printf("%-32s %s: %zu breaks, %zu segments across a jump, %zu jumps missed, %zu breaks in continuous curves, "
+                "%zu points outside, %zu curves over %zu extra evaluations\n",
+                "accuracy/polyline", ok ? "ok" : "FAILED", found, crossed, missed, spurious, outside, overBudget, MAX_EXTRA);
+    if (!ok) failed = true;
+}
+
+// --- Shared subexpressions across the expression list ---
+std::vector<CompiledExpr> compileExplicit(const char* const* sources, size_t count) {
+    std::vector<CompiledExpr> progs;
+    for (size_t i = 0; i < count; ++i) {
+        ASTNode* ast = parse(sources[i]);
+        progs.push_back(compileExpression(ast, {"x"}));
+        freeAST(ast);
+    }
+    return progs;
+}
+
+void benchShared() {
+    const int NUM_POINTS = 1000;
+    std::vector<CompiledExpr> progs = compileExplicit(SHARED_CORPUS, std::size(SHARED_CORPUS));
+    std::vector<const CompiledExpr*> ptrs;
+    for (const auto& p : progs) ptrs.push_back(&p);
+
+    if (selected("frame/explicit_")) {
+        for (int corpus = 0; corpus < 2; ++corpus) {
+            std::vector<CompiledExpr> c = corpus == 0 ? compileExplicit(EXPLICIT_CORPUS, std::size(EXPLICIT_CORPUS)) : progs;
+            std::vector<const CompiledExpr*> cp;
+            for (const auto& p : c) cp.push_back(&p);
+            SharedSampler sampler;
+            SharingStats stats;
+            sampler.update(cp, -10, 10, NUM_POINTS, Precision::DOUBLE, &stats);
+            std::printf("# sharing (%s corpus): %zu programs, %zu instructions per sample, %zu with %zu shared subexpressions\n",
+                        corpus == 0 ? "explicit" : "shared", stats.programs, stats.instructions, stats.evaluated,
+                        stats.shared);
+        }
+    }
+
+    std::vector<double> ys;
+    run("frame/explicit_separate", (double)progs.size(), "curve", [&] {
+        for (const auto& p : progs) sampleFunction(p, -10, 10, NUM_POINTS, ys);
+    });
+    SharedSampler sampler;
+    run("frame/explicit_shared", (double)progs.size(), "curve", [&] {
+        sink = sampler.update(ptrs, -10, 10, NUM_POINTS)[0][0];
+    });
+}
+
+// SharedSampler must reproduce sampleFunction exactly, in both precisions,
+// and rebuild its DAG when the expression list changes
+void checkSharedAccuracy() {
+    if (!selected("accuracy/shared")) return;
+    const int NUM_POINTS = 1000;
+    std::vector<CompiledExpr> progs = compileExplicit(EXPLICIT_CORPUS, std::size(EXPLICIT_CORPUS));
+    std::vector<CompiledExpr> more = compileExplicit(SHARED_CORPUS, std::size(SHARED_CORPUS));
+    progs.insert(progs.end(), more.begin(), more.end());
+    const char* const OWN[] = {"sum(n, 1, 5, sin(x)^n)", "sin(x) + integral(x^2, 0, 1)"};   // evaluated on their own
+    more = compileExplicit(OWN, std::size(OWN));
+    progs.insert(progs.end(), more.begin(), more.end());
+
+    std::vector<const CompiledExpr*> lists[2];
+    for (const auto& p : progs) lists[0].push_back(&p);
+    lists[1].assign(lists[0].rbegin(), lists[0].rend());
+    lists[1].pop_back();
+
+    SharedSampler sampler;
+    std::vector<double> ys;
+    size_t compared = 0, differ = 0;
+    for (const auto& list : lists) {
+        for (Precision precision : {Precision::DOUBLE, Precision::FLOAT}) {
+            const auto& shared = sampler.update(list, -9.7, 10.3, NUM_POINTS, precision);
+            for (size_t k = 0; k < list.size(); ++k) {
+                sampleFunction(*list[k], -9.7, 10.3, NUM_POINTS, ys, precision);
+                for (size_t i = 0; i < ys.size(); ++i) {
+                    bool same = std::isnan(ys[i]) ? std::isnan(shared[k][i]) : ys[i] == shared[k][i];
+                    differ += !same;
+                }
+                compared += ys.size();
+            }
+        }
+    }
+
+    bool ok = differ == 0;
+    std::printf("%-32s %s: %zu of %zu samples differ from sampleFunction\n", "accuracy/shared",
+                ok ? "ok" : "FAILED", differ, compared);
+    if (!ok) failed = true;
+}
+
+// --- Inequality regions: tiled rasterizer versus evaluating every pixel ---
+const char* REGION_CORPUS[] = {
+    "x^2 + y^2 <= 9",
+    "y < sin(x)",
+    "x*y < 1",
+    "abs(x) + abs(y) < 6",
+    "y^2 > x^3 - 4x",
+    "sin(x)*cos(y) > 0.2",
+    "sin(x^2 + y^2) > 0",
+    "mod(floor(x) + floor(y), 2) < 1",
+    "erf(x) > y/3",   // no interval form: classified by sampling
+};
+
+struct Region {
+    CompiledExpr f;   // left - right over x, y
+    Relation relation;
+};
+
+std::vector<Region> compileRegions() {
+    std::vector<Region> regions;
+    for (const char* s : REGION_CORPUS) {
+        ExprDefinition def = classifyExpression(s);
+        ASTNode diff(NodeType::BINARY_OP, "-");
+        diff.children = {parse(def.body), parse(def.bodyY)};
+        regions.push_back({compileExpression(&diff, {"x", "y"}), def.relation});
+        for (ASTNode* c : diff.children) freeAST(c);
+    }
+    return regions;
+}
+
+void benchRegions() {
+    const int GRAPH_W = 790, GRAPH_H = 700;
+    std::vector<Region> regions = compileRegions();
+    PlotWindow window{-10, 10, -10, 10, GRAPH_W, GRAPH_H};
+    std::vector<uint8_t> mask;
+
+    if (selected("frame/region_")) {
+        RegionStats stats, total;
+        for (const auto& r : regions) {
+            rasterizeRegion(r.f, r.relation, window, mask, &stats);
+            total.tiles += stats.tiles;
+            total.boundaryTiles += stats.boundaryTiles;
+            total.evaluations += stats.evaluations;
+        }
+        std::printf("# regions: %zu inequalities, %zu of %zu tiles on a boundary, %zu evaluations for %zu pixels\n",
+                    regions.size(), total.boundaryTiles, total.tiles, total.evaluations,
+                    regions.size() * GRAPH_W * GRAPH_H);
+    }
+
+    run("frame/region_tiled", 1, "frame", [&] {
+        for (const auto& r : regions) rasterizeRegion(r.f, r.relation, window, mask);
+        sink = mask[0];
+    });
+    run("frame/region_exact", 1, "frame", [&] {
+        for (const auto& r : regions) rasterizeRegionExact(r.f, r.relation, window, mask);
+        sink = mask[0];
+    });
+}
+
+// --- Heatmaps: full evaluation versus tiles reused while panning ---
+const char* HEATMAP_CORPUS[] = {
+    "sin(x)*cos(y)",
+    "x^2 - y^2",
+    "sin(x*y)/(1 + x^2 + y^2)",
+    "exp(-(x^2 + y^2)/20)*cos(x + y)",
+};
+
+std::vector<CompiledExpr> compileHeatmaps() {
+    std::vector<CompiledExpr> progs;
+    for (const char* s : HEATMAP_CORPUS) {
+        ASTNode* a = parse(s);
+        progs.push_back(compileExpression(a, {"x", "y"}));
+        freeAST(a);
+    }
+    return progs;
+}
+
+void benchHeatmap() {
+    const int GRAPH_W = 790, GRAPH_H = 700;
+    std::vector<CompiledExpr> progs = compileHeatmaps();
+    size_t n = progs.size();
+
+    run("frame/heatmap_full", (double)n, "heatmap", [&] {
+        for (size_t i = 0; i < n; ++i) {
+            HeatmapGrid grid;
+            sink = grid.update(progs[i], HEATMAP_CORPUS[i], {-10, 10, -10, 10, GRAPH_W, GRAPH_H})[0];
+        }
+    });
+
+    // Three pixels to the right per frame, as a mouse drag would
+    std::vector<HeatmapGrid> grids(n);
+    HeatmapStats stats;
+    double offset = 0, pixel = 20.0 / GRAPH_W;
+    run("frame/heatmap_panning", (double)n, "heatmap", [&] {
+        offset += 3 * pixel;
+        PlotWindow w{-10 + offset, 10 + offset, -10, 10, GRAPH_W, GRAPH_H};
+        for (size_t i = 0; i < n; ++i) sink = grids[i].update(progs[i], HEATMAP_CORPUS[i], w, &stats)[0];
+    });
+    if (selected("frame/heatmap_panning"))
+        std::printf("# heatmap panning: %zu tiles computed, %zu reused\n", stats.tilesComputed, stats.tilesReused);
+}
+
+// Features kept across a pan must match an analysis of the window from
+// scratch: the same points, at x within a thousandth of a sample step
+void checkAnalysisReuse() {
+    if (!selected("accuracy/analysis_reuse")) return;
+    const int NUM_POINTS = 1000;
+    std::vector<CompiledExpr> progs;
+    std::vector<AnalysisCurve> curves;
+    for (const char* s : EXPLICIT_CORPUS) {
+        ASTNode* a = parse(s);
+        progs.push_back(compileExpression(a, {"x"}));
+        freeAST(a);
+    }
+    for (size_t i = 0; i < progs.size(); ++i) curves.push_back({EXPLICIT_CORPUS[i], &progs[i]});
+
+    CurveAnalyzer panned;
+    size_t differ = 0, points = 0;
+    double x = -10, worst = 0;
+    for (int frame = 0; frame < 40; ++frame) {
+        x += (frame % 7 - 2) * 0.0371;
+        double step = 20.0 / NUM_POINTS;
+        std::vector<FeaturePoint> a = panned.update(curves, x, x + 20, NUM_POINTS);
+        CurveAnalyzer fresh;
+        const std::vector<FeaturePoint>& b = fresh.update(curves, x, x + 20, NUM_POINTS);
+        points += b.size();
+        if (a.size() != b.size()) {
+            differ += std::max(a.size(), b.size()) - std::min(a.size(), b.size());
+            continue;
+        }
+        for (size_t k = 0; k < a.size(); ++k) {
+            bool same = a[k].kind == b[k].kind && a[k].curveA == b[k].curveA && a[k].curveB == b[k].curveB;
+            double dx = std::fabs(a[k].x - b[k].x);
+            if (!same || !(dx <= 1e-3 * step)) ++differ;
+            else worst = std::max(worst, dx / step);
+        }
+    }
+
+    bool ok = differ == 0;
+    std::printf("%-32s %s: %zu of %zu points differ after panning, max %.2g steps apart\n",
+                "accuracy/analysis_reuse", ok ? "ok" : "FAILED", differ, points, worst);
+    if (!ok) failed = true;
+}
+
+// Tiles reused across a pan must match a grid built from scratch
+void checkHeatmapReuse() {
+    if (!selected("accuracy/heatmap")) return;
+    const int GRAPH_W = 790, GRAPH_H = 700;
+    std::vector<CompiledExpr> progs = compileHeatmaps();
+
+    size_t differ = 0, pixels = 0;
+    for (size_t i = 0; i < progs.size(); ++i) {
+        HeatmapGrid panned;
+        double x = -10, y = -10;
+        for (int frame = 0; frame < 40; ++frame) {
+            x += (frame % 7 - 3) * 0.37 * 20 / GRAPH_W * 5;
+            y -= (frame % 5 - 2) * 0.29 * 20 / GRAPH_H * 5;
+            PlotWindow w{x, x + 20, y, y + 20.0 * GRAPH_H / GRAPH_W, GRAPH_W, GRAPH_H};
+            const std::vector<float>& a = panned.update(progs[i], HEATMAP_CORPUS[i], w);
+            HeatmapGrid fresh;
+            const std::vector<float>& b = fresh.update(progs[i], HEATMAP_CORPUS[i], w);
+            for (size_t k = 0; k < a.size(); ++k)
+                differ += !(a[k] == b[k] || (std::isnan(a[k]) && std::isnan(b[k])));
+            pixels += a.size();
+        }
+    }
+
+    bool ok = differ == 0;
+    std::printf("%-32s %s: %zu of %zu pixels differ after panning\n", "accuracy/heatmap_reuse",
+                ok ? "ok" : "FAILED", differ, pixels);
+    if (!ok) failed = true;
+}
+
+// Pixels the tiled rasterizer gets wrong, over a few zoom levels. Tiles
+// settled by interval bounds should never be wrong; sampled ones can miss
+// features that fit between their samples.
+void checkRegionAccuracy() {
+    if (!selected("accuracy/region")) return;
+    const int GRAPH_W = 790, GRAPH_H = 700;
+    const double MAX_WRONG_FRACTION = 1e-4;
+
+    std::vector<Region> regions = compileRegions();
+    std::vector<uint8_t> tiled, exact;
+    size_t pixels = 0, wrong = 0;
+    for (double width : {40.0, 20.0, 5.0}) {
+        double h = width * GRAPH_H / GRAPH_W;
+        PlotWindow w{-width / 2 + 0.3, width / 2 + 0.3, -h / 2 - 0.2, h / 2 - 0.2, GRAPH_W, GRAPH_H};
+        for (const auto& r : regions) {
+            rasterizeRegion(r.f, r.relation, w, tiled);
+            rasterizeRegionExact(r.f, r.relation, w, exact);
+            for (size_t i = 0; i < exact.size(); ++i) wrong += tiled[i] != exact[i];
+            pixels += exact.size();
+        }
+    }
+
+    double fraction = (double)wrong / pixels;
+    bool ok = fraction <= MAX_WRONG_FRACTION;
+    std::printf("%-32s %s: %zu of %zu pixels differ from per-pixel evaluation (bound %.0e)\n",
+                "accuracy/region", ok ? "ok" : "FAILED", wrong, pixels, MAX_WRONG_FRACTION);
+    if (!ok) failed = true;
+}
+
+// --- Complex functions: domain coloring at graph resolution ---
+const char* COMPLEX_CORPUS[] = {
+    "z",
+    "(z^2-1)*(z-2-i)^2/(z^2+2+2i)",
+    "sin(z)",
+    "exp(1/z)",
+    "sqrt(z)*ln(z)",
+    "z^(1/2+i)",
+    "tan(z)/z^3",
+    "cos(z)^2+sin(z)^2",
+};
+
+std::vector<ComplexProgram> compileComplexCorpus() {
+    std::vector<ComplexProgram> progs;
+    for (const char* src : COMPLEX_CORPUS) {
+        ASTNode* ast = parse(src);
+        progs.push_back(compileComplex(ast));
+        freeAST(ast);
+    }
+    return progs;
+}
+
+void benchComplex() {
+    const int GRAPH_W = 790, GRAPH_H = 700;
+    std::vector<ComplexProgram> progs = compileComplexCorpus();
+    std::vector<uint8_t> rgba;
+    run("frame/complex_domain", (double)progs.size(), "image", [&] {
+        for (const auto& p : progs) {
+            renderDomainColoring(p, {-4, 4, -3.5, 3.5, GRAPH_W, GRAPH_H}, rgba);
+            sink = rgba[0];
+        }
+    });
+
+    // The split re/im batch path against std::complex one point at a time
+    const size_t N = 4096;
+    std::vector<double> zr(N), zi(N), wr(N), wi(N);
+    for (size_t i = 0; i < N; ++i) {
+        zr[i] = -4 + 8.0 * (i % 64) / 63;
+        zi[i] = -4 + 8.0 * (i / 64) / 63 + 1e-3;
+    }
+    run("eval/complex_batch", (double)(N * progs.size()), "point", [&] {
+        for (const auto& p : progs) evaluateComplexBatch(p, zr.data(), zi.data(), N, wr.data(), wi.data());
+        sink = wr[0];
+    });
+    run("eval/complex_scalar", (double)(N * progs.size()), "point", [&] {
+        for (const auto& p : progs)
+            for (size_t i = 0; i < N; ++i) sink = evaluateComplex(p, {zr[i], zi[i]}).real();
+    });
+}
+
+// The batch path against std::complex over a grid crossing the branch cut
+// of log and sqrt (the negative real axis, where both use the sign of the
+// zero imaginary part) and the poles of the corpus
+void checkComplexAccuracy() {
+    if (!selected("accuracy/complex")) return;
+    const int SIDE = 201;
+    std::vector<double> zr, zi;
+    for (int r = 0; r < SIDE; ++r) {
+        for (int c = 0; c < SIDE; ++c) {
+            zr.push_back(-5 + 10.0 * c / (SIDE - 1));
+            zi.push_back(-5 + 10.0 * r / (SIDE - 1));
+        }
+    }
+    zr.push_back(-2);
+    zi.push_back(-0.0);
+    std::vector<double> wr(zr.size()), wi(zr.size());
+
+    double worst = 0;
+    size_t mismatched = 0;
+    for (const char* src : COMPLEX_CORPUS) {
+        ASTNode* ast = parse(src);
+        ComplexProgram prog = compileComplex(ast);
+        freeAST(ast);
+        evaluateComplexBatch(prog, zr.data(), zi.data(), zr.size(), wr.data(), wi.data());
+        for (size_t i = 0; i < zr.size(); ++i) {
+            std::complex<double> ref = evaluateComplex(prog, {zr[i], zi[i]});
+            bool finite = std::isfinite(ref.real()) && std::isfinite(ref.imag());
+            if (finite != (std::isfinite(wr[i]) && std::isfinite(wi[i]))) {
+                ++mismatched;
+                continue;
+            }
+            if (finite)
+                worst = std::max(worst, std::abs(std::complex<double>(wr[i], wi[i]) - ref) / (std::abs(ref) + 1e-300));
+        }
+    }
+
+    bool ok = mismatched == 0 && worst < 1e-12;
+    std::printf("%-32s %s: max relative error %.2g, %zu points defined in only one path\n", "accuracy/complex",
+                ok ? "ok" : "FAILED", worst, mismatched);
+    if (!ok) failed = true;
+}
+
+// --- Symbolic differentiation ---
+void benchSymbolic() {
+    std::vector<ASTNode*> fs;
+    for (const char* src : SYMBOLIC_CORPUS) fs.push_back(parse(src));
+
+    run("symbolic/differentiate", (double)fs.size(), "expr", [&] {
+        for (ASTNode* f : fs) {
+            ASTNode* d = differentiate(f, "x");
+            sink = (double)d->children.size();
+            freeAST(d);
+        }
+    });
+
+    // Node counts of f, its literal derivative and the simplified one, and
+    // the cost of evaluating each derivative compiled against differencing
+    // f at x +- h and forward mode
+    int nodes = 0, rawNodes = 0, simplifiedNodes = 0;
+    std::vector<CompiledExpr> progs, raws, simplified;
+    for (ASTNode* f : fs) {
+        ASTNode* raw = differentiate(f, "x", false);
+        ASTNode* d = differentiate(f, "x");
+        nodes += countNodes(f);
+        rawNodes += countNodes(raw);
+        simplifiedNodes += countNodes(d);
+        progs.push_back(compileExpression(f, {"x"}));
+        raws.push_back(compileExpression(raw, {"x"}));
+        simplified.push_back(compileExpression(d, {"x"}));
+        freeAST(raw);
+        freeAST(d);
+    }
+    if (selected("symbolic/"))
+        std::printf("# symbolic: %zu expressions, %d nodes -> derivative %d nodes literal, %d simplified\n", fs.size(),
+                    nodes, rawNodes, simplifiedNodes);
+
+    const size_t POINTS = 1000;
+    const double H = 1e-6;
+    std::vector<double> xs(POINTS), lo(POINTS), hi(POINTS), ys(POINTS), grad(POINTS);
+    for (size_t i = 0; i < POINTS; ++i) {
+        xs[i] = 0.1 + 3.0 * i / POINTS;
+        lo[i] = xs[i] - H;
+        hi[i] = xs[i] + H;
+    }
+    double evals = (double)(POINTS * fs.size());
+    run("eval/derivative_symbolic", evals, "point", [&] {
+        for (const auto& p : simplified) evaluateBatch(p, xs.data(), POINTS, ys.data());
+        sink = ys[0];
+    });
+    run("eval/derivative_literal", evals, "point", [&] {
+        for (const auto& p : raws) evaluateBatch(p, xs.data(), POINTS, ys.data());
+        sink = ys[0];
+    });
+    run("eval/derivative_central", evals, "point", [&] {
+        for (const auto& p : progs) {
+            evaluateBatch(p, hi.data(), POINTS, ys.data());
+            evaluateBatch(p, lo.data(), POINTS, grad.data());
+            for (size_t i = 0; i < POINTS; ++i) ys[i] = (ys[i] - grad[i]) / (2 * H);
+        }
+        sink = ys[0];
+    });
+    run("eval/derivative_forward", evals, "point", [&] {
+        VarBinding binding{xs.data(), 1};
+        uint32_t wrt = 0;
+        double* grads[1] = {grad.data()};
+        for (const auto& p : progs) evaluateBatchGradient(p, &binding, POINTS, &wrt, 1, ys.data(), grads);
+        sink = grad[0];
+    });
+
+    for (ASTNode* f : fs) freeAST(f);
+}
+
+// Simplified and literal derivatives against forward mode wherever the
+// latter is defined (away from kinks), and formatExpression reading back to the same values
+void checkSymbolicAccuracy() {
+    if (!selected("accuracy/symbolic")) return;
+    // An even count keeps x = 0 off the grid: sqrt(abs(x)) has no derivative
+    // there, forward mode gives 0
+    const size_t POINTS = 1000;
+    std::vector<double> xs(POINTS), ys(POINTS), grad(POINTS), d(POINTS), raw(POINTS), back(POINTS);
+    for (size_t i = 0; i < POINTS; ++i) xs[i] = -5 + 10.0 * (i + 0.5) / POINTS;
+
+    std::vector<const char*> corpus(std::begin(EXPLICIT_CORPUS), std::end(EXPLICIT_CORPUS));
+    corpus.insert(corpus.end(), std::begin(SYMBOLIC_CORPUS), std::end(SYMBOLIC_CORPUS));
+    double worst = 0;
+    const char* worstSrc = "";
+    size_t mismatched = 0, checked = 0;
+    for (const char* src : corpus) {
+        ASTNode* f = parse(src);
+        CompiledExpr prog = compileExpression(f, {"x"});
+        if (!hasDerivativeForm(prog)) {
+            freeAST(f);
+            continue;
+        }
+        ASTNode* dAst = differentiate(f, "x");
+        ASTNode* rawAst = differentiate(f, "x", false);
+        ASTNode* backAst = parse(formatExpression(dAst));
+        evaluateBatch(compileExpression(dAst, {"x"}), xs.data(), POINTS, d.data());
+        evaluateBatch(compileExpression(rawAst, {"x"}), xs.data(), POINTS, raw.data());
+        evaluateBatch(compileExpression(backAst, {"x"}), xs.data(), POINTS, back.data());
+        VarBinding binding{xs.data(), 1};
+        uint32_t wrt = 0;
+        double* grads[1] = {grad.data()};
+        evaluateBatchGradient(prog, &binding, POINTS, &wrt, 1, ys.data(), grads);
+
+        for (size_t i = 0; i < POINTS; ++i) {
+            if (!std::isfinite(grad[i])) continue;
+            ++checked;
+            if (!std::isfinite(d[i]) || !std::isfinite(raw[i]) || back[i] != d[i]) {
+                ++mismatched;
+                continue;
+            }
+            double err = std::max(std::fabs(d[i] - grad[i]), std::fabs(raw[i] - grad[i])) / (1 + std::fabs(grad[i]));
+            if (err > worst) {
+                worst = err;
+                worstSrc = src;
+            }
+        }
+        freeAST(f);
+        freeAST(dAst);
+        freeAST(rawAst);
+        freeAST(backAst);
+    }
+
+    bool ok = mismatched == 0 && worst < 1e-9;
+    std::printf("%-32s %s: max relative error %.2g (%s), %zu of %zu points mismatched\n", "accuracy/symbolic",
+                ok ? "ok" : "FAILED", worst, worstSrc, mismatched, checked);
+    if (!ok) failed = true;
+}
+
+// --- Runtime metrics ---
+void benchMetrics() {
+    const int COUNTS = 1000;
+    run("metrics/count", COUNTS, "count", [&] {
+        for (int i = 0; i < COUNTS; ++i) countMetric(Metric::EVALUATIONS);
+    });
+    run("metrics/read", 1, "read", [&] { sink = (double)readMetric(Metric::EVALUATIONS); });
+}
+
+// Counts made on short-lived threads (like parallelFor's workers) survive
+// them, and exports hold every counter
+void checkMetrics() {
+    if (!selected("accuracy/metrics")) return;
+    const size_t THREADS = 4, BATCHES = 1000, LANES = 100;
+    uint64_t before = readMetric(Metric::EVALUATIONS);
+    ASTNode* ast = parse("x^2+1");
+    CompiledExpr prog = compileExpression(ast, {"x"});
+    freeAST(ast);
+    for (int round = 0; round < 3; ++round) {
+        std::vector<std::thread> pool;
+        for (size_t t = 0; t < THREADS; ++t) {
+            pool.emplace_back([&] {
+                double xs[LANES] = {}, ys[LANES];
+                for (size_t b = 0; b < BATCHES; ++b) evaluateBatch(prog, xs, LANES, ys);
+            });
+        }
+        for (auto& th : pool) th.join();
+    }
+    uint64_t counted = readMetric(Metric::EVALUATIONS) - before;
+    uint64_t expected = 3 * THREADS * BATCHES * LANES;
+    std::string json = metricsJson();
+    bool allNamed = true;
+    for (size_t m = 0; m < (size_t)Metric::COUNT; ++m)
+        allNamed &= json.find(std::string("\"") + metricName((Metric)m) + "\":") != std::string::npos;
+
+    bool ok = counted == expected && allNamed;
+    std::printf("%-32s %s: %llu of %llu evaluations counted across threads, export %s\n", "accuracy/metrics",
+                ok ? "ok" : "FAILED", (unsigned long long)counted, (unsigned long long)expected,
+                allNamed ? "complete" : "missing counters");
+    if (!ok) failed = true;
+}
+
+// --- Regression fitting: forward-mode derivatives versus finite differences ---
+const char* FIT_MODEL = "a*exp(b*x)+c";
+const double FIT_TRUTH[3] = {2.5, -1.3, 0.7};
+
+// n points of the model at FIT_TRUTH on [0, 4], with uniform noise of
+// +-0.05 from a fixed LCG
+void makeFitData(size_t n, std::vector<double>& xs, std::vector<double>& ys) {
+    xs.resize(n);
+    ys.resize(n);
+    uint32_t state = 12345;
+    for (size_t i = 0; i < n; ++i) {
+        state = state * 1664525u + 1013904223u;
+        xs[i] = 4.0 * i / (n - 1);
+        ys[i] = FIT_TRUTH[0] * std::exp(FIT_TRUTH[1] * xs[i]) + FIT_TRUTH[2] + ((state >> 8) / 16777216.0 - 0.5) * 0.1;
+    }
+}
+
+CompiledExpr compileModel(const char* src) {
+    ASTNode* ast = parse(src);
+    CompiledExpr prog = compileExpression(ast, {"x", "a", "b", "c"});
+    freeAST(ast);
+    return prog;
+}
+
+void benchFit() {
+    const size_t N = 1000000;
+    std::vector<double> xs, ys;
+    makeFitData(N, xs, ys);
+    CompiledExpr model = compileModel(FIT_MODEL);
+
+    for (bool differences : {false, true}) {
+        const char* name = differences ? "fit/lm_finite_differences" : "fit/lm_derivatives";
+        FitOptions options;
+        options.finiteDifferences = differences;
+        FitResult fit;
+        run(name, (double)N, "point", [&] {
+            fit = fitLeastSquares(model, xs, ys, {1, 1, 1}, options);
+            sink = fit.rss;
+        });
+        if (selected(name))
+            std::printf("# %s: %d iterations, a = %.4f, b = %.4f, c = %.4f\n", name, fit.iterations, fit.params[0],
+                        fit.params[1], fit.params[2]);
+    }
+}
+
+// Forward-mode derivatives against central differences, and both fits
+// recovering the parameters the data was made with
+void checkFitAccuracy() {
+    if (!selected("accuracy/fit")) return;
+    const char* MODELS[] = {
+        "a*exp(b*x)+c", "a*sin(b*x+c)", "a/(1+exp(-b*(x-c)))", "a*x^b+c", "ln(a*x+b)*c",
+        "atan2(a,x)+erf(b*x)*c", "a*besselj1(b*x)+normcdf(c*x)", "sqrt(a*x)/b+max(c,x)",
+    };
+    const size_t N = 64;
+    std::vector<double> xs(N), values(N), grads(3 * N), plus(N), minus(N);
+    for (size_t i = 0; i < N; ++i) xs[i] = 0.45 + 3.1 * i / N;
+    double params[3] = {1.3, 0.7, 0.4};
+    uint32_t wrt[3] = {1, 2, 3};
+    double* gradRows[3] = {&grads[0], &grads[N], &grads[2 * N]};
+
+    double worst = 0;
+    for (const char* src : MODELS) {
+        CompiledExpr prog = compileModel(src);
+        VarBinding bindings[4] = {{xs.data(), 1}, {&params[0], 0}, {&params[1], 0}, {&params[2], 0}};
+        evaluateBatchGradient(prog, bindings, N, wrt, 3, values.data(), gradRows);
+        for (int k = 0; k < 3; ++k) {
+            double saved = params[k], h = 1e-6;
+            params[k] = saved + h;
+            evaluateBatch(prog, bindings, N, plus.data());
+            params[k] = saved - h;
+            evaluateBatch(prog, bindings, N, minus.data());
+            params[k] = saved;
+            for (size_t i = 0; i < N; ++i) {
+                double numeric = (plus[i] - minus[i]) / (2 * h);
+                worst = std::max(worst, std::fabs(grads[k * N + i] - numeric) / (1 + std::fabs(numeric)));
+            }
+        }
+    }
+
+    std::vector<double> fx, fy;
+    makeFitData(100000, fx, fy);
+    CompiledExpr model = compileModel(FIT_MODEL);
+    double worstParam = 0;
+    for (bool differences : {false, true}) {
+        FitOptions options;
+        options.finiteDifferences = differences;
+        FitResult fit = fitLeastSquares(model, fx, fy, {1, 1, 1}, options);
+        for (int k = 0; k < 3; ++k) worstParam = std::max(worstParam, std::fabs(fit.params[k] - FIT_TRUTH[k]));
+        if (!fit.converged) worstParam = INFINITY;
+    }
+
+    bool ok = worst < 1e-6 && worstParam < 1e-2;
+    std::printf("%-32s %s: derivatives within %.2g of central differences, parameters within %.2g\n",
+                "accuracy/fit", ok ? "ok" : "FAILED", worst, worstParam);
+    if (!ok) failed = true;
+}
+
+// --- Float32 plotting accuracy against the double path ---
+// Samples every corpus expression in each window where plotPrecision picks
+// float32 and measures how far the float curve lands from the double one,
+// in pixels. Samples next to a jump (floor, round, mod) may legitimately
+// fall on the other side of it; those are counted separately.
+void checkFloatAccuracy() {
+    if (!selected("accuracy/float32")) return;
+    const int NUM_POINTS = 1000;
+    const int GRAPH_W = 790, GRAPH_H = 700;
+    const double MAX_PIXEL_ERROR = 0.5;
+    const double MAX_JUMP_FRACTION = 0.002;
+
+    std::vector<CompiledExpr> progs;
+    for (const char* s : EXPLICIT_CORPUS) {
+        ASTNode* a = parse(s);
+        progs.push_back(compileExpression(a, {"x"}));
+        freeAST(a);
+    }
+
+    double worst = 0;
+    size_t windows = 0, compared = 0, jumps = 0, undefined = 0;
+    std::vector<double> yd, yf;
+    auto compare = [&](const CompiledExpr& p, const PlotWindow& w) {
+        ++windows;
+        sampleFunction(p, w.xMin, w.xMax, NUM_POINTS, yd);
+        sampleFunction(p, w.xMin, w.xMax, NUM_POINTS, yf, Precision::FLOAT);
+        double toPixels = GRAPH_H / (w.yMax - w.yMin);
+        for (int i = 0; i <= NUM_POINTS; ++i) {
+            bool visible = !std::isnan(yd[i]) && yd[i] >= w.yMin && yd[i] <= w.yMax;
+            if (!visible) continue;
+            if (std::isnan(yf[i])) { ++undefined; continue; }
+            double err = std::fabs(yd[i] - yf[i]) * toPixels;
+            ++compared;
+            if (err > MAX_PIXEL_ERROR) ++jumps;
+            else worst = std::max(worst, err);
+        }
+    };
+    for (double cx : {0.0, 2.5, -7.0, 40.0, 300.0}) {
+        for (double width : {40.0, 20.0, 4.0, 1.0, 0.25, 0.05}) {
+            for (const auto& p : progs) {
+                double centre = evaluateCompiled(p, &cx);
+                if (!std::isfinite(centre)) centre = 0;
+                double h = width * GRAPH_H / GRAPH_W;
+                PlotWindow w{cx - width / 2, cx + width / 2, centre - h / 2, centre + h / 2, GRAPH_W, GRAPH_H, true};
+                if (plotPrecision(w) == Precision::FLOAT) compare(p, w);
+            }
+        }
+    }
+
+    // Intermediate values past float's range in a window whose scale is
+    // small: exp(90) overflows float32 while the quotient is e
+    ASTNode* a = parse("exp(x)/exp(x-1)");
+    CompiledExpr overflow = compileExpression(a, {"x"});
+    freeAST(a);
+    PlotWindow w{80, 100, -10, 10, GRAPH_W, GRAPH_H, true};
+    size_t before = undefined + jumps;
+    if (plotPrecision(w) == Precision::FLOAT) compare(overflow, w);
+    size_t overflowed = undefined + jumps - before;
+
+    double jumpFraction = compared ? (double)(jumps + undefined) / compared : 0;
+    bool ok = worst <= MAX_PIXEL_ERROR && jumpFraction <= MAX_JUMP_FRACTION && overflowed == 0;
+    std::printf("%-32s %s: %zu windows, %zu samples, max %.4f px, %zu off by > %.1f px, %zu undefined, "
+                "%zu wrong in exp(x)/exp(x-1)\n",
+                "accuracy/float32", ok ? "ok" : "FAILED", windows, compared, worst, jumps, MAX_PIXEL_ERROR, undefined,
+                overflowed);
+    if (!ok) failed = true;
+}
+
+// --- Session load: stored compiled programs versus reparsing the text ---
+void benchSession() {
+    const int ENTRIES = 600;
+    Session session;
+    for (int i = 0; i < ENTRIES; ++i) {
+        const char* src = EXPLICIT_CORPUS[i % (sizeof(EXPLICIT_CORPUS) / sizeof(EXPLICIT_CORPUS[0]))];
+        ASTNode* a = parse(src);
+        SessionEntry e{src, {0, 0, 0, 255}, i % 10 == 0, ExprKind::EXPLICIT, false,
+                       compileExpression(a, {"x"}), {}};
+        freeAST(a);
+        session.entries.push_back(std::move(e));
+    }
+    const std::string path = "bench_session.dsm";
+    if (!saveSession(path, session)) {
+        std::printf("# session: cannot write %s\n", path.c_str());
+        return;
+    }
+
+    run("session/load", ENTRIES, "expr", [&] {
+        Session s;
+        sink = loadSession(path, s) ? (double)s.entries.size() : 0;
+    });
+    run("session/load_reparse", ENTRIES, "expr", [&] {
+        Session s;
+        loadSession(path, s);
+        for (const auto& e : s.entries) {
+            ASTNode* a = parse(e.text);
+            sink = (double)compileExpression(a, {"x"}).code.size();
+            freeAST(a);
+        }
+    });
+    std::remove(path.c_str());
+}
+
+// Programs saved under a kind whose variables they do not match must be
+// rejected on load, so the text is reparsed instead of a program reading
+// slots the plotting code never binds
+void checkSessionVariables() {
+    if (!selected("accuracy/session")) return;
+    auto compile = [](const char* src, const std::vector<std::string>& vars) {
+        ASTNode* a = parse(src);
+        CompiledExpr c = compileExpression(a, vars);
+        freeAST(a);
+        return c;
+    };
+    struct Case {
+        ExprKind kind;
+        const char* text;
+        std::vector<std::string> vars;
+        bool loads;
+    };
+    const Case cases[] = {
+        {ExprKind::EXPLICIT, "x*y", {"x", "y"}, false},   // reads VAR 1 with only x bound
+        {ExprKind::EXPLICIT, "sin(x)", {"x"}, true},
+        {ExprKind::POLAR, "sin(x)", {"x"}, false},
+        {ExprKind::POLAR, "sin(theta)", {"theta"}, true},
+        {ExprKind::HEATMAP, "x*y", {"x", "y"}, true},
+        {ExprKind::HEATMAP, "x", {"x"}, false},
+        {ExprKind::INEQUALITY, "x", {"x"}, true},
+        {ExprKind::INEQUALITY, "t", {"t"}, false},
+    };
+
+    Session session;
+    for (const auto& c : cases)
+        session.entries.push_back({c.text, {0, 0, 0, 255}, true, c.kind, false, compile(c.text, c.vars), {}});
+    session.entries.push_back({"(t, x)", {0, 0, 0, 255}, true, ExprKind::PARAMETRIC, false,
+                               compile("t", {"t"}), compile("x", {"x"})});
+    const std::string path = "bench_session_vars.dsm";
+    Session loaded;
+    bool ok = saveSession(path, session) && loadSession(path, loaded) &&
+              loaded.entries.size() == session.entries.size();
+    std::remove(path.c_str());
+
+    size_t wrong = 0;
+    for (size_t i = 0; ok && i < std::size(cases); ++i) wrong += loaded.entries[i].compiledLoaded != cases[i].loads;
+    if (ok) wrong += loaded.entries.back().compiledLoaded;
+    ok = ok && wrong == 0;
+    std::printf("%-32s %s: %zu of %zu entries loaded or rejected wrongly\n", "accuracy/session_variables",
+                ok ? "ok" : "FAILED", wrong, session.entries.size());
+    if (!ok) failed = true;
+}
+
+// A header whose entry count cannot fit in its payload is rejected before
+// anything is allocated for the entries
+void checkSessionCorrupt() {
+    if (!selected("accuracy/session")) return;
+    unsigned char header[64] = {'D', 'S', 'M', 'S'};
+    uint32_t version = 2, count = 0xFFFFFFF0, sum = 2166136261u;   // FNV-1a of no bytes
+    double bounds[4] = {-10, 10, -10, 10};
+    uint64_t payloadSize = 0;
+    std::memcpy(header + 4, &version, 4);
+    std::memcpy(header + 8, &BYTECODE_VERSION, 4);
+    std::memcpy(header + 12, &count, 4);
+    std::memcpy(header + 16, bounds, sizeof(bounds));
+    std::memcpy(header + 48, &payloadSize, 8);
+    std::memcpy(header + 56, &sum, 4);
+
+    const std::string path = "bench_session_corrupt.dsm";
+    FILE* f = std::fopen(path.c_str(), "wb");
+    bool written = f && std::fwrite(header, 1, sizeof(header), f) == sizeof(header);
+    if (f) std::fclose(f);
+    bool rejected = false;
+    try {
+        Session s;
+        rejected = !loadSession(path, s);
+    } catch (const std::exception&) {
+    }
+    std::remove(path.c_str());
+    bool ok = written && rejected;
+    std::printf("%-32s %s: header claiming %u entries with an empty payload %s\n", "accuracy/session_corrupt",
+                ok ? "ok" : "FAILED", count, rejected ? "rejected" : "not rejected");
+    if (!ok) failed = true;
+}
+
+// The points regressions are fitted to must come back exactly, so a
+// restored regression can be refitted
+void checkSessionPoints() {
+    if (!selected("accuracy/session")) return;
+    const int POINTS = 5000;
+    Session session;
+    ASTNode* a = parse("x");
+    session.entries.push_back({"y ~ a*x + b", {0, 0, 0, 255}, true, ExprKind::REGRESSION, false,
+                               compileExpression(a, {"x"}), {}});
+    freeAST(a);
+    session.pointsName = "points.csv";
+    for (int i = 0; i < POINTS; ++i) {
+        session.pointsX.push_back(i * 0.01);
+        session.pointsY.push_back(std::sin(i * 0.01) + 1e-3 * (i % 7));
+    }
+
+    const std::string path = "bench_session_points.dsm";
+    Session loaded;
+    bool ok = saveSession(path, session) && loadSession(path, loaded);
+    std::remove(path.c_str());
+    ok = ok && loaded.entries.size() == 1 && loaded.pointsName == session.pointsName &&
+         loaded.pointsX == session.pointsX && loaded.pointsY == session.pointsY;
+    std::printf("%-32s %s: %zu points saved, %zu loaded\n", "accuracy/session_points", ok ? "ok" : "FAILED",
+                session.pointsX.size(), loaded.pointsX.size());
+    if (!ok) failed = true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) minTime = std::atof(argv[++i]);
+        else filters.push_back(argv[i]);
+    }
+
+    benchParser();
+    benchEvaluator();
+    benchFrame();
+    benchShared();
+    benchSession();
+    benchSpecial();
+    benchRegions();
+    benchHeatmap();
+    benchFit();
+    benchComplex();
+    benchSymbolic();
+    benchMetrics();
+    checkDiagnostics();
+    checkLoopAccuracy();
+    checkSessionVariables();
+    checkSessionPoints();
+    checkSessionCorrupt();
+    checkFloatAccuracy();
+    checkRegionAccuracy();
+    checkPolylineAccuracy();
+    checkSharedAccuracy();
+    checkAnalysisReuse();
+    checkHeatmapReuse();
+    checkFitAccuracy();
+    checkComplexAccuracy();
+    checkSpecialAccuracy();
+    checkSymbolicAccuracy();
+    checkMetrics();
+    return failed ? 1 : 0;
+}
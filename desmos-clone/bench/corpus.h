@@ -0,0 +1,91 @@
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+// Fixed set of expressions used by the benchmarks. Entries are the kind of
+// thing people actually type into the expression list; keep the list stable
+// so results stay comparable between builds.
+static const char* const EXPLICIT_CORPUS[] = {
+    "x",
+    "2x+1",
+    "x^2-4",
+    "x^3-3x^2+2x-1",
+    "(x+1)*(x-2)*(x+3)/10",
+    "sin(x)",
+    "cos(2x)+sin(3x)/2",
+    "sin(x)/x",
+    "tan(x)",
+    "1/x",
+    "sqrt(abs(x))",
+    "exp(-x^2/2)",
+    "x*exp(-x)*sin(4x)",
+    "log(abs(x)+1)",
+    "ln(x)",
+    "floor(x)+mod(x,2)/2",
+    "abs(sin(x))+abs(cos(x))",
+    "max(sin(x),cos(x),0)",
+    "min(x^2,4-x^2)",
+    "sin(x)^2+cos(x)^2",
+    "atan2(sin(x),cos(x))",
+    "pow(2,x)-3",
+    "round(3sin(x))/3",
+    "sec(x)-csc(x)",
+    "sin(pi*x)*exp(-abs(x)/5)*10",
+    "(x^4-10x^2+9)/(x^2+1)",
+    "sqrt(9-x^2)",
+    "-sqrt(9-x^2)",
+    "log10(x^2+1)*log2(abs(x)+2)",
+    "e^(-x)*cos(tau*x)",
+};
+
+// A session built up by editing: variations of a few curves, which share
+// most of their subexpressions
+static const char* const SHARED_CORPUS[] = {
+    "sin(x)",
+    "sin(x)+1",
+    "2*sin(x)",
+    "sin(x)^2",
+    "sin(x)*cos(x)",
+    "cos(x)*sin(x)+1",
+    "exp(-x^2/8)",
+    "-exp(-x^2/8)",
+    "exp(-x^2/8)*sin(3x)",
+    "exp(-x^2/8)*cos(3x)",
+    "exp(-x^2/8)*(sin(3x)+cos(3x))",
+    "sqrt(9-x^2)",
+    "-sqrt(9-x^2)",
+    "sqrt(9-x^2)/2",
+    "x^3-3x^2+2x-1",
+    "x^3-3x^2+2x+1",
+    "(x^3-3x^2+2x-1)/(x^2+1)",
+    "log(abs(x)+1)*sin(x)",
+    "log(abs(x)+1)*cos(x)",
+    "log(abs(x)+1)",
+};
+
+static const char* const CURVE_CORPUS[] = {
+    "(cos(t), sin(t))",
+    "(t*cos(t), t*sin(t))",
+    "(sin(3t)*5, sin(4t)*5)",
+    "(16sin(t)^3/2, (13cos(t)-5cos(2t)-2cos(3t)-cos(4t))/2)",
+    "r = 5sin(4theta)",
+    "r = theta/4",
+    "r = 3(1+cos(theta))",
+    "r = sqrt(abs(cos(2theta)))*6",
+};
+
+// Nested chain, product and quotient rules, where symbolic derivatives
+// grow fastest
+static const char* const SYMBOLIC_CORPUS[] = {
+    "sin(cos(tan(x)))",
+    "sin(sin(sin(sin(sin(sin(x))))))",
+    "exp(sin(x^2))*ln(x^2+1)",
+    "sqrt(1+x^2)/(1+exp(-x))",
+    "(x^2+1)^5*(x-3)^4",
+    "x^x",
+    "atan2(sin(x),cos(2x))*normcdf(x)",
+    "(x+1)*(x-2)*(x+3)*(x-4)*(x+5)/(x^2+1)",
+    "exp(-x^2/2)*cos(3x)/(2+sin(x))",
+    "ln(1+exp(sin(x)*cos(x)))^2",
+    "x*digamma(x^2+1)",
+};
+#endif
@@ -0,0 +1,379 @@
+#include "analysis.h"
+#include "metrics.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <set>
+
+double safeEvaluate(const CompiledExpr& f, double x) {
+    double y = evaluateCompiled(f, &x);
+    return std::isfinite(y) ? y : std::numeric_limits<double>::quiet_NaN();
+}
+
+namespace {
+
+const int MAX_ITER = 100;
+
+// Lattice indices stay well inside int64_t and below where k * step would
+// no longer step by whole samples
+const double MAX_LATTICE_INDEX = 4503599627370496.0;   // 2^52
+
+// Brent's method: inverse quadratic / secant steps, falling back to bisection
+// whenever a step would leave the bracket or converge too slowly.
+// Requires fa and fb to have opposite signs.
+template <typename F>
+double brentRoot(F f, double a, double b, double fa, double fb, double tol) {
+    double c = a, fc = fa, d = b - a, e = d;
+
+    for (int iter = 0; iter < MAX_ITER; ++iter) {
+        if ((fb > 0) == (fc > 0)) {
+            c = a; fc = fa;
+            d = e = b - a;
+        }
+        if (std::fabs(fc) < std::fabs(fb)) {
+            a = b; b = c; c = a;
+            fa = fb; fb = fc; fc = fa;
+        }
+
+        double tol1 = 2 * std::numeric_limits<double>::epsilon() * std::fabs(b) + 0.5 * tol;
+        double xm = 0.5 * (c - b);
+        if (std::fabs(xm) <= tol1 || fb == 0) return b;
+
+        if (std::fabs(e) >= tol1 && std::fabs(fa) > std::fabs(fb)) {
+            double s = fb / fa, p, q;
+            if (a == c) {
+                p = 2 * xm * s;
+                q = 1 - s;
+            } else {
+                double r = fb / fc;
+                q = fa / fc;
+                p = s * (2 * xm * q * (q - r) - (b - a) * (r - 1));
+                q = (q - 1) * (r - 1) * (s - 1);
+            }
+            if (p > 0) q = -q;
+            p = std::fabs(p);
+            if (2 * p < std::min(3 * xm * q - std::fabs(tol1 * q), std::fabs(e * q))) {
+                e = d;
+                d = p / q;
+            } else {
+                d = xm; e = d;
+            }
+        } else {
+            d = xm; e = d;
+        }
+
+        a = b; fa = fb;
+        b += (std::fabs(d) > tol1) ? d : (xm > 0 ? tol1 : -tol1);
+        fb = f(b);
+        if (std::isnan(fb)) return std::numeric_limits<double>::quiet_NaN();
+    }
+    return b;
+}
+
+// Brent's minimizer: golden-section search accelerated by parabolic steps.
+template <typename F>
+double brentMinimize(F f, double a, double b, double tol) {
+    const double GOLD = 0.3819660112501051;
+    double x = a + GOLD * (b - a), w = x, v = x;
+    double fx = f(x), fw = fx, fv = fx;
+    double d = 0, e = 0;
+
+    for (int iter = 0; iter < MAX_ITER; ++iter) {
+        double xm = 0.5 * (a + b);
+        double tol1 = tol * std::fabs(x) + 1e-12 * (b - a) + 1e-300;
+        double tol2 = 2 * tol1;
+        if (std::fabs(x - xm) <= tol2 - 0.5 * (b - a)) break;
+
+        bool golden = true;
+        if (std::fabs(e) > tol1) {
+            double r = (x - w) * (fx - fv);
+            double q = (x - v) * (fx - fw);
+            double p = (x - v) * q - (x - w) * r;
+            q = 2 * (q - r);
+            if (q > 0) p = -p;
+            q = std::fabs(q);
+            double etemp = e;
+            e = d;
+            if (std::fabs(p) < std::fabs(0.5 * q * etemp) && p > q * (a - x) && p < q * (b - x)) {
+                d = p / q;
+                double u = x + d;
+                if (u - a < tol2 || b - u < tol2) d = (xm > x) ? tol1 : -tol1;
+                golden = false;
+            }
+        }
+        if (golden) {
+            e = (x >= xm) ? a - x : b - x;
+            d = GOLD * e;
+        }
+
+        double u = x + ((std::fabs(d) >= tol1) ? d : (d > 0 ? tol1 : -tol1));
+        double fu = f(u);
+        if (std::isnan(fu)) fu = std::numeric_limits<double>::infinity();
+
+        if (fu <= fx) {
+            if (u >= x) a = x; else b = x;
+            v = w; fv = fw;
+            w = x; fw = fx;
+            x = u; fx = fu;
+        } else {
+            if (u < x) a = u; else b = u;
+            if (fu <= fw || w == x) {
+                v = w; fv = fw;
+                w = u; fw = fu;
+            } else if (fu <= fv || v == x || v == w) {
+                v = u; fv = fu;
+            }
+        }
+    }
+    return x;
+}
+
+// Refines every sign change of g over the sampled differences ds, which
+// sits at lattice samples first, first + 1, ..., from bracket [from, to) on.
+// A refined point is kept only if g actually vanishes there, which rejects
+// poles (tan, 1/x) and jumps (floor) that also flip sign between samples.
+// emit(i, point) receives each point with the sample i it was found from.
+template <typename G, typename Y, typename E>
+void findSignChanges(G g, Y yAt, const std::vector<double>& ds, int64_t first, double step, size_t from,
+                     size_t to, PointKind kind, E emit) {
+    for (size_t i = from; i < to; ++i) {
+        double d0 = ds[i];
+        if (std::isnan(d0)) continue;
+        double x0 = (double)(first + (int64_t)i) * step;
+        double tol = 1e-12 * (std::fabs(x0) + step * ds.size()) + 1e-300;
+
+        if (d0 == 0) {
+            // Exact zeros count only when isolated, not along a flat stretch
+            bool flatLeft = i > 0 && ds[i - 1] == 0;
+            bool flatRight = i + 1 < ds.size() && ds[i + 1] == 0;
+            if (!flatLeft && !flatRight) emit(i, {kind, x0, yAt(x0), -1, -1});
+            continue;
+        }
+        if (i + 1 >= ds.size()) continue;
+        double d1 = ds[i + 1];
+        if (std::isnan(d1) || d1 == 0 || (d0 > 0) == (d1 > 0)) continue;
+
+        double r = brentRoot(g, x0, x0 + step, d0, d1, tol);
+        if (std::isnan(r)) continue;
+        double gr = g(r);
+        double scale = std::max(std::fabs(d0), std::fabs(d1));
+        if (std::isnan(gr) || std::fabs(gr) > 1e-6 * std::max(1.0, scale)) continue;
+
+        double y = yAt(r);
+        if (std::isnan(y)) continue;
+        emit(i, {kind, r, y, -1, -1});
+    }
+}
+
+// Local extrema of the samples ys (as in findSignChanges) at [from, to)
+template <typename E>
+void findExtrema(const CompiledExpr& f, const std::vector<double>& ys, int64_t first, double step, size_t from,
+                 size_t to, E emit) {
+    for (size_t i = std::max<size_t>(from, 1); i < to && i + 1 < ys.size(); ++i) {
+        double yPrev = ys[i - 1], y = ys[i], yNext = ys[i + 1];
+        if (std::isnan(yPrev) || std::isnan(y) || std::isnan(yNext)) continue;
+
+        bool isMax = y > yPrev && y > yNext;
+        bool isMin = y < yPrev && y < yNext;
+        if (!isMax && !isMin) continue;
+
+        double sgn = isMax ? -1.0 : 1.0;
+        double x = (double)(first + (int64_t)i) * step;
+        double xm = brentMinimize([&](double t) { return sgn * safeEvaluate(f, t); },
+                                  x - step, x + step, 1e-10);
+        double ym = safeEvaluate(f, xm);
+        if (std::isnan(ym)) continue;
+
+        // A smooth extremum falls off about equally on both sides, by about as
+        // much as the samples around it differ; the flank of a pole does not.
+        double spread = std::max(std::fabs(y - yPrev), std::fabs(y - yNext));
+        double dl = sgn * (safeEvaluate(f, xm - step) - ym);
+        double dr = sgn * (safeEvaluate(f, xm + step) - ym);
+        if (!(dl > 0 && dr > 0) || std::max(dl, dr) > 4 * std::min(dl, dr)) continue;
+        if (std::max(dl, dr) > 4 * spread) continue;
+
+        emit(i, {isMax ? PointKind::MAXIMUM : PointKind::MINIMUM, xm, ym, -1, -1});
+    }
+}
+
+void sortAndDedupe(std::vector<FeaturePoint>& pts, double tol) {
+    std::sort(pts.begin(), pts.end(), [](const FeaturePoint& a, const FeaturePoint& b) {
+        return a.x < b.x;
+    });
+    std::vector<FeaturePoint> kept;
+    for (const auto& p : pts) {
+        bool dup = false;
+        for (auto it = kept.rbegin(); it != kept.rend() && p.x - it->x <= tol; ++it) {
+            if (it->kind == p.kind) { dup = true; break; }
+        }
+        if (!dup) kept.push_back(p);
+    }
+    pts.swap(kept);
+}
+
+} // namespace
+
+const std::vector<FeaturePoint>& CurveAnalyzer::update(const std::vector<AnalysisCurve>& curves,
+                                                       double xMin, double xMax, int samples) {
+    Window window{xMin, xMax, samples};
+    result.clear();
+
+    // Panning changes the window's span in its last bits; only a real
+    // change of sample spacing (a zoom) moves the lattice
+    double newStep = (xMax - xMin) / samples;
+    if (!(std::fabs(newStep - step) <= 1e-9 * newStep)) step = newStep;
+    if (!(std::fabs(xMin) < MAX_LATTICE_INDEX * step && std::fabs(xMax) < MAX_LATTICE_INDEX * step)) return result;
+    Span span{step, (int64_t)std::floor(xMin / step), (int64_t)std::ceil(xMax / step)};
+    size_t n = (size_t)(span.last - span.first + 1);
+    double dedupeTol = step * 1e-3;
+
+    // Samples [lo, hi] of old are still in span. Features found from
+    // [lo + 1, hi - 1] saw the same neighbours then as now and are kept.
+    auto overlap = [&span](const Span& old, int64_t& lo, int64_t& hi) {
+        lo = std::max(old.first, span.first);
+        hi = old.step == span.step ? std::min(old.last, span.last) : lo - 1;
+    };
+    // Keeps those features, then emits the ones search(from, to) finds
+    // over the rest of span (indices relative to span.first)
+    auto refresh = [&](const Span& old, std::vector<Found>& found, auto search) {
+        int64_t lo, hi;
+        overlap(old, lo, hi);
+        ++lo;
+        --hi;
+        if (lo > hi) {
+            found.clear();
+            search(0, n);
+            return;
+        }
+        found.erase(std::remove_if(found.begin(), found.end(), [&](const Found& p) {
+            return p.sample < lo || p.sample > hi;
+        }), found.end());
+        search(0, (size_t)(lo - span.first));
+        search((size_t)(hi + 1 - span.first), n);
+    };
+    auto inWindow = [&](const std::vector<Found>& found, std::vector<FeaturePoint>& points) {
+        points.clear();
+        for (const Found& p : found)
+            if (p.point.x >= xMin && p.point.x <= xMax) points.push_back(p.point);
+        sortAndDedupe(points, dedupeTol);
+    };
+
+    // Per-curve work: only curves that are new or were computed for another window
+    std::vector<std::pair<const CompiledExpr*, CurveEntry*>> stale;
+    std::set<std::string> liveKeys;
+    for (const auto& c : curves) {
+        if (!liveKeys.insert(c.key).second) continue;
+        CurveEntry& entry = curveCache[c.key];
+        if (!(entry.window == window) || entry.ys.empty())
+            stale.emplace_back(c.program, &entry);
+    }
+    countMetric(Metric::ANALYSIS_HITS, liveKeys.size() - stale.size());
+    countMetric(Metric::ANALYSIS_MISSES, stale.size());
+
+    parallelFor(stale.size(), [&](size_t k) {
+        const CompiledExpr& f = *stale[k].first;
+        CurveEntry& entry = *stale[k].second;
+
+        // Samples still in view move to their new place; the rest are evaluated
+        int64_t lo, hi;
+        overlap(entry.span, lo, hi);
+        std::vector<double> ys(n), xs;
+        std::vector<size_t> missing;
+        for (size_t i = 0; i < n; ++i) {
+            int64_t s = span.first + (int64_t)i;
+            if (s >= lo && s <= hi) {
+                ys[i] = entry.ys[s - entry.span.first];
+            } else {
+                missing.push_back(i);
+                xs.push_back((double)s * step);
+            }
+        }
+        std::vector<double> values(xs.size());
+        evaluateBatch(f, xs.data(), xs.size(), values.data());
+        for (size_t j = 0; j < missing.size(); ++j)
+            ys[missing[j]] = std::isfinite(values[j]) ? values[j] : std::numeric_limits<double>::quiet_NaN();
+        entry.ys.swap(ys);
+
+        auto emit = [&](size_t i, const FeaturePoint& p) { entry.found.push_back({span.first + (int64_t)i, p}); };
+        refresh(entry.span, entry.found, [&](size_t from, size_t to) {
+            findSignChanges([&f](double x) { return safeEvaluate(f, x); }, [](double) { return 0.0; },
+                            entry.ys, span.first, step, from, to, PointKind::ROOT, emit);
+            findExtrema(f, entry.ys, span.first, step, from, to, emit);
+        });
+        entry.window = window;
+        entry.span = span;
+        inWindow(entry.found, entry.points);
+    });
+
+    // Pairwise intersections reuse the cached samples; only brackets are refined
+    struct PairJob {
+        const CompiledExpr* a;
+        const CompiledExpr* b;
+        const CurveEntry* ca;
+        const CurveEntry* cb;
+        PairEntry* entry;
+    };
+    std::vector<PairJob> pairJobs;
+    std::set<std::pair<std::string, std::string>> livePairs;
+    for (size_t i = 0; i < curves.size(); ++i) {
+        for (size_t j = i + 1; j < curves.size(); ++j) {
+            const AnalysisCurve* a = &curves[i];
+            const AnalysisCurve* b = &curves[j];
+            if (a->key == b->key) continue;
+            if (b->key < a->key) std::swap(a, b);
+            auto pk = std::make_pair(a->key, b->key);
+            if (!livePairs.insert(pk).second) continue;
+            PairEntry& entry = pairCache[pk];
+            if (!(entry.window == window))
+                pairJobs.push_back({a->program, b->program, &curveCache[a->key], &curveCache[b->key], &entry});
+        }
+    }
+
+    parallelFor(pairJobs.size(), [&](size_t k) {
+        const PairJob& job = pairJobs[k];
+        std::vector<double> ds(n);
+        for (size_t i = 0; i < n; ++i)
+            ds[i] = job.ca->ys[i] - job.cb->ys[i];
+
+        PairEntry& entry = *job.entry;
+        const CompiledExpr& a = *job.a;
+        const CompiledExpr& b = *job.b;
+        auto emit = [&](size_t i, const FeaturePoint& p) { entry.found.push_back({span.first + (int64_t)i, p}); };
+        refresh(entry.span, entry.found, [&](size_t from, size_t to) {
+            findSignChanges([&a, &b](double x) { return safeEvaluate(a, x) - safeEvaluate(b, x); },
+                            [&a](double x) { return safeEvaluate(a, x); },
+                            ds, span.first, step, from, to, PointKind::INTERSECTION, emit);
+        });
+        entry.window = window;
+        entry.span = span;
+        inWindow(entry.found, entry.points);
+    });
+
+    // Drop cache entries for expressions that no longer exist
+    for (auto it = curveCache.begin(); it != curveCache.end();)
+        it = liveKeys.count(it->first) ? std::next(it) : curveCache.erase(it);
+    for (auto it = pairCache.begin(); it != pairCache.end();)
+        it = livePairs.count(it->first) ? std::next(it) : pairCache.erase(it);
+
+    // Assemble results with indices into this call's curve list
+    result.clear();
+    for (size_t i = 0; i < curves.size(); ++i) {
+        for (FeaturePoint p : curveCache[curves[i].key].points) {
+            p.curveA = (int)i;
+            result.push_back(p);
+        }
+        for (size_t j = i + 1; j < curves.size(); ++j) {
+            if (curves[i].key == curves[j].key) continue;
+            bool swapped = curves[j].key < curves[i].key;
+            auto pk = swapped ? std::make_pair(curves[j].key, curves[i].key)
+                              : std::make_pair(curves[i].key, curves[j].key);
+            for (FeaturePoint p : pairCache[pk].points) {
+                p.curveA = swapped ? (int)j : (int)i;
+                p.curveB = swapped ? (int)i : (int)j;
+                result.push_back(p);
+            }
+        }
+    }
+    return result;
+}
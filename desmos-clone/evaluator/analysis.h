@@ -0,0 +1,91 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "compiler.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class PointKind {
+    ROOT,
+    MINIMUM,
+    MAXIMUM,
+    INTERSECTION
+};
+
+struct FeaturePoint {
+    PointKind kind;
+    double x, y;
+    int curveA;   // index into the curves passed to CurveAnalyzer::update
+    int curveB;   // second curve for intersections, -1 otherwise
+};
+
+// One plotted curve y = f(x), compiled with the single variable x. key
+// identifies the expression (its text) so results can be reused while the
+// expression is unchanged.
+struct AnalysisCurve {
+    std::string key;
+    const CompiledExpr* program;
+};
+
+// Finds zeros, local extrema and pairwise intersections over [xMin, xMax].
+// Sign changes are bracketed on a uniform sample grid and refined with Brent's
+// method. The grid is a lattice anchored at x = 0 with the window's sample
+// spacing, kept until the zoom changes. Per-curve and per-pair results are
+// cached by expression key: curves whose text is unchanged keep their
+// samples and the features found between them, so panning only samples and
+// searches the part of the range that came into view.
+class CurveAnalyzer {
+public:
+    const std::vector<FeaturePoint>& update(const std::vector<AnalysisCurve>& curves,
+                                            double xMin, double xMax, int samples);
+    const std::vector<FeaturePoint>& points() const { return result; }
+
+private:
+    struct Window {
+        double xMin = 0, xMax = 0;
+        int samples = 0;
+        bool operator==(const Window& o) const {
+            return xMin == o.xMin && xMax == o.xMax && samples == o.samples;
+        }
+    };
+
+    // Lattice samples k * step for k in [first, last]
+    struct Span {
+        double step = 0;
+        int64_t first = 0, last = -1;
+    };
+
+    // A feature and the lattice sample it was found from
+    struct Found {
+        int64_t sample;
+        FeaturePoint point;
+    };
+
+    struct CurveEntry {
+        Window window;
+        Span span;
+        std::vector<double> ys;            // at span's samples, NaN where undefined
+        std::vector<Found> found;          // roots and extrema over the span (curve index unset)
+        std::vector<FeaturePoint> points;  // those inside the window, deduplicated
+    };
+
+    struct PairEntry {
+        Window window;
+        Span span;
+        std::vector<Found> found;
+        std::vector<FeaturePoint> points;
+    };
+
+    double step = 0;   // lattice spacing
+    std::map<std::string, CurveEntry> curveCache;
+    std::map<std::pair<std::string, std::string>, PairEntry> pairCache;
+    std::vector<FeaturePoint> result;
+};
+
+// f(x) with infinities mapped to NaN, so only finite values count as defined
+double safeEvaluate(const CompiledExpr& f, double x);
+
+#endif
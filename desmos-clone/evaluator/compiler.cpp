@@ -0,0 +1,1150 @@
+#define _USE_MATH_DEFINES
+#include "compiler.h"
+#include "integrate.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "special.h"
+#include <cmath>
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+namespace {
+
+const double EPSILON = 1e-12;
+const double NaN = std::numeric_limits<double>::quiet_NaN();
+const size_t BLOCK = 256;   // lanes evaluated per instruction in batch mode
+const double MAX_TERMS = 1e6;   // longest sum or prod; longer ones are NaN
+
+struct FunctionInfo {
+    const char* name;
+    OpCode op;
+    int arity;   // -1 for variadic
+};
+
+const FunctionInfo FUNCTIONS[] = {
+    {"sin", OpCode::SIN, 1},     {"cos", OpCode::COS, 1},     {"tan", OpCode::TAN, 1},
+    {"cot", OpCode::COT, 1},     {"sec", OpCode::SEC, 1},     {"csc", OpCode::CSC, 1},
+    {"sqrt", OpCode::SQRT, 1},   {"abs", OpCode::ABS, 1},     {"sign", OpCode::SIGN, 1},
+    {"floor", OpCode::FLOOR, 1}, {"ceil", OpCode::CEIL, 1},   {"round", OpCode::ROUND, 1},
+    {"ln", OpCode::LN, 1},       {"log", OpCode::LN, 1},      {"log", OpCode::LOGB, 2},
+    {"log10", OpCode::LOG10, 1}, {"log2", OpCode::LOG2, 1},   {"exp", OpCode::EXP, 1},
+    {"pow", OpCode::POWF, 2},    {"mod", OpCode::MOD, 2},     {"atan2", OpCode::ATAN2, 2},
+    {"max", OpCode::MAX, -1},    {"min", OpCode::MIN, -1},
+    {"gamma", OpCode::GAMMA, 1},       {"lgamma", OpCode::LGAMMA, 1},
+    {"erf", OpCode::ERF, 1},           {"erfc", OpCode::ERFC, 1},
+    {"normpdf", OpCode::NORMPDF, 1},   {"normcdf", OpCode::NORMCDF, 1},
+    {"besselj0", OpCode::BESSELJ0, 1}, {"besselj1", OpCode::BESSELJ1, 1},
+    {"digamma", OpCode::DIGAMMA, 1},   {"trigamma", OpCode::TRIGAMMA, 1},
+    {"beta", OpCode::BETA, 2},
+};
+
+bool isUnary(OpCode op) {
+    return op == OpCode::NEG || (op >= OpCode::SIN && op <= OpCode::TRIGAMMA);
+}
+
+bool isBinary(OpCode op) {
+    return (op >= OpCode::ADD && op <= OpCode::POW) || (op >= OpCode::POWF && op <= OpCode::BETA);
+}
+
+// Scalar kernels shared by the scalar and batch paths, in double or (for
+// the float32 plotting mode) float. Domain checks mirror the exceptions
+// thrown by evaluate().
+template <typename T>
+inline T applyUnary(OpCode op, T a) {
+    const T nan = std::numeric_limits<T>::quiet_NaN();
+    const T eps = (T)EPSILON;
+    switch (op) {
+        case OpCode::NEG: return -a;
+        case OpCode::SIN: return std::sin(a);
+        case OpCode::COS: return std::cos(a);
+        case OpCode::TAN: {
+            T angleMod = std::fmod(a * (T)(180.0 / M_PI), (T)180);
+            return std::fabs(angleMod - (T)90) < eps ? nan : std::tan(a);
+        }
+        case OpCode::COT: {
+            T angleMod = std::fmod(a * (T)(180.0 / M_PI), (T)180);
+            return std::fabs(angleMod) < eps ? nan : (T)1 / std::tan(a);
+        }
+        case OpCode::SEC: {
+            T c = std::cos(a);
+            return std::fabs(c) < eps ? nan : (T)1 / c;
+        }
+        case OpCode::CSC: {
+            T s = std::sin(a);
+            return std::fabs(s) < eps ? nan : (T)1 / s;
+        }
+        case OpCode::SQRT: return a < 0 ? nan : std::sqrt(a);
+        case OpCode::ABS: return std::fabs(a);
+        case OpCode::SIGN: return (T)((a > 0) - (a < 0));
+        case OpCode::FLOOR: return std::floor(a);
+        case OpCode::CEIL: return std::ceil(a);
+        case OpCode::ROUND: return std::round(a);
+        case OpCode::LN: return a <= 0 ? nan : std::log(a);
+        case OpCode::LOG10: return a <= 0 ? nan : std::log10(a);
+        case OpCode::LOG2: return a <= 0 ? nan : std::log2(a);
+        case OpCode::EXP: return std::exp(a);
+        // Special functions are evaluated in double in either precision
+        case OpCode::GAMMA: return (T)specialGamma(a);
+        case OpCode::LGAMMA: return (T)specialLgamma(a);
+        case OpCode::ERF: return (T)specialErf(a);
+        case OpCode::ERFC: return (T)specialErfc(a);
+        case OpCode::NORMPDF: return (T)specialNormPdf(a);
+        case OpCode::NORMCDF: return (T)specialNormCdf(a);
+        case OpCode::BESSELJ0: return (T)specialBesselJ0(a);
+        case OpCode::BESSELJ1: return (T)specialBesselJ1(a);
+        case OpCode::DIGAMMA: return (T)specialDigamma(a);
+        case OpCode::TRIGAMMA: return (T)specialTrigamma(a);
+        default: return nan;
+    }
+}
+
+template <typename T>
+inline T applyBinary(OpCode op, T a, T b) {
+    const T nan = std::numeric_limits<T>::quiet_NaN();
+    const T eps = (T)EPSILON;
+    switch (op) {
+        case OpCode::ADD: return a + b;
+        case OpCode::SUB: return a - b;
+        case OpCode::MUL: return a * b;
+        case OpCode::DIV: return std::fabs(b) < eps ? nan : a / b;
+        case OpCode::POW:
+            if (a == 0 && b < 0) return nan;
+            if (a < 0 && std::floor(b) != b) return nan;
+            return std::pow(a, b);
+        case OpCode::POWF: return std::pow(a, b);
+        case OpCode::MOD: return std::fabs(b) < eps ? nan : std::fmod(a, b);
+        case OpCode::LOGB:
+            if (a <= 0 || b <= 0 || b == 1) return nan;
+            return std::log(a) / std::log(b);
+        case OpCode::ATAN2: return std::atan2(a, b);
+        case OpCode::BETA: return (T)specialBeta(a, b);
+        default: return nan;
+    }
+}
+
+template <OpCode OP, typename T>
+void unaryLoop(T* a, size_t n) {
+    for (size_t i = 0; i < n; ++i) a[i] = applyUnary<T>(OP, a[i]);
+}
+
+// x^2 is by far the most common power; a * a is exactly what pow returns
+// for it, at a fraction of the cost
+template <typename T>
+bool allEqual(const T* a, size_t n, T value) {
+    bool equal = true;
+    for (size_t i = 0; i < n; ++i) equal &= a[i] == value;
+    return equal;
+}
+
+template <typename T>
+void squareLoop(T* a, size_t n) {
+    for (size_t i = 0; i < n; ++i) a[i] = a[i] * a[i];
+}
+
+template <OpCode OP, typename T>
+void binaryLoop(T* a, const T* b, size_t n) {
+    for (size_t i = 0; i < n; ++i) a[i] = applyBinary<T>(OP, a[i], b[i]);
+}
+
+// Applies a single-argument function to n lanes in place
+template <typename T>
+void unaryBlock(OpCode op, T* a, size_t n) {
+    switch (op) {
+        case OpCode::NEG:   unaryLoop<OpCode::NEG, T>(a, n); break;
+        case OpCode::SIN:   unaryLoop<OpCode::SIN, T>(a, n); break;
+        case OpCode::COS:   unaryLoop<OpCode::COS, T>(a, n); break;
+        case OpCode::TAN:   unaryLoop<OpCode::TAN, T>(a, n); break;
+        case OpCode::COT:   unaryLoop<OpCode::COT, T>(a, n); break;
+        case OpCode::SEC:   unaryLoop<OpCode::SEC, T>(a, n); break;
+        case OpCode::CSC:   unaryLoop<OpCode::CSC, T>(a, n); break;
+        case OpCode::SQRT:  unaryLoop<OpCode::SQRT, T>(a, n); break;
+        case OpCode::ABS:   unaryLoop<OpCode::ABS, T>(a, n); break;
+        case OpCode::SIGN:  unaryLoop<OpCode::SIGN, T>(a, n); break;
+        case OpCode::FLOOR: unaryLoop<OpCode::FLOOR, T>(a, n); break;
+        case OpCode::CEIL:  unaryLoop<OpCode::CEIL, T>(a, n); break;
+        case OpCode::ROUND: unaryLoop<OpCode::ROUND, T>(a, n); break;
+        case OpCode::LN:    unaryLoop<OpCode::LN, T>(a, n); break;
+        case OpCode::LOG10: unaryLoop<OpCode::LOG10, T>(a, n); break;
+        case OpCode::LOG2:  unaryLoop<OpCode::LOG2, T>(a, n); break;
+        case OpCode::EXP:   unaryLoop<OpCode::EXP, T>(a, n); break;
+        case OpCode::GAMMA:    unaryLoop<OpCode::GAMMA, T>(a, n); break;
+        case OpCode::LGAMMA:   unaryLoop<OpCode::LGAMMA, T>(a, n); break;
+        case OpCode::ERF:      unaryLoop<OpCode::ERF, T>(a, n); break;
+        case OpCode::ERFC:     unaryLoop<OpCode::ERFC, T>(a, n); break;
+        case OpCode::NORMPDF:  unaryLoop<OpCode::NORMPDF, T>(a, n); break;
+        case OpCode::NORMCDF:  unaryLoop<OpCode::NORMCDF, T>(a, n); break;
+        case OpCode::BESSELJ0: unaryLoop<OpCode::BESSELJ0, T>(a, n); break;
+        case OpCode::BESSELJ1: unaryLoop<OpCode::BESSELJ1, T>(a, n); break;
+        case OpCode::DIGAMMA:  unaryLoop<OpCode::DIGAMMA, T>(a, n); break;
+        case OpCode::TRIGAMMA: unaryLoop<OpCode::TRIGAMMA, T>(a, n); break;
+        default: break;
+    }
+}
+
+// a[i] = a[i] op b[i] for two-argument operators and functions
+template <typename T>
+void binaryBlock(OpCode op, T* a, const T* b, size_t n) {
+    switch (op) {
+        case OpCode::ADD:   binaryLoop<OpCode::ADD, T>(a, b, n); break;
+        case OpCode::SUB:   binaryLoop<OpCode::SUB, T>(a, b, n); break;
+        case OpCode::MUL:   binaryLoop<OpCode::MUL, T>(a, b, n); break;
+        case OpCode::DIV:   binaryLoop<OpCode::DIV, T>(a, b, n); break;
+        case OpCode::POW:
+            if (allEqual(b, n, (T)2)) squareLoop(a, n);
+            else binaryLoop<OpCode::POW, T>(a, b, n);
+            break;
+        case OpCode::POWF:  binaryLoop<OpCode::POWF, T>(a, b, n); break;
+        case OpCode::MOD:   binaryLoop<OpCode::MOD, T>(a, b, n); break;
+        case OpCode::LOGB:  binaryLoop<OpCode::LOGB, T>(a, b, n); break;
+        case OpCode::ATAN2: binaryLoop<OpCode::ATAN2, T>(a, b, n); break;
+        case OpCode::BETA:  binaryLoop<OpCode::BETA, T>(a, b, n); break;
+        default: break;
+    }
+}
+
+int stackEffect(const Instruction& ins) {
+    if (ins.op == OpCode::CONST || ins.op == OpCode::VAR) return 1;
+    if (isUnary(ins.op)) return 0;
+    if (isBinary(ins.op) || ins.op == OpCode::INTEGRAL || ins.op == OpCode::SUM || ins.op == OpCode::PROD)
+        return -1;
+    return 1 - (int)ins.arg;   // MAX / MIN
+}
+
+// First slot of a loop body that holds a hoisted invariant
+size_t hoistedSlot(const CompiledExpr& body) {
+    return body.variables.size() - body.invariants.size();
+}
+
+// Marks the slots prog reads from its parent's variables: its own VARs and
+// whatever its subprograms read, except the variable each one binds itself
+// and the slots filled by its hoisted invariants
+void collectFreeSlots(const CompiledExpr& prog, std::vector<bool>& used) {
+    if (used.size() < prog.variables.size()) used.resize(prog.variables.size());
+    for (const Instruction& ins : prog.code)
+        if (ins.op == OpCode::VAR) used[ins.arg] = true;
+    for (const CompiledExpr& inv : prog.invariants) collectFreeSlots(inv, used);
+    for (const CompiledExpr& sub : prog.subprograms) {
+        std::vector<bool> inner;
+        collectFreeSlots(sub, inner);
+        for (size_t i = 0; i < std::min(inner.size(), hoistedSlot(sub)); ++i)
+            if (inner[i] && (int)i != sub.boundSlot) used[i] = true;
+    }
+}
+
+// Loop bounds rounded to the integers the index runs over; false when the
+// range is undefined, longer than MAX_TERMS or past 2^53, where doubles no
+// longer hold every integer
+bool loopRange(double lo, double hi, double& first, double& last) {
+    const double MAX_INDEX = 9007199254740992.0;   // 2^53
+    first = std::round(lo);
+    last = std::round(hi);
+    return std::fabs(first) <= MAX_INDEX && std::fabs(last) <= MAX_INDEX && last - first < MAX_TERMS;
+}
+
+// Number of indices in [first, last] from loopRange
+size_t loopCount(double first, double last) {
+    return last < first ? 0 : (size_t)(last - first) + 1;
+}
+
+// sum/prod of body over the index range for one set of variable values
+double reduceSubprogram(OpCode op, const CompiledExpr& body, const double* vars, size_t parentVars,
+                        double lo, double hi) {
+    double first, last;
+    if (!loopRange(lo, hi, first, last)) return NaN;
+
+    double small[32];
+    std::vector<double> heap;
+    double* local = small;
+    if (body.variables.size() > 32) {
+        heap.resize(body.variables.size());
+        local = heap.data();
+    }
+    size_t hoisted = hoistedSlot(body);
+    std::fill(local, local + body.variables.size(), 0.0);
+    if (vars) std::copy(vars, vars + std::min(parentVars, hoisted), local);
+    for (size_t k = 0; k < body.invariants.size(); ++k)
+        local[hoisted + k] = evaluateCompiled(body.invariants[k], local);
+
+    double acc = op == OpCode::SUM ? 0.0 : 1.0;
+    for (size_t k = 0, count = loopCount(first, last); k < count; ++k) {
+        local[body.boundSlot] = first + (double)k;
+        double term = evaluateCompiled(body, local);
+        acc = op == OpCode::SUM ? acc + term : acc * term;
+    }
+    return acc;
+}
+
+// Integral of sub over [a, b]. vars holds the lane's values for the parent's
+// variable slots; the bound slot is overwritten with the integration variable.
+double integrateSubprogram(const CompiledExpr& sub, const double* vars, size_t parentVars, double a, double b) {
+    const size_t MAX_VARS = 16;
+    if (sub.variables.size() > MAX_VARS) return NaN;
+    double base[MAX_VARS] = {0};
+    if (vars) std::copy(vars, vars + std::min(parentVars, sub.variables.size()), base);
+
+    // Serial: a scalar integral is a single lane, often one of many already
+    // spread over the cores, and starting threads per call costs more than
+    // the quadrature. Only ShadedArea's one integral splits its range.
+    return integrateAdaptive([&](double t) {
+        double local[MAX_VARS];
+        std::copy(base, base + sub.variables.size(), local);
+        local[sub.boundSlot] = t;
+        double y = evaluateCompiled(sub, local);
+        return std::isfinite(y) ? y : NaN;
+    }, a, b);
+}
+
+std::string lowerName(const ASTNode* node) {
+    std::string name = node->value;
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    return name;
+}
+
+// True if node reads any of names. integral binds x in its integrand and
+// sum/prod bind their index in their body, hiding outer variables of the
+// same name there.
+bool readsAny(const ASTNode* node, const std::vector<std::string>& names) {
+    if (names.empty()) return false;
+    if (node->type == NodeType::VARIABLE)
+        return std::find(names.begin(), names.end(), lowerName(node)) != names.end();
+
+    std::string func = node->type == NodeType::FUNCTION ? lowerName(node) : "";
+    size_t bodyArg = node->children.size();
+    std::string bound;
+    if (func == "integral" && node->children.size() == 3) {
+        bodyArg = 0;
+        bound = "x";
+    } else if ((func == "sum" || func == "prod") && node->children.size() == 4 &&
+               node->children[0]->type == NodeType::VARIABLE) {
+        bodyArg = 3;
+        bound = lowerName(node->children[0]);
+    }
+
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        if (i == bodyArg) {
+            std::vector<std::string> inner;
+            for (const auto& n : names)
+                if (n != bound) inner.push_back(n);
+            if (readsAny(node->children[i], inner)) return true;
+        } else if (!(bodyArg == 3 && i == 0) && readsAny(node->children[i], names)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool isNamedConstant(const std::string& name) {
+    return name == "pi" || name == "e" || name == "tau" || name == "phi" || name == "gamma";
+}
+
+void collectFree(const ASTNode* node, const std::vector<std::string>& bound, std::vector<std::string>& out) {
+    if (node->type == NodeType::VARIABLE) {
+        std::string name = lowerName(node);
+        if (!isNamedConstant(name) && std::find(bound.begin(), bound.end(), name) == bound.end() &&
+            std::find(out.begin(), out.end(), name) == out.end())
+            out.push_back(name);
+        return;
+    }
+
+    std::string func = node->type == NodeType::FUNCTION ? lowerName(node) : "";
+    size_t bodyArg = node->children.size();
+    std::string binds;
+    if (func == "integral" && node->children.size() == 3) {
+        bodyArg = 0;
+        binds = "x";
+    } else if ((func == "sum" || func == "prod") && node->children.size() == 4 &&
+               node->children[0]->type == NodeType::VARIABLE) {
+        bodyArg = 3;
+        binds = lowerName(node->children[0]);
+    }
+
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        if (i == bodyArg) {
+            std::vector<std::string> inner = bound;
+            inner.push_back(binds);
+            collectFree(node->children[i], inner, out);
+        } else if (!(bodyArg == 3 && i == 0)) {
+            collectFree(node->children[i], bound, out);
+        }
+    }
+}
+
+// Collects the largest subtrees of a loop body that do not read the index
+// but do read an outer variable (constant subtrees are folded anyway).
+// Bodies of nested integrals and loops are compiled separately, so only
+// their bounds are searched.
+void findInvariants(ASTNode* node, const std::string& index, const std::vector<std::string>& outer,
+                    std::vector<ASTNode*>& out) {
+    if (!readsAny(node, {index})) {
+        if (node->type != NodeType::VARIABLE && node->type != NodeType::NUMBER && readsAny(node, outer))
+            out.push_back(node);
+        return;
+    }
+    std::string func = node->type == NodeType::FUNCTION ? lowerName(node) : "";
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        if (func == "integral" && i == 0) continue;
+        if ((func == "sum" || func == "prod") && (i == 0 || i == 3)) continue;
+        findInvariants(node->children[i], index, outer, out);
+    }
+}
+
+int computeStackSize(const std::vector<Instruction>& code) {
+    int depth = 0, maxDepth = 0;
+    for (const auto& ins : code) {
+        depth += stackEffect(ins);
+        maxDepth = std::max(maxDepth, depth);
+    }
+    return maxDepth;
+}
+
+struct Compiler {
+    std::vector<std::string> variables;
+    std::vector<Instruction> code;
+    std::vector<CompiledExpr> subprograms;
+    std::vector<std::pair<const ASTNode*, uint32_t>> hoisted;   // subtree -> slot holding its value
+
+    void emitConst(double v) { code.push_back({OpCode::CONST, 0, v}); }
+
+    // Replaces everything emitted since start with its value when every
+    // operand was a constant
+    void fold(size_t start) {
+        CompiledExpr tmp;
+        tmp.code.assign(code.begin() + start, code.end());
+        tmp.stackSize = computeStackSize(tmp.code);
+        tmp.variables = variables;
+        tmp.subprograms = subprograms;
+        double v = evaluateCompiled(tmp, nullptr);
+        code.resize(start);
+        emitConst(v);
+    }
+
+    // True when the instructions since start are constant operands followed
+    // by the operator just emitted (each folded operand is one CONST)
+    bool isConstSince(size_t start, size_t length) const {
+        if (code.size() - start != length) return false;
+        for (size_t i = start; i + 1 < code.size(); ++i)
+            if (code[i].op != OpCode::CONST) return false;
+        return true;
+    }
+
+    void compile(ASTNode* node) {
+        if (!node) throw std::runtime_error("Null node in AST");
+        size_t start = code.size();
+
+        for (const auto& r : hoisted) {
+            if (r.first == node) {
+                code.push_back({OpCode::VAR, r.second, 0});
+                return;
+            }
+        }
+
+        switch (node->type) {
+            case NodeType::NUMBER:
+                emitConst(std::stod(node->value));
+                return;
+
+            case NodeType::VARIABLE: {
+                std::string var = node->value;
+                std::transform(var.begin(), var.end(), var.begin(), ::tolower);
+
+                for (size_t i = 0; i < variables.size(); ++i) {
+                    if (variables[i] == var) {
+                        code.push_back({OpCode::VAR, (uint32_t)i, 0});
+                        return;
+                    }
+                }
+                if (var == "pi") return emitConst(M_PI);
+                if (var == "e") return emitConst(M_E);
+                if (var == "tau") return emitConst(2 * M_PI);
+                if (var == "phi") return emitConst(1.61803398875);
+                if (var == "gamma") return emitConst(0.5772156649);
+
+                throw std::runtime_error("Unknown variable: " + node->value);
+            }
+
+            case NodeType::UNARY_OP: {
+                compile(node->children[0]);
+                if (node->value == "+") return;
+                if (node->value != "-") throw std::runtime_error("Unknown unary operator: " + node->value);
+                code.push_back({OpCode::NEG, 0, 0});
+                if (isConstSince(start, 2)) fold(start);
+                return;
+            }
+
+            case NodeType::BINARY_OP: {
+                OpCode op;
+                if (node->value == "+") op = OpCode::ADD;
+                else if (node->value == "-") op = OpCode::SUB;
+                else if (node->value == "*") op = OpCode::MUL;
+                else if (node->value == "/") op = OpCode::DIV;
+                else if (node->value == "^") op = OpCode::POW;
+                else throw std::runtime_error("Unknown binary operator: " + node->value);
+
+                compile(node->children[0]);
+                compile(node->children[1]);
+                code.push_back({op, 0, 0});
+                if (isConstSince(start, 3)) fold(start);
+                return;
+            }
+
+            case NodeType::FUNCTION: {
+                std::string func = node->value;
+                std::transform(func.begin(), func.end(), func.begin(), ::tolower);
+                int argc = (int)node->children.size();
+
+                if (func == "integral") return compileIntegral(node, start);
+                if (func == "sum") return compileLoop(node, start, OpCode::SUM);
+                if (func == "prod") return compileLoop(node, start, OpCode::PROD);
+
+                const FunctionInfo* info = nullptr;
+                bool known = false;
+                for (const auto& f : FUNCTIONS) {
+                    if (func != f.name) continue;
+                    known = true;
+                    if (f.arity == argc || (f.arity < 0 && argc > 0)) { info = &f; break; }
+                }
+                if (!known) throw std::runtime_error("Unknown function: " + func);
+                if (!info) throw std::runtime_error("Wrong number of arguments for " + func);
+
+                for (ASTNode* arg : node->children) compile(arg);
+                code.push_back({info->op, (uint32_t)argc, 0});
+                if (isConstSince(start, argc + 1)) fold(start);
+                return;
+            }
+
+            default:
+                throw std::runtime_error("Unsupported AST node type.");
+        }
+    }
+
+    // integral(f, a, b): f is compiled as a subprogram in which x is the
+    // integration variable; the bounds are evaluated in this program
+    void compileIntegral(ASTNode* node, size_t start) {
+        if (node->children.size() != 3)
+            throw std::runtime_error("integral requires 3 args: integral(f, a, b)");
+
+        std::vector<std::string> subVars = variables;
+        auto it = std::find(subVars.begin(), subVars.end(), "x");
+        int slot = (int)(it - subVars.begin());
+        if (it == subVars.end()) subVars.push_back("x");
+
+        CompiledExpr sub = compileExpression(node->children[0], subVars);
+        sub.boundSlot = slot;
+
+        compile(node->children[1]);
+        compile(node->children[2]);
+        subprograms.push_back(std::move(sub));
+        code.push_back({OpCode::INTEGRAL, (uint32_t)(subprograms.size() - 1), 0});
+
+        // Constant bounds and an integrand of x alone: integrate once, now
+        std::vector<bool> used;
+        collectFreeSlots(subprograms.back(), used);
+        used.resize(subVars.size());
+        used[slot] = false;
+        if (isConstSince(start, 3) && std::find(used.begin(), used.end(), true) == used.end()) {
+            fold(start);
+            subprograms.pop_back();
+        }
+    }
+
+    // sum(n, a, b, f) / prod(n, a, b, f): f is compiled once as a subprogram
+    // with n as its bound variable. Subtrees of f that read this program's
+    // variables but not n are compiled separately as invariants, computed
+    // once per evaluation instead of once per term.
+    void compileLoop(ASTNode* node, size_t start, OpCode op) {
+        const char* name = op == OpCode::SUM ? "sum" : "prod";
+        if (node->children.size() != 4 || node->children[0]->type != NodeType::VARIABLE)
+            throw std::runtime_error(std::string(name) + " requires 4 args: " + name + "(n, a, b, f)");
+
+        std::string index = lowerName(node->children[0]);
+        std::vector<std::string> outer;
+        for (const auto& v : variables)
+            if (v != index) outer.push_back(v);
+
+        std::vector<ASTNode*> invariantNodes;
+        findInvariants(node->children[3], index, outer, invariantNodes);
+
+        Compiler body;
+        body.variables = variables;
+        auto it = std::find(variables.begin(), variables.end(), index);
+        int slot = (int)(it - variables.begin());
+        if (it == variables.end()) body.variables.push_back(index);
+
+        CompiledExpr sub;
+        for (ASTNode* inv : invariantNodes) {
+            sub.invariants.push_back(compileExpression(inv, variables));
+            body.hoisted.push_back({inv, (uint32_t)body.variables.size()});
+            body.variables.push_back("#" + std::to_string(sub.invariants.size() - 1));
+        }
+        body.compile(node->children[3]);
+        sub.code = std::move(body.code);
+        sub.variables = std::move(body.variables);
+        sub.subprograms = std::move(body.subprograms);
+        sub.stackSize = computeStackSize(sub.code);
+        sub.boundSlot = slot;
+
+        compile(node->children[1]);
+        compile(node->children[2]);
+        subprograms.push_back(std::move(sub));
+        code.push_back({op, (uint32_t)(subprograms.size() - 1), 0});
+
+        // Constant bounds and a body of n alone: reduce once, now
+        std::vector<bool> used;
+        collectFreeSlots(subprograms.back(), used);
+        used.resize(hoistedSlot(subprograms.back()));
+        used[slot] = false;
+        if (isConstSince(start, 3) && std::find(used.begin(), used.end(), true) == used.end()) {
+            fold(start);
+            subprograms.pop_back();
+        }
+    }
+};
+
+// INTEGRAL over a block of lanes. When every lane shares the lower bound and
+// the integrand only reads broadcast variables, the upper bounds are walked
+// in order and each lane reuses the previous lane's integral (a prefix sum
+// over neighbouring sample points): one Gauss-Kronrod panel per lane, all
+// panels evaluated in a single batch. Otherwise each lane is integrated
+// adaptively on its own.
+void integrateLanes(const CompiledExpr& sub, const VarBinding* bindings, size_t parentVars, size_t offset,
+                    const double* lo, const double* hi, size_t n, double* out) {
+    size_t vars = sub.variables.size();
+    auto laneVars = [&](size_t i, double* dst) {
+        for (size_t s = 0; s < std::min(parentVars, vars); ++s)
+            dst[s] = bindings[s].data[(offset + i) * bindings[s].stride];
+    };
+
+    std::vector<bool> used;
+    collectFreeSlots(sub, used);
+    bool shared = n > 1 && vars <= 16;
+    for (size_t s = 0; s < used.size() && shared; ++s)
+        if (used[s] && (int)s != sub.boundSlot && (s >= parentVars || bindings[s].stride != 0)) shared = false;
+    for (size_t i = 0; i < n && shared; ++i)
+        if (lo[i] != lo[0] || !std::isfinite(hi[i])) shared = false;
+
+    if (!shared) {
+        parallelFor(n, [&](size_t i) {
+            double v[16] = {0};
+            if (vars <= 16) laneVars(i, v);
+            out[i] = integrateSubprogram(sub, v, parentVars, lo[i], hi[i]);
+        });
+        return;
+    }
+
+    double v[16] = {0};
+    laneVars(0, v);
+    out[0] = integrateSubprogram(sub, v, parentVars, lo[0], hi[0]);
+
+    // All panels [hi[i-1], hi[i]] in one batch
+    size_t panels = n - 1;
+    std::vector<double> nodes(panels * GK_POINTS), values(panels * GK_POINTS);
+    for (size_t i = 0; i < panels; ++i)
+        gaussKronrodAbscissae(hi[i], hi[i + 1], &nodes[i * GK_POINTS]);
+
+    std::vector<VarBinding> subBindings(vars);
+    for (size_t s = 0; s < vars; ++s) subBindings[s] = {&v[s], 0};
+    subBindings[sub.boundSlot] = {nodes.data(), 1};
+    evaluateBatch(sub, subBindings.data(), nodes.size(), values.data());
+
+    for (size_t i = 0; i < panels; ++i) {
+        double value, error;
+        gaussKronrodCombine(hi[i], hi[i + 1], &values[i * GK_POINTS], value, error);
+        if (!(error <= 1e-10 * std::max(1.0, std::fabs(hi[i + 1] - hi[i]))))
+            value = integrateSubprogram(sub, v, parentVars, hi[i], hi[i + 1]);
+        out[i + 1] = out[i] + value;
+    }
+}
+
+// SUM/PROD over a block of lanes. The body is evaluated across all lanes
+// once per index value; invariants are evaluated once for the block. Lanes
+// whose range differs from the others only take the terms inside it, and
+// only indices inside some lane's range are visited. MAX_TERMS applies to
+// each lane: when the ranges together cover more, each lane is reduced on
+// its own.
+void reduceLanes(OpCode op, const CompiledExpr& body, const VarBinding* bindings, size_t parentVars,
+                 size_t offset, const double* lo, const double* hi, size_t n, double* out) {
+    size_t hoisted = hoistedSlot(body);
+
+    // The body's lane i is lane offset + i of the parent
+    std::vector<VarBinding> bodyBindings(body.variables.size(), VarBinding{nullptr, 0});
+    for (size_t s = 0; s < std::min(parentVars, hoisted); ++s)
+        bodyBindings[s] = {bindings[s].data + offset * bindings[s].stride, bindings[s].stride};
+
+    std::vector<double> invariantValues(body.invariants.size() * n);
+    for (size_t k = 0; k < body.invariants.size(); ++k) {
+        evaluateBatch(body.invariants[k], bodyBindings.data(), n, &invariantValues[k * n]);
+        bodyBindings[hoisted + k] = {&invariantValues[k * n], 1};
+    }
+
+    double firsts[BLOCK], lasts[BLOCK];
+    bool uniform = true;
+    std::vector<std::pair<double, double>> ranges;
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = op == OpCode::SUM ? 0.0 : 1.0;
+        if (!loopRange(lo[i], hi[i], firsts[i], lasts[i])) {
+            out[i] = NaN;
+            firsts[i] = 1;
+            lasts[i] = 0;
+        }
+        if (firsts[i] <= lasts[i]) ranges.push_back({firsts[i], lasts[i]});
+        uniform = uniform && firsts[i] == firsts[0] && lasts[i] == lasts[0];
+    }
+
+    // The union of the lanes' ranges, as disjoint runs of indices
+    std::sort(ranges.begin(), ranges.end());
+    std::vector<std::pair<double, double>> runs;
+    double covered = 0;
+    for (const auto& r : ranges) {
+        if (!runs.empty() && r.first <= runs.back().second + 1) {
+            covered += std::max(0.0, r.second - runs.back().second);
+            runs.back().second = std::max(runs.back().second, r.second);
+        } else {
+            covered += r.second - r.first + 1;
+            runs.push_back(r);
+        }
+    }
+    if (covered > MAX_TERMS) {
+        std::vector<double> vars(parentVars);
+        for (size_t i = 0; i < n; ++i) {
+            if (std::isnan(out[i])) continue;
+            for (size_t s = 0; s < parentVars; ++s)
+                vars[s] = bindings[s].data[(offset + i) * bindings[s].stride];
+            out[i] = reduceSubprogram(op, body, vars.data(), parentVars, lo[i], hi[i]);
+        }
+        return;
+    }
+
+    double index;
+    bodyBindings[body.boundSlot] = {&index, 0};
+    double term[BLOCK];
+    for (const auto& run : runs) {
+        for (size_t k = 0, count = loopCount(run.first, run.second); k < count; ++k) {
+            index = run.first + (double)k;
+            evaluateBatch(body, bodyBindings.data(), n, term);
+            if (uniform && op == OpCode::SUM) {
+                for (size_t i = 0; i < n; ++i) out[i] += term[i];
+            } else if (uniform) {
+                for (size_t i = 0; i < n; ++i) out[i] *= term[i];
+            } else {
+                for (size_t i = 0; i < n; ++i) {
+                    if (index < firsts[i] || index > lasts[i]) continue;
+                    out[i] = op == OpCode::SUM ? out[i] + term[i] : out[i] * term[i];
+                }
+            }
+        }
+    }
+}
+
+// Runs prog over n <= BLOCK lanes starting at lane offset, in T precision.
+// stack holds prog.stackSize rows of BLOCK values.
+template <typename T>
+void runBlock(const CompiledExpr& prog, const VarBinding* bindings, size_t offset, size_t n,
+              T* stack, double* out) {
+    T* sp = stack - BLOCK;
+
+    for (const Instruction& ins : prog.code) {
+        switch (ins.op) {
+            case OpCode::CONST:
+                sp += BLOCK;
+                std::fill(sp, sp + n, (T)ins.value);
+                break;
+
+            case OpCode::VAR: {
+                sp += BLOCK;
+                const VarBinding& b = bindings[ins.arg];
+                if (b.stride == 0) std::fill(sp, sp + n, (T)b.data[0]);
+                else if (b.stride == 1) std::copy(b.data + offset, b.data + offset + n, sp);
+                else for (size_t i = 0; i < n; ++i) sp[i] = (T)b.data[(offset + i) * b.stride];
+                break;
+            }
+
+            case OpCode::MAX:
+            case OpCode::MIN: {
+                sp -= (ins.arg - 1) * BLOCK;
+                for (uint32_t k = 1; k < ins.arg; ++k) {
+                    const T* b = sp + k * BLOCK;
+                    if (ins.op == OpCode::MAX)
+                        for (size_t i = 0; i < n; ++i) sp[i] = (sp[i] < b[i]) ? b[i] : sp[i];
+                    else
+                        for (size_t i = 0; i < n; ++i) sp[i] = (b[i] < sp[i]) ? b[i] : sp[i];
+                }
+                break;
+            }
+
+            case OpCode::INTEGRAL: {
+                // Quadrature always runs in double
+                sp -= BLOCK;
+                double lo[BLOCK], hi[BLOCK], result[BLOCK];
+                std::copy(sp, sp + n, lo);
+                std::copy(sp + BLOCK, sp + BLOCK + n, hi);
+                integrateLanes(prog.subprograms[ins.arg], bindings, prog.variables.size(), offset,
+                               lo, hi, n, result);
+                std::copy(result, result + n, sp);
+                break;
+            }
+
+            case OpCode::SUM:
+            case OpCode::PROD: {
+                sp -= BLOCK;
+                double lo[BLOCK], hi[BLOCK], result[BLOCK];
+                std::copy(sp, sp + n, lo);
+                std::copy(sp + BLOCK, sp + BLOCK + n, hi);
+                reduceLanes(ins.op, prog.subprograms[ins.arg], bindings, prog.variables.size(), offset,
+                            lo, hi, n, result);
+                std::copy(result, result + n, sp);
+                break;
+            }
+
+            default:
+                if (isUnary(ins.op)) {
+                    unaryBlock(ins.op, sp, n);
+                } else {
+                    sp -= BLOCK;
+                    binaryBlock(ins.op, sp, sp + BLOCK, n);
+                }
+                break;
+        }
+    }
+
+    std::copy(sp, sp + n, out);
+}
+
+// float32 overflows past 3.4e38 where double does not, and the window's
+// scale says nothing about intermediate values: exp(x) / exp(x - 1) is
+// inf / inf at x = 90. Evaluates again in double, gathered into one block,
+// the lanes of a float block that came out non-finite. Each lane gets the
+// value evaluateBatch computes for it in double, whatever its neighbours.
+void widenNonFinite(const CompiledExpr& prog, const VarBinding* bindings, size_t offset, size_t n,
+                    std::vector<double>& stack, double* out) {
+    size_t lanes[BLOCK], m = 0;
+    for (size_t i = 0; i < n; ++i)
+        if (!std::isfinite(out[i])) lanes[m++] = i;
+    if (m == 0) return;
+
+    size_t slots = prog.variables.size();
+    std::vector<double> gathered(slots * BLOCK);
+    std::vector<VarBinding> narrow(bindings, bindings + slots);
+    for (size_t s = 0; s < slots; ++s) {
+        if (bindings[s].stride == 0) continue;
+        double* column = gathered.data() + s * BLOCK;
+        for (size_t j = 0; j < m; ++j) column[j] = bindings[s].data[(offset + lanes[j]) * bindings[s].stride];
+        narrow[s] = {column, 1};
+    }
+    if (stack.size() < prog.stackSize * BLOCK) stack.resize(prog.stackSize * BLOCK);
+    double result[BLOCK];
+    runBlock<double>(prog, narrow.data(), 0, m, stack.data(), result);
+    for (size_t j = 0; j < m; ++j) out[lanes[j]] = result[j];
+}
+
+template <typename T>
+void runBatch(const CompiledExpr& prog, const VarBinding* bindings, size_t count, double* out) {
+    // One stack per nesting level: integrands are batch-evaluated from
+    // inside their parent's block
+    thread_local std::deque<std::vector<T>> stacks;   // growing keeps references valid
+    thread_local std::deque<std::vector<double>> wideStacks;   // for widenNonFinite
+    thread_local size_t depth = 0;
+    if (stacks.size() <= depth) stacks.resize(depth + 1);
+    std::vector<T>& stack = stacks[depth];
+    if (stack.size() < prog.stackSize * BLOCK) stack.resize(prog.stackSize * BLOCK);
+    if (std::is_same<T, float>::value && wideStacks.size() <= depth) wideStacks.resize(depth + 1);
+
+    ++depth;
+    for (size_t offset = 0; offset < count; offset += BLOCK) {
+        size_t n = std::min(BLOCK, count - offset);
+        runBlock<T>(prog, bindings, offset, n, stack.data(), out + offset);
+        if (std::is_same<T, float>::value)
+            widenNonFinite(prog, bindings, offset, n, wideStacks[depth - 1], out + offset);
+    }
+    --depth;
+}
+
+// --- Forward-mode derivatives ---
+// Derivative of r = applyUnary(op, a) with respect to a
+inline double unaryDerivative(OpCode op, double a, double r) {
+    switch (op) {
+        case OpCode::NEG: return -1;
+        case OpCode::SIN: return std::cos(a);
+        case OpCode::COS: return -std::sin(a);
+        case OpCode::TAN: return 1 + r * r;
+        case OpCode::COT: return -(1 + r * r);
+        case OpCode::SEC: return r * std::tan(a);
+        case OpCode::CSC: return -r / std::tan(a);
+        case OpCode::SQRT: return 0.5 / r;
+        case OpCode::ABS: return (double)((a > 0) - (a < 0));
+        case OpCode::SIGN:
+        case OpCode::FLOOR:
+        case OpCode::CEIL:
+        case OpCode::ROUND: return 0;
+        case OpCode::LN: return 1 / a;
+        case OpCode::LOG10: return 1 / (a * M_LN10);
+        case OpCode::LOG2: return 1 / (a * M_LN2);
+        case OpCode::EXP: return r;
+        case OpCode::ERF: return M_2_SQRTPI * std::exp(-a * a);
+        case OpCode::ERFC: return -M_2_SQRTPI * std::exp(-a * a);
+        case OpCode::NORMPDF: return -a * r;
+        case OpCode::NORMCDF: return specialNormPdf(a);
+        case OpCode::BESSELJ0: return -specialBesselJ1(a);
+        case OpCode::BESSELJ1: return a == 0 ? 0.5 : specialBesselJ0(a) - r / a;
+        case OpCode::DIGAMMA: return specialTrigamma(a);
+        default: return NaN;
+    }
+}
+
+// Partial derivatives of r = applyBinary(op, a, b)
+inline void binaryPartials(OpCode op, double a, double b, double r, double& da, double& db) {
+    switch (op) {
+        case OpCode::ADD: da = 1; db = 1; return;
+        case OpCode::SUB: da = 1; db = -1; return;
+        case OpCode::MUL: da = b; db = a; return;
+        case OpCode::DIV: da = 1 / b; db = -r / b; return;
+        case OpCode::POW:
+        case OpCode::POWF:
+            da = b == 0 ? 0 : b * std::pow(a, b - 1);
+            db = r * std::log(a);   // NaN for a < 0, where only constant exponents are defined
+            return;
+        case OpCode::MOD: da = 1; db = -std::trunc(a / b); return;
+        case OpCode::LOGB: da = 1 / (a * std::log(b)); db = -r / (b * std::log(b)); return;
+        case OpCode::ATAN2: {
+            double s = a * a + b * b;
+            da = b / s;
+            db = -a / s;
+            return;
+        }
+        default: da = db = NaN; return;
+    }
+}
+
+// A zero tangent contributes nothing, even where the partial derivative is
+// infinite or undefined (x^c at x = 0, c^x for c < 0)
+inline double chain(double partial, double tangent) {
+    return tangent == 0 ? 0 : partial * tangent;
+}
+
+// Runs prog over n <= BLOCK lanes carrying, for every stack entry, one
+// tangent row per derivative: entry e's tangent k is at tans + (e * m + k) * BLOCK
+void runGradientBlock(const CompiledExpr& prog, const VarBinding* bindings, size_t offset, size_t n,
+                      const uint32_t* wrt, size_t m, double* vals, double* tans, double* out,
+                      double* const* grads) {
+    int top = -1;
+    auto val = [&](int e) { return vals + e * BLOCK; };
+    auto tan = [&](int e, size_t k) { return tans + (e * m + k) * BLOCK; };
+
+    for (const Instruction& ins : prog.code) {
+        switch (ins.op) {
+            case OpCode::CONST:
+                ++top;
+                std::fill(val(top), val(top) + n, ins.value);
+                for (size_t k = 0; k < m; ++k) std::fill(tan(top, k), tan(top, k) + n, 0.0);
+                break;
+
+            case OpCode::VAR: {
+                ++top;
+                const VarBinding& b = bindings[ins.arg];
+                double* v = val(top);
+                for (size_t i = 0; i < n; ++i) v[i] = b.data[(offset + i) * b.stride];
+                for (size_t k = 0; k < m; ++k) std::fill(tan(top, k), tan(top, k) + n, wrt[k] == ins.arg ? 1.0 : 0.0);
+                break;
+            }
+
+            case OpCode::MAX:
+            case OpCode::MIN: {
+                top -= ins.arg - 1;
+                double* v = val(top);
+                for (uint32_t j = 1; j < ins.arg; ++j) {
+                    const double* b = val(top + j);
+                    for (size_t i = 0; i < n; ++i) {
+                        if (ins.op == OpCode::MAX ? !(v[i] < b[i]) : !(b[i] < v[i])) continue;
+                        v[i] = b[i];
+                        for (size_t k = 0; k < m; ++k) tan(top, k)[i] = tan(top + j, k)[i];
+                    }
+                }
+                break;
+            }
+
+            default: {
+                // Values through the same block kernels as evaluateBatch,
+                // then the partial derivatives, then the tangents
+                double a[BLOCK], da[BLOCK], db[BLOCK];
+                if (isUnary(ins.op)) {
+                    double* v = val(top);
+                    std::copy(v, v + n, a);
+                    unaryBlock(ins.op, v, n);
+                    for (size_t i = 0; i < n; ++i) da[i] = unaryDerivative(ins.op, a[i], v[i]);
+                    for (size_t k = 0; k < m; ++k) {
+                        double* t = tan(top, k);
+                        for (size_t i = 0; i < n; ++i) t[i] = chain(da[i], t[i]);
+                    }
+                } else {
+                    --top;
+                    double* v = val(top);
+                    const double* b = val(top + 1);
+                    std::copy(v, v + n, a);
+                    binaryBlock(ins.op, v, b, n);
+                    for (size_t i = 0; i < n; ++i) binaryPartials(ins.op, a[i], b[i], v[i], da[i], db[i]);
+                    for (size_t k = 0; k < m; ++k) {
+                        double* t = tan(top, k);
+                        const double* tb = tan(top + 1, k);
+                        for (size_t i = 0; i < n; ++i) t[i] = chain(da[i], t[i]) + chain(db[i], tb[i]);
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    std::copy(val(0), val(0) + n, out + offset);
+    for (size_t k = 0; k < m; ++k) std::copy(tan(0, k), tan(0, k) + n, grads[k] + offset);
+}
+
+} // namespace
+
+std::vector<std::string> freeVariables(ASTNode* node, const std::vector<std::string>& known) {
+    std::vector<std::string> bound, out;
+    for (std::string v : known) {
+        std::transform(v.begin(), v.end(), v.begin(), ::tolower);
+        bound.push_back(v);
+    }
+    if (node) collectFree(node, bound, out);
+    return out;
+}
+
+CompiledExpr compileExpression(ASTNode* node, const std::vector<std::string>& variables) {
+    Compiler c;
+    for (std::string v : variables) {
+        std::transform(v.begin(), v.end(), v.begin(), ::tolower);
+        c.variables.push_back(v);
+    }
+    c.compile(node);
+
+    CompiledExpr prog;
+    prog.code = std::move(c.code);
+    prog.variables = std::move(c.variables);
+    prog.subprograms = std::move(c.subprograms);
+    prog.stackSize = computeStackSize(prog.code);
+    return prog;
+}
+
+bool validateProgram(const CompiledExpr& prog) {
+    int depth = 0, maxDepth = 0;
+    for (const Instruction& ins : prog.code) {
+        if (ins.op > LAST_OPCODE) return false;
+        if (ins.op == OpCode::VAR && ins.arg >= prog.variables.size()) return false;
+        if ((ins.op == OpCode::MAX || ins.op == OpCode::MIN) && (ins.arg == 0 || (int)ins.arg > depth))
+            return false;
+        if (isUnary(ins.op) && depth < 1) return false;
+        if (isBinary(ins.op) && depth < 2) return false;
+        if (ins.op == OpCode::INTEGRAL || ins.op == OpCode::SUM || ins.op == OpCode::PROD) {
+            if (depth < 2 || ins.arg >= prog.subprograms.size()) return false;
+            const CompiledExpr& sub = prog.subprograms[ins.arg];
+            if (sub.invariants.size() > sub.variables.size()) return false;
+            size_t hoisted = hoistedSlot(sub);
+            if (hoisted < prog.variables.size() || sub.boundSlot < 0 || sub.boundSlot >= (int)hoisted ||
+                !validateProgram(sub))
+                return false;
+            if (ins.op == OpCode::INTEGRAL && !sub.invariants.empty()) return false;
+            for (const CompiledExpr& inv : sub.invariants)
+                if (inv.variables.size() > prog.variables.size() || !validateProgram(inv)) return false;
+        }
+        depth += stackEffect(ins);
+        maxDepth = std::max(maxDepth, depth);
+    }
+    return depth == 1 && maxDepth == prog.stackSize;
+}
+
+double evaluateCompiled(const CompiledExpr& prog, const double* vars) {
+    countMetric(Metric::EVALUATIONS);
+    double local[32];
+    std::vector<double> heap;
+    double* st = local;
+    if (prog.stackSize > 32) {
+        heap.resize(prog.stackSize);
+        st = heap.data();
+    }
+
+    int top = -1;
+    for (const Instruction& ins : prog.code) {
+        switch (ins.op) {
+            case OpCode::CONST: st[++top] = ins.value; break;
+            case OpCode::VAR: st[++top] = vars[ins.arg]; break;
+            case OpCode::INTEGRAL:
+                --top;
+                st[top] = integrateSubprogram(prog.subprograms[ins.arg], vars, prog.variables.size(),
+                                              st[top], st[top + 1]);
+                break;
+            case OpCode::SUM:
+            case OpCode::PROD:
+                --top;
+                st[top] = reduceSubprogram(ins.op, prog.subprograms[ins.arg], vars, prog.variables.size(),
+                                           st[top], st[top + 1]);
+                break;
+            case OpCode::MAX:
+            case OpCode::MIN: {
+                top -= ins.arg - 1;
+                for (uint32_t k = 1; k < ins.arg; ++k) {
+                    double b = st[top + k];
+                    if (ins.op == OpCode::MAX ? st[top] < b : b < st[top]) st[top] = b;
+                }
+                break;
+            }
+            default:
+                if (isUnary(ins.op)) {
+                    st[top] = applyUnary(ins.op, st[top]);
+                } else {
+                    --top;
+                    st[top] = applyBinary(ins.op, st[top], st[top + 1]);
+                }
+                break;
+        }
+    }
+    return top == 0 ? st[0] : NaN;
+}
+
+void evaluateBatch(const CompiledExpr& prog, const VarBinding* bindings, size_t count, double* out,
+                   Precision precision) {
+    countMetric(Metric::EVALUATIONS, count);
+    if (prog.empty()) {
+        std::fill(out, out + count, NaN);
+        return;
+    }
+    if (precision == Precision::FLOAT) runBatch<float>(prog, bindings, count, out);
+    else runBatch<double>(prog, bindings, count, out);
+}
+
+void evaluateBatch(const CompiledExpr& prog, const double* xs, size_t count, double* out,
+                   Precision precision) {
+    VarBinding x{xs, 1};
+    evaluateBatch(prog, &x, count, out, precision);
+}
+
+bool hasDerivativeForm(const CompiledExpr& prog) {
+    if (prog.empty()) return false;
+    for (const Instruction& ins : prog.code) {
+        switch (ins.op) {
+            case OpCode::GAMMA:
+            case OpCode::LGAMMA:
+            case OpCode::TRIGAMMA:
+            case OpCode::BETA:
+            case OpCode::INTEGRAL:
+            case OpCode::SUM:
+            case OpCode::PROD: return false;
+            default: break;
+        }
+    }
+    return true;
+}
+
+void evaluateBatchGradient(const CompiledExpr& prog, const VarBinding* bindings, size_t count,
+                           const uint32_t* wrt, size_t wrtCount, double* out, double* const* grads) {
+    countMetric(Metric::EVALUATIONS, count);
+    thread_local std::vector<double> vals, tans;
+    if (vals.size() < prog.stackSize * BLOCK) vals.resize(prog.stackSize * BLOCK);
+    if (tans.size() < prog.stackSize * wrtCount * BLOCK) tans.resize(prog.stackSize * wrtCount * BLOCK);
+
+    for (size_t offset = 0; offset < count; offset += BLOCK) {
+        size_t n = std::min(BLOCK, count - offset);
+        runGradientBlock(prog, bindings, offset, n, wrt, wrtCount, vals.data(), tans.data(), out, grads);
+    }
+}
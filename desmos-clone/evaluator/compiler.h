@@ -0,0 +1,152 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "../parser/parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class OpCode : uint8_t {
+    CONST,
+    VAR,
+    NEG,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    POW,
+    // Single-argument functions
+    SIN,
+    COS,
+    TAN,
+    COT,
+    SEC,
+    CSC,
+    SQRT,
+    ABS,
+    SIGN,
+    FLOOR,
+    CEIL,
+    ROUND,
+    LN,
+    LOG10,
+    LOG2,
+    EXP,
+    GAMMA,
+    LGAMMA,
+    ERF,
+    ERFC,
+    NORMPDF,
+    NORMCDF,
+    BESSELJ0,
+    BESSELJ1,
+    DIGAMMA,
+    TRIGAMMA,
+    // Two-argument functions
+    POWF,
+    MOD,
+    LOGB,
+    ATAN2,
+    BETA,
+    // Variadic functions (arg = argument count)
+    MAX,
+    MIN,
+    // integral(f, a, b): pops a and b, arg = subprogram holding f
+    INTEGRAL,
+    // sum(n, a, b, f) and prod(n, a, b, f): pop a and b, arg = subprogram
+    // holding f with n as its bound variable
+    SUM,
+    PROD
+};
+
+// Compiled programs are stored in session files. Bump BYTECODE_VERSION and
+// keep LAST_OPCODE current whenever opcodes or Instruction change.
+const OpCode LAST_OPCODE = OpCode::PROD;
+const uint32_t BYTECODE_VERSION = 5;
+
+struct Instruction {
+    OpCode op;
+    uint32_t arg;   // variable slot for VAR, argument count for MAX/MIN,
+                    // subprogram index for INTEGRAL, SUM and PROD
+    double value;   // constant for CONST
+};
+
+// Postfix program compiled from an AST. Variables are resolved to slots and
+// constant subtrees are folded, so evaluation does no string work at all.
+struct CompiledExpr {
+    std::vector<Instruction> code;
+    std::vector<std::string> variables;  // slot order used by VAR
+    int stackSize = 0;
+
+    // Integrands of INTEGRAL and bodies of SUM/PROD instructions. A
+    // subprogram sees the variables of its parent (same slots) plus the one
+    // it binds (x, or the loop index): boundSlot is the slot set to it.
+    std::vector<CompiledExpr> subprograms;
+    int boundSlot = -1;
+
+    // Loop bodies only: the parts of the body that do not depend on the
+    // loop index, hoisted out and evaluated once before the loop. They read
+    // the parent's slots; invariants[k] fills slot
+    // variables.size() - invariants.size() + k.
+    std::vector<CompiledExpr> invariants;
+
+    bool empty() const { return code.empty(); }
+};
+
+// Source of one variable for batch evaluation: value i is data[i * stride].
+// A stride of 0 broadcasts a single value to every lane.
+struct VarBinding {
+    const double* data;
+    size_t stride;
+};
+
+// Compiles node with the given variable names (case-insensitive). Named
+// constants (pi, e, tau, phi, gamma) are folded unless listed as variables.
+// Throws std::runtime_error for unknown variables, functions or arities.
+CompiledExpr compileExpression(ASTNode* node, const std::vector<std::string>& variables);
+
+// Checks that a program loaded from outside is safe to run: known opcodes,
+// variable slots in range and a stack that never underflows and ends with
+// exactly one value.
+bool validateProgram(const CompiledExpr& prog);
+
+// Same semantics as evaluate(), except domain errors produce NaN instead of
+// throwing. vars holds one value per slot.
+double evaluateCompiled(const CompiledExpr& prog, const double* vars);
+
+// Arithmetic used by evaluateBatch. FLOAT runs the stack in float32, twice
+// as many lanes per vector register; inputs and outputs stay double. Only
+// for plotting, where the error stays below a pixel (see plotPrecision).
+// Lanes whose float result is not finite are evaluated again in double, so
+// overflow in intermediate values does not blank a curve.
+enum class Precision { DOUBLE, FLOAT };
+
+// Evaluates count lanes at once, one instruction at a time over blocks of
+// lanes, so each operation runs as a tight loop the compiler can vectorize.
+// bindings holds one entry per variable slot.
+void evaluateBatch(const CompiledExpr& prog, const VarBinding* bindings, size_t count, double* out,
+                   Precision precision = Precision::DOUBLE);
+
+// Convenience for single-variable programs: binds slot 0 to xs.
+void evaluateBatch(const CompiledExpr& prog, const double* xs, size_t count, double* out,
+                   Precision precision = Precision::DOUBLE);
+
+// True if every instruction of prog has a derivative rule for
+// evaluateBatchGradient: all but gamma, lgamma, trigamma, beta, integral,
+// sum and prod
+bool hasDerivativeForm(const CompiledExpr& prog);
+
+// evaluateBatch in double plus forward-mode derivatives: grads[k][i] is the
+// derivative of lane i with respect to variable slot wrt[k]. Derivatives of
+// floor, ceil, round and sign are 0 and those of abs, max, min and mod are
+// one-sided at their kinks. Requires hasDerivativeForm(prog).
+void evaluateBatchGradient(const CompiledExpr& prog, const VarBinding* bindings, size_t count,
+                           const uint32_t* wrt, size_t wrtCount, double* out, double* const* grads);
+
+// Names prog's AST reads besides the given ones and the named constants, in
+// order of first use. Variables bound by integral (x) and sum/prod (their
+// index) are not free inside the part that binds them.
+std::vector<std::string> freeVariables(ASTNode* node, const std::vector<std::string>& known);
+
+#endif
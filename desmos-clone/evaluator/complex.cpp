@@ -0,0 +1,517 @@
+#define _USE_MATH_DEFINES
+#include "complex.h"
+#include "metrics.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+using Complex = std::complex<double>;
+
+const size_t BLOCK = 256;        // lanes per instruction in batch mode
+const int MAX_POWI = 64;         // largest literal exponent multiplied out
+
+struct FunctionInfo {
+    const char* name;
+    ComplexOp op;
+};
+
+const FunctionInfo FUNCTIONS[] = {
+    {"sin", ComplexOp::SIN},   {"cos", ComplexOp::COS}, {"tan", ComplexOp::TAN}, {"exp", ComplexOp::EXP},
+    {"ln", ComplexOp::LOG},    {"log", ComplexOp::LOG}, {"sqrt", ComplexOp::SQRT}, {"abs", ComplexOp::ABS},
+    {"re", ComplexOp::RE},     {"im", ComplexOp::IM},   {"arg", ComplexOp::ARG}, {"conj", ComplexOp::CONJ},
+};
+
+bool isBinary(ComplexOp op) {
+    return op >= ComplexOp::ADD && op <= ComplexOp::POW;
+}
+
+int stackEffect(const ComplexInstruction& ins) {
+    if (ins.op == ComplexOp::CONST || ins.op == ComplexOp::Z) return 1;
+    return isBinary(ins.op) ? -1 : 0;
+}
+
+Complex powi(Complex a, int n) {
+    Complex result = 1;
+    for (int k = std::abs(n); k > 0; k >>= 1, a *= a)
+        if (k & 1) result *= a;
+    return n < 0 ? 1.0 / result : result;
+}
+
+// Integer value of a literal exponent (a number, possibly negated) small
+// enough to multiply out
+bool literalExponent(const ASTNode* node, int& n) {
+    bool negate = false;
+    if (node->type == NodeType::UNARY_OP && node->value == "-" && node->children.size() == 1) {
+        negate = true;
+        node = node->children[0];
+    }
+    if (node->type != NodeType::NUMBER) return false;
+    double v = std::stod(node->value);
+    if (v != std::floor(v) || v > MAX_POWI) return false;
+    n = negate ? -(int)v : (int)v;
+    return true;
+}
+
+struct Compiler {
+    std::vector<ComplexInstruction> code;
+
+    void emit(ComplexOp op, int32_t arg = 0) { code.push_back({op, arg, 0, 0}); }
+    void emitConst(Complex v) { code.push_back({ComplexOp::CONST, 0, v.real(), v.imag()}); }
+
+    // Folds the instructions since start when they are constant operands
+    // followed by the operator just emitted
+    void foldIfConstant(size_t start) {
+        for (size_t i = start; i + 1 < code.size(); ++i)
+            if (code[i].op != ComplexOp::CONST) return;
+        ComplexProgram tmp;
+        tmp.code.assign(code.begin() + start, code.end());
+        tmp.stackSize = 2;
+        Complex v = evaluateComplex(tmp, 0);
+        code.resize(start);
+        emitConst(v);
+    }
+
+    void compile(ASTNode* node) {
+        if (!node) throw std::runtime_error("Null node in AST");
+        size_t start = code.size();
+
+        switch (node->type) {
+            case NodeType::NUMBER:
+                emitConst(std::stod(node->value));
+                return;
+
+            case NodeType::VARIABLE: {
+                std::string var = node->value;
+                std::transform(var.begin(), var.end(), var.begin(), ::tolower);
+                if (var == "z") return emit(ComplexOp::Z);
+                if (var == "i") return emitConst(Complex(0, 1));
+                if (var == "pi") return emitConst(M_PI);
+                if (var == "e") return emitConst(M_E);
+                if (var == "tau") return emitConst(2 * M_PI);
+                if (var == "phi") return emitConst(1.61803398875);
+                throw std::runtime_error("Unknown variable: " + node->value);
+            }
+
+            case NodeType::UNARY_OP:
+                compile(node->children[0]);
+                if (node->value == "+") return;
+                if (node->value != "-") throw std::runtime_error("Unknown unary operator: " + node->value);
+                emit(ComplexOp::NEG);
+                foldIfConstant(start);
+                return;
+
+            case NodeType::BINARY_OP: {
+                int n;
+                if (node->value == "^" && literalExponent(node->children[1], n)) {
+                    compile(node->children[0]);
+                    emit(ComplexOp::POWI, n);
+                    foldIfConstant(start);
+                    return;
+                }
+
+                ComplexOp op;
+                if (node->value == "+") op = ComplexOp::ADD;
+                else if (node->value == "-") op = ComplexOp::SUB;
+                else if (node->value == "*") op = ComplexOp::MUL;
+                else if (node->value == "/") op = ComplexOp::DIV;
+                else if (node->value == "^") op = ComplexOp::POW;
+                else throw std::runtime_error("Unknown binary operator: " + node->value);
+                compile(node->children[0]);
+                compile(node->children[1]);
+                emit(op);
+                foldIfConstant(start);
+                return;
+            }
+
+            case NodeType::FUNCTION: {
+                std::string func = node->value;
+                std::transform(func.begin(), func.end(), func.begin(), ::tolower);
+                size_t argc = node->children.size();
+                if (func == "pow") {
+                    if (argc != 2) throw std::runtime_error("Wrong number of arguments for pow");
+                    compile(node->children[0]);
+                    compile(node->children[1]);
+                    emit(ComplexOp::POW);
+                    foldIfConstant(start);
+                    return;
+                }
+                for (const auto& f : FUNCTIONS) {
+                    if (func != f.name) continue;
+                    if (argc != 1) throw std::runtime_error("Wrong number of arguments for " + func);
+                    compile(node->children[0]);
+                    emit(f.op);
+                    foldIfConstant(start);
+                    return;
+                }
+                throw std::runtime_error("Unknown complex function: " + func);
+            }
+
+            default:
+                throw std::runtime_error("Unsupported AST node type.");
+        }
+    }
+};
+
+// --- Batch kernels: one loop per operation over split re/im rows ---
+void mulLoop(double* ar, double* ai, const double* br, const double* bi, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        double r = ar[i] * br[i] - ai[i] * bi[i];
+        ai[i] = ar[i] * bi[i] + ai[i] * br[i];
+        ar[i] = r;
+    }
+}
+
+void divLoop(double* ar, double* ai, const double* br, const double* bi, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        double d = br[i] * br[i] + bi[i] * bi[i];
+        double r = (ar[i] * br[i] + ai[i] * bi[i]) / d;
+        ai[i] = (ai[i] * br[i] - ar[i] * bi[i]) / d;
+        ar[i] = r;
+    }
+}
+
+void expLoop(double* re, double* im, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        double m = std::exp(re[i]);
+        re[i] = m * std::cos(im[i]);
+        im[i] = m * std::sin(im[i]);
+    }
+}
+
+void logLoop(double* re, double* im, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        double m = std::log(std::hypot(re[i], im[i]));
+        im[i] = std::atan2(im[i], re[i]);
+        re[i] = m;
+    }
+}
+
+// Principal square root, computed from whichever of the two half-sums does
+// not cancel
+void sqrtLoop(double* re, double* im, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        double a = re[i], b = im[i];
+        if (a == 0 && b == 0) {
+            re[i] = 0;
+            continue;
+        }
+        double t = std::sqrt((std::hypot(a, b) + std::fabs(a)) / 2);
+        if (a >= 0) {
+            re[i] = t;
+            im[i] = b / (2 * t);
+        } else {
+            re[i] = std::fabs(b) / (2 * t);
+            im[i] = std::copysign(t, b);
+        }
+    }
+}
+
+void powiLoop(double* re, double* im, int power, size_t n) {
+    double rr[BLOCK], ri[BLOCK];
+    std::fill(rr, rr + n, 1.0);
+    std::fill(ri, ri + n, 0.0);
+    for (int k = std::abs(power); k > 0; k >>= 1) {
+        if (k & 1) mulLoop(rr, ri, re, im, n);
+        if (k > 1) mulLoop(re, im, re, im, n);
+    }
+    if (power < 0) {
+        for (size_t i = 0; i < n; ++i) {
+            double d = rr[i] * rr[i] + ri[i] * ri[i];
+            re[i] = rr[i] / d;
+            im[i] = -ri[i] / d;
+        }
+    } else {
+        std::copy(rr, rr + n, re);
+        std::copy(ri, ri + n, im);
+    }
+}
+
+// Runs prog over n <= BLOCK lanes; sr/si hold prog.stackSize rows of BLOCK
+void runBlock(const ComplexProgram& prog, const double* zRe, const double* zIm, size_t n, double* sr, double* si,
+              double* outRe, double* outIm) {
+    double* ar = sr - BLOCK;
+    double* ai = si - BLOCK;
+
+    for (const ComplexInstruction& ins : prog.code) {
+        double* br = ar;
+        double* bi = ai;
+        if (isBinary(ins.op)) {
+            ar -= BLOCK;
+            ai -= BLOCK;
+        }
+        switch (ins.op) {
+            case ComplexOp::CONST:
+                ar += BLOCK;
+                ai += BLOCK;
+                std::fill(ar, ar + n, ins.re);
+                std::fill(ai, ai + n, ins.im);
+                break;
+            case ComplexOp::Z:
+                ar += BLOCK;
+                ai += BLOCK;
+                std::copy(zRe, zRe + n, ar);
+                std::copy(zIm, zIm + n, ai);
+                break;
+            case ComplexOp::NEG:
+                for (size_t i = 0; i < n; ++i) {
+                    ar[i] = -ar[i];
+                    ai[i] = -ai[i];
+                }
+                break;
+            case ComplexOp::ADD:
+                for (size_t i = 0; i < n; ++i) {
+                    ar[i] += br[i];
+                    ai[i] += bi[i];
+                }
+                break;
+            case ComplexOp::SUB:
+                for (size_t i = 0; i < n; ++i) {
+                    ar[i] -= br[i];
+                    ai[i] -= bi[i];
+                }
+                break;
+            case ComplexOp::MUL: mulLoop(ar, ai, br, bi, n); break;
+            case ComplexOp::DIV: divLoop(ar, ai, br, bi, n); break;
+            case ComplexOp::POW: {
+                // exp(b log a), 0 where a = 0
+                double zero[BLOCK];
+                for (size_t i = 0; i < n; ++i) zero[i] = ar[i] == 0 && ai[i] == 0;
+                logLoop(ar, ai, n);
+                mulLoop(ar, ai, br, bi, n);
+                expLoop(ar, ai, n);
+                for (size_t i = 0; i < n; ++i) {
+                    if (!zero[i]) continue;
+                    ar[i] = 0;
+                    ai[i] = 0;
+                }
+                break;
+            }
+            case ComplexOp::POWI: powiLoop(ar, ai, ins.arg, n); break;
+            case ComplexOp::SIN:
+                for (size_t i = 0; i < n; ++i) {
+                    double a = ar[i], b = ai[i];
+                    ar[i] = std::sin(a) * std::cosh(b);
+                    ai[i] = std::cos(a) * std::sinh(b);
+                }
+                break;
+            case ComplexOp::COS:
+                for (size_t i = 0; i < n; ++i) {
+                    double a = ar[i], b = ai[i];
+                    ar[i] = std::cos(a) * std::cosh(b);
+                    ai[i] = -std::sin(a) * std::sinh(b);
+                }
+                break;
+            case ComplexOp::TAN:
+                // (sin 2a + i sinh 2b) / (cos 2a + cosh 2b), divided through
+                // by cosh 2b so a large |b| tends to +-i instead of inf/inf
+                for (size_t i = 0; i < n; ++i) {
+                    double a = 2 * ar[i], b = 2 * ai[i];
+                    double c = std::cosh(b), d = 1 + std::cos(a) / c;
+                    ar[i] = std::sin(a) / c / d;
+                    ai[i] = std::tanh(b) / d;
+                }
+                break;
+            case ComplexOp::EXP: expLoop(ar, ai, n); break;
+            case ComplexOp::LOG: logLoop(ar, ai, n); break;
+            case ComplexOp::SQRT: sqrtLoop(ar, ai, n); break;
+            case ComplexOp::ABS:
+                for (size_t i = 0; i < n; ++i) {
+                    ar[i] = std::hypot(ar[i], ai[i]);
+                    ai[i] = 0;
+                }
+                break;
+            case ComplexOp::RE: std::fill(ai, ai + n, 0.0); break;
+            case ComplexOp::IM:
+                std::copy(ai, ai + n, ar);
+                std::fill(ai, ai + n, 0.0);
+                break;
+            case ComplexOp::ARG:
+                for (size_t i = 0; i < n; ++i) {
+                    ar[i] = std::atan2(ai[i], ar[i]);
+                    ai[i] = 0;
+                }
+                break;
+            case ComplexOp::CONJ:
+                for (size_t i = 0; i < n; ++i) ai[i] = -ai[i];
+                break;
+        }
+    }
+
+    std::copy(ar, ar + n, outRe);
+    std::copy(ai, ai + n, outIm);
+}
+
+// --- Coloring ---
+// atan2 to about 1e-5 rad and log2 to about 1e-5, plenty for 8-bit colour,
+// in branch-free arithmetic the compiler can vectorize instead of libm calls.
+// Selects are written as arithmetic on comparisons: GCC will not if-convert
+// floating-point ternaries while it honours trapping math.
+const double ROUNDER = 6755399441055744.0;   // 1.5 * 2^52: x + ROUNDER - ROUNDER rounds x
+
+inline double fastAtan2(double y, double x) {
+    double ax = std::fabs(x), ay = std::fabs(y);
+    double hi = std::max(ax, ay), lo = std::min(ax, ay);
+    double a = lo / std::max(hi, 1e-300), s = a * a;
+    double r = ((-0.0464964749 * s + 0.15931422) * s - 0.327622764) * s * a + a;
+    r += (ay > ax) * (M_PI_2 - 2 * r);
+    r += (x < 0) * (M_PI - 2 * r);
+    return std::copysign(r, y);
+}
+
+// For positive normal x: the exponent (read from the bits as a double, not
+// through an integer conversion) plus log2 of the mantissa m in [1, 2) from
+// the series in t = (m - 1) / (m + 1) <= 1/3
+inline double fastLog2(double x) {
+    uint64_t bits, eBits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    eBits = 0x4330000000000000ULL | (bits >> 52);
+    bits = (bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+    double e, m;
+    std::memcpy(&e, &eBits, sizeof(e));
+    std::memcpy(&m, &bits, sizeof(m));
+    e -= 4503599627370496.0 + 1023;   // 2^52 + bias
+    double t = (m - 1) / (m + 1), t2 = t * t;
+    return e + 2 / M_LN2 * t * (1 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 / 7)));
+}
+
+// Hue from arg w (s = 0.9), value stepping from 0.65 to 1 within each
+// doubling of |w|. hue and value are scratch rows of n doubles.
+void colorPixels(const double* re, const double* im, size_t n, double* hue, double* value, uint8_t* rgba) {
+    for (size_t i = 0; i < n; ++i) {
+        double a = re[i], b = im[i];
+        double h6 = fastAtan2(b, a) * (3 / M_PI);
+        hue[i] = h6 + 6 * (h6 < 0);
+        double l = 0.5 * fastLog2(a * a + b * b);
+        // Rounding l - 1/2 floors l (up to ties, which only pick 0.65 or 1)
+        double whole = (l - 0.5) + ROUNDER - ROUNDER;
+        value[i] = 0.65 + 0.35 * (l - whole);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            // (5 - 2c + hue) mod 6; GCC only if-converts the < comparison
+            double k = (-1 - 2 * c) + hue[i];
+            k += 6 * (k < 0);
+            double f = std::max(0.0, std::min(std::min(k, 4 - k), 1.0));
+            rgba[4 * i + c] = (uint8_t)(int)((value[i] - value[i] * 0.9 * f) * 255 + 0.5);
+        }
+        rgba[4 * i + 3] = 255;
+    }
+
+    // Undefined points transparent, poles white
+    for (size_t i = 0; i < n; ++i) {
+        if (std::isfinite(re[i] * re[i] + im[i] * im[i])) continue;
+        uint8_t fill = std::isnan(re[i]) || std::isnan(im[i]) ? 0 : 255;
+        std::fill(rgba + 4 * i, rgba + 4 * i + 4, fill);
+    }
+}
+
+} // namespace
+
+ComplexProgram compileComplex(ASTNode* node) {
+    Compiler c;
+    c.compile(node);
+
+    ComplexProgram prog;
+    prog.code = std::move(c.code);
+    int depth = 0;
+    for (const auto& ins : prog.code) {
+        depth += stackEffect(ins);
+        prog.stackSize = std::max(prog.stackSize, depth);
+    }
+    return prog;
+}
+
+Complex evaluateComplex(const ComplexProgram& prog, Complex z) {
+    countMetric(Metric::EVALUATIONS);
+    std::vector<Complex> st;
+    st.reserve(prog.stackSize);
+    for (const ComplexInstruction& ins : prog.code) {
+        if (ins.op == ComplexOp::CONST) {
+            st.push_back(Complex(ins.re, ins.im));
+            continue;
+        }
+        if (ins.op == ComplexOp::Z) {
+            st.push_back(z);
+            continue;
+        }
+        Complex b = st.back();
+        if (isBinary(ins.op)) st.pop_back();
+        Complex& a = st.back();
+        switch (ins.op) {
+            case ComplexOp::NEG: a = -a; break;
+            case ComplexOp::ADD: a += b; break;
+            case ComplexOp::SUB: a -= b; break;
+            case ComplexOp::MUL: a *= b; break;
+            case ComplexOp::DIV: a /= b; break;
+            case ComplexOp::POW: a = a == 0.0 ? 0.0 : std::exp(b * std::log(a)); break;
+            case ComplexOp::POWI: a = powi(a, ins.arg); break;
+            case ComplexOp::SIN: a = std::sin(a); break;
+            case ComplexOp::COS: a = std::cos(a); break;
+            case ComplexOp::TAN: a = std::tan(a); break;
+            case ComplexOp::EXP: a = std::exp(a); break;
+            case ComplexOp::LOG: a = std::log(a); break;
+            case ComplexOp::SQRT: a = std::sqrt(a); break;
+            case ComplexOp::ABS: a = std::abs(a); break;
+            case ComplexOp::RE: a = a.real(); break;
+            case ComplexOp::IM: a = a.imag(); break;
+            case ComplexOp::ARG: a = std::arg(a); break;
+            case ComplexOp::CONJ: a = std::conj(a); break;
+            default: break;
+        }
+    }
+    return st.size() == 1 ? st[0] : Complex(NAN, NAN);
+}
+
+void evaluateComplexBatch(const ComplexProgram& prog, const double* zRe, const double* zIm, size_t count,
+                          double* outRe, double* outIm) {
+    countMetric(Metric::EVALUATIONS, count);
+    if (prog.empty()) {
+        std::fill(outRe, outRe + count, NAN);
+        std::fill(outIm, outIm + count, NAN);
+        return;
+    }
+    thread_local std::vector<double> sr, si;
+    if (sr.size() < prog.stackSize * BLOCK) {
+        sr.resize(prog.stackSize * BLOCK);
+        si.resize(prog.stackSize * BLOCK);
+    }
+    for (size_t offset = 0; offset < count; offset += BLOCK) {
+        size_t n = std::min(BLOCK, count - offset);
+        runBlock(prog, zRe + offset, zIm + offset, n, sr.data(), si.data(), outRe + offset, outIm + offset);
+    }
+}
+
+void renderDomainColoring(const ComplexProgram& prog, const PlotWindow& window, std::vector<uint8_t>& rgba) {
+    int W = std::max(window.width, 0), H = std::max(window.height, 0);
+    rgba.assign((size_t)W * H * 4, 0);
+    if (W == 0 || H == 0) return;
+
+    const int T = DOMAIN_TILE;
+    int tilesX = (W + T - 1) / T, tilesY = (H + T - 1) / T;
+    double dx = (window.xMax - window.xMin) / W, dy = (window.yMax - window.yMin) / H;
+    parallelFor((size_t)tilesX * tilesY, [&](size_t t) {
+        int x0 = (int)(t % tilesX) * T, y0 = (int)(t / tilesX) * T;
+        int w = std::min(T, W - x0), h = std::min(T, H - y0), n = w * h;
+        thread_local std::vector<double> buf(6 * T * T);
+        thread_local std::vector<uint8_t> px(4 * T * T);
+        double *zr = buf.data(), *zi = zr + T * T, *wr = zi + T * T, *wi = wr + T * T;
+        double *hue = wi + T * T, *value = hue + T * T;
+        for (int row = 0; row < h; ++row) {
+            for (int col = 0; col < w; ++col) {
+                zr[row * w + col] = window.xMin + (x0 + col + 0.5) * dx;
+                zi[row * w + col] = window.yMax - (y0 + row + 0.5) * dy;
+            }
+        }
+        evaluateComplexBatch(prog, zr, zi, n, wr, wi);
+        colorPixels(wr, wi, n, hue, value, px.data());
+        for (int row = 0; row < h; ++row)
+            std::copy(&px[(size_t)row * w * 4], &px[(size_t)(row + 1) * w * 4],
+                      &rgba[((size_t)(y0 + row) * W + x0) * 4]);
+    });
+}
@@ -0,0 +1,81 @@
+#ifndef COMPLEX_H
+#define COMPLEX_H
+
+#include "../parser/parser.h"
+#include "sampler.h"
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class ComplexOp : uint8_t {
+    CONST,
+    Z,
+    NEG,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    POW,
+    POWI,   // integer power by repeated squaring, arg = exponent
+    SIN,
+    COS,
+    TAN,
+    EXP,
+    LOG,
+    SQRT,
+    ABS,
+    RE,
+    IM,
+    ARG,
+    CONJ
+};
+
+struct ComplexInstruction {
+    ComplexOp op;
+    int32_t arg;      // exponent for POWI
+    double re, im;    // constant for CONST
+};
+
+// Postfix program over complex values in the single variable z, kept apart
+// from CompiledExpr because real constant folding would turn sqrt(-1) into
+// NaN. Constant subtrees are folded in complex arithmetic instead.
+struct ComplexProgram {
+    std::vector<ComplexInstruction> code;
+    int stackSize = 0;
+
+    bool empty() const { return code.empty(); }
+};
+
+// Compiles node over z. Knows i, pi, e, tau and phi, the operators
+// + - * / ^ and sin, cos, tan, exp, ln/log, sqrt, pow, abs, re, im, arg
+// and conj. Throws std::runtime_error for anything else.
+//
+// Branch cuts are the principal values of std::complex everywhere: log and
+// sqrt are cut along the negative real axis, arg lies in (-pi, pi] and the
+// sign of a zero imaginary part picks the side of the cut. a^b is
+// exp(b log a), and 0 for a = 0; a small integer literal exponent
+// multiplies instead, so z^2 is exact.
+ComplexProgram compileComplex(ASTNode* node);
+
+// Reference evaluation with std::complex, one point at a time
+std::complex<double> evaluateComplex(const ComplexProgram& prog, std::complex<double> z);
+
+// Evaluates count points at once with real and imaginary parts in separate
+// arrays (and separate stack rows), so each operation is a plain loop over
+// doubles the compiler can vectorize. Agrees with evaluateComplex to
+// rounding.
+void evaluateComplexBatch(const ComplexProgram& prog, const double* zRe, const double* zIm, size_t count,
+                          double* outRe, double* outIm);
+
+// Side length in pixels of the tiles domain colorings are evaluated in
+const int DOMAIN_TILE = 64;
+
+// Domain coloring of w = f(z) over window's pixel centres (x real, y
+// imaginary, row 0 at yMax) as RGBA bytes: hue is arg w, and brightness
+// steps with log2 |w| so each doubling of the modulus draws a contour.
+// Poles (infinite w) are white and undefined points transparent. Tiles
+// are evaluated in parallel.
+void renderDomainColoring(const ComplexProgram& prog, const PlotWindow& window, std::vector<uint8_t>& rgba);
+
+#endif
@@ -1,17 +1,30 @@
-#include "../parser/parser.h"
 #define _USE_MATH_DEFINES
+#include "../parser/parser.h"
+#include "integrate.h"
+#include "metrics.h"
+#include "special.h"
 #include <cmath>
 #include <string>
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
 #include <vector>
+#include <limits>
 
 // Helper to convert degrees to radians (not needed if trig expects radians directly)
 inline double deg2rad(double degrees) {
     return degrees * M_PI / 180.0;
 }
 
+// Variables bound by the integral, sum and prod calls being evaluated,
+// innermost last
+thread_local std::vector<std::pair<std::string, double>> boundVariables;
+
+struct BindVariable {
+    BindVariable(const std::string& name, double value) { boundVariables.push_back({name, value}); }
+    ~BindVariable() { boundVariables.pop_back(); }
+};
+
 double evaluate(ASTNode* node, double x) {
     if (!node) throw std::runtime_error("Null node in AST");
 
@@ -25,6 +38,8 @@ double evaluate(ASTNode* node, double x) {
             std::string var = node->value;
             std::transform(var.begin(), var.end(), var.begin(), ::tolower);
 
+            for (auto it = boundVariables.rbegin(); it != boundVariables.rend(); ++it)
+                if (it->first == var) return it->second;
             if (var == "x") return x;
             if (var == "pi") return M_PI;
             if (var == "e") return M_E;
@@ -69,6 +84,51 @@ double evaluate(ASTNode* node, double x) {
             std::string func = node->value;
             std::transform(func.begin(), func.end(), func.begin(), ::tolower);
 
+            // integral(f, a, b): x inside f is the integration variable
+            if (func == "integral") {
+                if (node->children.size() != 3)
+                    throw std::runtime_error("integral requires 3 args: integral(f, a, b)");
+                double a = evaluate(node->children[1], x);
+                double b = evaluate(node->children[2], x);
+                ASTNode* f = node->children[0];
+                double result = integrateAdaptive([f](double t) {
+                    try {
+                        BindVariable bind("x", t);
+                        return evaluate(f, t);
+                    }
+                    catch (const std::exception&) {
+                        countMetric(Metric::EXCEPTIONS_CAUGHT);
+                        return std::numeric_limits<double>::quiet_NaN();
+                    }
+                }, a, b);
+                if (!std::isfinite(result))
+                    throw std::runtime_error("integral does not converge");
+                return result;
+            }
+
+            // sum(n, a, b, f) / prod(n, a, b, f) over integers n from a to b
+            if (func == "sum" || func == "prod") {
+                if (node->children.size() != 4 || node->children[0]->type != NodeType::VARIABLE)
+                    throw std::runtime_error(func + " requires 4 args: " + func + "(n, a, b, f)");
+                std::string index = node->children[0]->value;
+                std::transform(index.begin(), index.end(), index.begin(), ::tolower);
+                // Past 2^53 doubles skip integers and ++n stops moving
+                const double MAX_INDEX = 9007199254740992.0;
+                double first = std::round(evaluate(node->children[1], x));
+                double last = std::round(evaluate(node->children[2], x));
+                if (!(std::fabs(first) <= MAX_INDEX && std::fabs(last) <= MAX_INDEX && last - first < 1e6))
+                    throw std::runtime_error(func + " has too many terms");
+
+                double acc = func == "sum" ? 0.0 : 1.0;
+                size_t count = last < first ? 0 : (size_t)(last - first) + 1;
+                for (size_t k = 0; k < count; ++k) {
+                    BindVariable bind(index, first + (double)k);
+                    double term = evaluate(node->children[3], x);
+                    acc = func == "sum" ? acc + term : acc * term;
+                }
+                return acc;
+            }
+
             std::vector<double> args;
             for (ASTNode* arg : node->children) {
                 args.push_back(evaluate(arg, x));
@@ -110,7 +170,7 @@ double evaluate(ASTNode* node, double x) {
             if (func == "floor") return std::floor(args[0]);
             if (func == "ceil") return std::ceil(args[0]);
             if (func == "round") return std::round(args[0]);
-            if (func == "log" || func == "ln") {
+            if ((func == "log" && args.size() == 1) || func == "ln") {
                 if (args[0] <= 0) throw std::runtime_error("log of non-positive");
                 return std::log(args[0]);
             }
@@ -144,6 +204,32 @@ double evaluate(ASTNode* node, double x) {
                 return std::atan2(args[0], args[1]);
             }
 
+            // Special functions (see special.h for their accuracy)
+            if (func == "gamma" || func == "lgamma") {
+                if (args.size() != 1) throw std::runtime_error(func + " requires 1 arg");
+                if (args[0] <= 0 && std::floor(args[0]) == args[0])
+                    throw std::runtime_error(func + " undefined at non-positive integers");
+                return func == "gamma" ? specialGamma(args[0]) : specialLgamma(args[0]);
+            }
+            if (func == "digamma" || func == "trigamma") {
+                if (args.size() != 1) throw std::runtime_error(func + " requires 1 arg");
+                if (args[0] <= 0 && std::floor(args[0]) == args[0])
+                    throw std::runtime_error(func + " undefined at non-positive integers");
+                return func == "digamma" ? specialDigamma(args[0]) : specialTrigamma(args[0]);
+            }
+            if (func == "erf") return specialErf(args[0]);
+            if (func == "erfc") return specialErfc(args[0]);
+            if (func == "normpdf") return specialNormPdf(args[0]);
+            if (func == "normcdf") return specialNormCdf(args[0]);
+            if (func == "besselj0") return specialBesselJ0(args[0]);
+            if (func == "besselj1") return specialBesselJ1(args[0]);
+            if (func == "beta") {
+                if (args.size() != 2) throw std::runtime_error("beta requires 2 args");
+                double b = specialBeta(args[0], args[1]);
+                if (std::isnan(b)) throw std::runtime_error("beta undefined at non-positive integers");
+                return b;
+            }
+
             // Variadic functions
             if (func == "max") {
                 if (args.empty()) throw std::runtime_error("max needs args");
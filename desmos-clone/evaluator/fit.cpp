@@ -0,0 +1,329 @@
+#include "fit.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+const size_t CHUNK = 8192;   // points per parallel work item
+const double INF = std::numeric_limits<double>::infinity();
+const size_t MAX_START_PARAMS = 4;   // up to 2^4 sign patterns of the starting values
+const size_t SUBSAMPLE = 2000;       // points the starting values are compared on
+const int START_ITERATIONS = 30;
+
+// Four partial sums, which the compiler can keep in vector registers
+double dot(const double* a, const double* b, size_t n) {
+    double s[4] = {0, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        for (int j = 0; j < 4; ++j) s[j] += a[i + j] * b[i + j];
+    for (; i < n; ++i) s[0] += a[i] * b[i];
+    return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+class Problem {
+public:
+    Problem(const CompiledExpr& m, const std::vector<double>& x, const std::vector<double>& y, bool analytic)
+        : model(m), xs(x), ys(y), P(m.variables.size() - 1), analytic(analytic),
+          chunks((x.size() + CHUNK - 1) / CHUNK) {}
+
+    // Residual sum of squares at p; infinite if the model is undefined
+    // at any point
+    double cost(const std::vector<double>& p) const {
+        std::vector<double> partial(chunks);
+        parallelFor(chunks, [&](size_t c) {
+            size_t offset = c * CHUNK, n = std::min(CHUNK, xs.size() - offset);
+            thread_local std::vector<double> f;
+            f.resize(n);
+            evaluate(p, offset, n, f.data());
+            for (size_t i = 0; i < n; ++i) f[i] = ys[offset + i] - f[i];
+            double rss = dot(f.data(), f.data(), n);
+            partial[c] = std::isfinite(rss) ? rss : INF;
+        });
+        double rss = 0;
+        for (double s : partial) rss += s;
+        return rss;
+    }
+
+    // J^T J (P x P, row-major) and J^T r at p, where J is the Jacobian of
+    // the model and r the residuals; returns the residual sum of squares.
+    // Chunks are summed in order, so the result does not depend on threads.
+    double normalEquations(const std::vector<double>& p, std::vector<double>& jtj, std::vector<double>& jtr) const {
+        size_t stride = P * P + P + 1;
+        std::vector<double> partial(chunks * stride, 0.0);
+        parallelFor(chunks, [&](size_t c) {
+            size_t offset = c * CHUNK, n = std::min(CHUNK, xs.size() - offset);
+            thread_local std::vector<double> f, jac;
+            f.resize(n);
+            jac.resize(P * n);
+            jacobian(p, offset, n, f.data(), jac.data());
+
+            // Residuals, then each sum as a dot product over the chunk
+            double* sums = &partial[c * stride];
+            for (size_t i = 0; i < n; ++i) f[i] = ys[offset + i] - f[i];
+            for (size_t k = 0; k < P; ++k) {
+                sums[P * P + k] = dot(&jac[k * n], f.data(), n);
+                for (size_t l = 0; l <= k; ++l) sums[k * P + l] = dot(&jac[k * n], &jac[l * n], n);
+            }
+            double rss = dot(f.data(), f.data(), n);
+            sums[P * P + P] = std::isfinite(rss) ? rss : INF;
+        });
+
+        jtj.assign(P * P, 0.0);
+        jtr.assign(P, 0.0);
+        double rss = 0;
+        for (size_t c = 0; c < chunks; ++c) {
+            const double* sums = &partial[c * stride];
+            for (size_t k = 0; k < P; ++k) {
+                jtr[k] += sums[P * P + k];
+                for (size_t l = 0; l <= k; ++l) jtj[k * P + l] += sums[k * P + l];
+            }
+            rss += sums[P * P + P];
+        }
+        for (size_t k = 0; k < P; ++k)
+            for (size_t l = 0; l < k; ++l) jtj[l * P + k] = jtj[k * P + l];
+        return rss;
+    }
+
+private:
+    const CompiledExpr& model;
+    const std::vector<double>& xs;
+    const std::vector<double>& ys;
+    size_t P;
+    bool analytic;
+    size_t chunks;
+
+    void evaluate(const std::vector<double>& p, size_t offset, size_t n, double* f) const {
+        std::vector<VarBinding> bindings(P + 1);
+        bindings[0] = {xs.data() + offset, 1};
+        for (size_t k = 0; k < P; ++k) bindings[k + 1] = {&p[k], 0};
+        evaluateBatch(model, bindings.data(), n, f);
+    }
+
+    // Model values and derivatives with respect to each parameter (row k of
+    // jac holds parameter k)
+    void jacobian(const std::vector<double>& p, size_t offset, size_t n, double* f, double* jac) const {
+        if (analytic) {
+            std::vector<VarBinding> bindings(P + 1);
+            bindings[0] = {xs.data() + offset, 1};
+            std::vector<uint32_t> wrt(P);
+            std::vector<double*> grads(P);
+            for (size_t k = 0; k < P; ++k) {
+                bindings[k + 1] = {&p[k], 0};
+                wrt[k] = (uint32_t)(k + 1);
+                grads[k] = jac + k * n;
+            }
+            evaluateBatchGradient(model, bindings.data(), n, wrt.data(), P, f, grads.data());
+            return;
+        }
+
+        evaluate(p, offset, n, f);
+        std::vector<double> shifted = p, minus(n);
+        for (size_t k = 0; k < P; ++k) {
+            double h = 1e-6 * std::max(std::fabs(p[k]), 1.0);
+            shifted[k] = p[k] + h;
+            evaluate(shifted, offset, n, jac + k * n);
+            shifted[k] = p[k] - h;
+            evaluate(shifted, offset, n, minus.data());
+            shifted[k] = p[k];
+            for (size_t i = 0; i < n; ++i) jac[k * n + i] = (jac[k * n + i] - minus[i]) / (2 * h);
+        }
+    }
+};
+
+// Solves A x = b for symmetric A by Cholesky; false unless A is positive
+// definite
+bool solveCholesky(std::vector<double> a, std::vector<double> b, size_t n, std::vector<double>& x) {
+    for (size_t j = 0; j < n; ++j) {
+        double d = a[j * n + j];
+        for (size_t k = 0; k < j; ++k) d -= a[j * n + k] * a[j * n + k];
+        if (!(d > 0)) return false;
+        a[j * n + j] = std::sqrt(d);
+        for (size_t i = j + 1; i < n; ++i) {
+            double s = a[i * n + j];
+            for (size_t k = 0; k < j; ++k) s -= a[i * n + k] * a[j * n + k];
+            a[i * n + j] = s / a[j * n + j];
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t k = 0; k < i; ++k) b[i] -= a[i * n + k] * b[k];
+        b[i] /= a[i * n + i];
+    }
+    for (size_t i = n; i-- > 0;) {
+        for (size_t k = i + 1; k < n; ++k) b[i] -= a[k * n + i] * b[k];
+        b[i] /= a[i * n + i];
+    }
+    x = std::move(b);
+    return true;
+}
+
+// Levenberg-Marquardt from params; returns the final residual sum of
+// squares, infinite when the model is undefined somewhere at the start
+double levenbergMarquardt(const Problem& problem, std::vector<double>& params, int maxIterations,
+                          int& iterations, bool& converged) {
+    size_t P = params.size();
+    std::vector<double> jtj, jtr, step, trial(P);
+    double rss = problem.normalEquations(params, jtj, jtr);
+    iterations = 0;
+    converged = false;
+    if (!std::isfinite(rss)) return INF;
+
+    // Marquardt's damping scales each parameter by its curvature
+    double lambda = 1e-3;
+    while (iterations < maxIterations && rss > 0) {
+        ++iterations;
+        double maxDiag = 0;
+        bool finite = true;
+        for (size_t k = 0; k < P; ++k) {
+            maxDiag = std::max(maxDiag, jtj[k * P + k]);
+            finite = finite && std::isfinite(jtr[k]);
+        }
+        for (double v : jtj) finite = finite && std::isfinite(v);
+        double floor = maxDiag > 0 ? maxDiag * 1e-12 : 1;
+
+        bool accepted = false;
+        double trialRss = rss;
+        for (; finite && lambda < 1e16; lambda *= 10) {
+            std::vector<double> a = jtj;
+            for (size_t k = 0; k < P; ++k) a[k * P + k] += lambda * std::max(jtj[k * P + k], floor);
+            if (!solveCholesky(a, jtr, P, step)) continue;
+            for (size_t k = 0; k < P; ++k) trial[k] = params[k] + step[k];
+            trialRss = problem.cost(trial);
+            if (trialRss < rss) {
+                accepted = true;
+                break;
+            }
+        }
+        if (!accepted) {
+            // No damped step lowers the cost: a minimum to working precision,
+            // unless the derivatives were undefined
+            converged = finite;
+            return rss;
+        }
+
+        bool smallStep = true;
+        for (size_t k = 0; k < P; ++k)
+            smallStep = smallStep && std::fabs(step[k]) <= 1e-10 * (std::fabs(params[k]) + 1e-10);
+        bool smallGain = rss - trialRss <= 1e-12 * rss;
+        params = trial;
+        lambda = std::max(lambda / 10, 1e-12);
+        rss = problem.normalEquations(params, jtj, jtr);
+        if (smallStep || smallGain) {
+            converged = true;
+            return rss;
+        }
+    }
+    converged = rss == 0;
+    return rss;
+}
+
+} // namespace
+
+FitResult fitLeastSquares(const CompiledExpr& model, const std::vector<double>& xs, const std::vector<double>& ys,
+                          std::vector<double> params, const FitOptions& options) {
+    if (model.variables.empty() || params.size() != model.variables.size() - 1 || xs.size() != ys.size())
+        throw std::runtime_error("Fit needs a model in x and one starting value per parameter");
+    size_t P = params.size();
+    if (xs.size() < std::max<size_t>(P, 1)) throw std::runtime_error("Not enough points to fit");
+
+    FitResult result;
+    result.analyticJacobian = !options.finiteDifferences && hasDerivativeForm(model);
+
+    // A start in the wrong basin (b > 0 for a decaying a*exp(b*x)+c) can
+    // crawl along a valley for hundreds of iterations, so every sign pattern
+    // of the starting values gets a few iterations on a subsample first
+    if (P > 0 && P <= MAX_START_PARAMS && xs.size() > 0) {
+        size_t every = std::max<size_t>(1, xs.size() / SUBSAMPLE);
+        std::vector<double> sx, sy;
+        for (size_t i = 0; i < xs.size(); i += every) {
+            sx.push_back(xs[i]);
+            sy.push_back(ys[i]);
+        }
+        Problem sample(model, sx, sy, result.analyticJacobian);
+        std::vector<double> best = params;
+        double bestRss = INF;
+        for (unsigned signs = 0; signs < (1u << P); ++signs) {
+            std::vector<double> start = params;
+            bool duplicate = false;
+            for (size_t k = 0; k < P; ++k) {
+                if (!(signs >> k & 1)) continue;
+                duplicate = duplicate || start[k] == 0;
+                start[k] = -start[k];
+            }
+            if (duplicate) continue;
+            int iterations;
+            bool converged;
+            double rss = levenbergMarquardt(sample, start, START_ITERATIONS, iterations, converged);
+            if (rss < bestRss) {
+                bestRss = rss;
+                best = start;
+            }
+        }
+        params = best;
+    }
+
+    Problem problem(model, xs, ys, result.analyticJacobian);
+    double rss = levenbergMarquardt(problem, params, options.maxIterations, result.iterations, result.converged);
+    if (!std::isfinite(rss)) throw std::runtime_error("Model is undefined at some data points");
+
+    double mean = 0, total = 0;
+    for (double y : ys) mean += y;
+    mean /= ys.size();
+    for (double y : ys) total += (y - mean) * (y - mean);
+
+    result.params = std::move(params);
+    result.rss = rss;
+    result.rSquared = total > 0 ? 1 - rss / total : (rss == 0 ? 1 : 0);
+    result.rmse = std::sqrt(rss / xs.size());
+    return result;
+}
+
+ASTNode* substituteVariables(const ASTNode* node, const std::vector<std::string>& names,
+                             const std::vector<double>& values) {
+    if (node->type == NodeType::VARIABLE) {
+        std::string name = node->value;
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        auto it = std::find(names.begin(), names.end(), name);
+        if (it != names.end()) {
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.17g", values[it - names.begin()]);
+            return new ASTNode(NodeType::NUMBER, text);
+        }
+        return new ASTNode(node->type, node->value);
+    }
+
+    // integral binds x in its integrand, sum/prod their index in their body
+    std::string func = node->value;
+    std::transform(func.begin(), func.end(), func.begin(), ::tolower);
+    size_t bodyArg = node->children.size();
+    std::string binds;
+    if (node->type == NodeType::FUNCTION && func == "integral" && node->children.size() == 3) {
+        bodyArg = 0;
+        binds = "x";
+    } else if (node->type == NodeType::FUNCTION && (func == "sum" || func == "prod") &&
+               node->children.size() == 4 && node->children[0]->type == NodeType::VARIABLE) {
+        bodyArg = 3;
+        binds = node->children[0]->value;
+        std::transform(binds.begin(), binds.end(), binds.begin(), ::tolower);
+    }
+
+    ASTNode* copy = new ASTNode(node->type, node->value);
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        if (bodyArg == 3 && i == 0) {
+            copy->children.push_back(new ASTNode(node->children[0]->type, node->children[0]->value));
+        } else if (i == bodyArg && std::find(names.begin(), names.end(), binds) != names.end()) {
+            std::vector<std::string> inner = names;
+            std::vector<double> innerValues = values;
+            size_t k = std::find(inner.begin(), inner.end(), binds) - inner.begin();
+            inner.erase(inner.begin() + k);
+            innerValues.erase(innerValues.begin() + k);
+            copy->children.push_back(substituteVariables(node->children[i], inner, innerValues));
+        } else {
+            copy->children.push_back(substituteVariables(node->children[i], names, values));
+        }
+    }
+    return copy;
+}
@@ -0,0 +1,40 @@
+#ifndef FIT_H
+#define FIT_H
+
+#include "compiler.h"
+#include <string>
+#include <vector>
+
+struct FitOptions {
+    int maxIterations = 200;
+    bool finiteDifferences = false;   // central differences even when derivatives are available
+};
+
+struct FitResult {
+    std::vector<double> params;   // one per model parameter, in slot order
+    double rss = 0;               // residual sum of squares
+    double rSquared = 0;
+    double rmse = 0;
+    int iterations = 0;
+    bool converged = false;
+    bool analyticJacobian = false;
+};
+
+// Least-squares fit of y ~ model(x, p1, ..., pn) by Levenberg-Marquardt.
+// model is compiled with the variables x, p1, ..., pn in that order and
+// params holds the starting values; with at most four parameters, the sign
+// pattern of them that fits a subsample best is used instead. Residuals and the normal equations are
+// accumulated in parallel chunks of points, with the Jacobian from forward-
+// mode derivatives (hasDerivativeForm) or else central differences.
+// Throws std::runtime_error when there are fewer points than parameters or
+// the model is undefined at some point for the starting values.
+FitResult fitLeastSquares(const CompiledExpr& model, const std::vector<double>& xs, const std::vector<double>& ys,
+                          std::vector<double> params, const FitOptions& options = FitOptions());
+
+// Copy of node with every variable in names replaced by the number at the
+// same index of values, leaving variables bound by integral or sum/prod
+// alone. The caller frees the result.
+ASTNode* substituteVariables(const ASTNode* node, const std::vector<std::string>& names,
+                             const std::vector<double>& values);
+
+#endif
@@ -0,0 +1,111 @@
+#include "heatmap.h"
+#include "metrics.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const int T = HEATMAP_TILE;
+const int KEEP_MARGIN = 2;   // tiles kept around the window for panning back
+
+int64_t floorDiv(int64_t a, int64_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// Pixel cell i of the lattice spans [i * dx, (i + 1) * dx) in x; row r
+// spans (-(r + 1) * dy, -r * dy] in y, so rows grow downwards like the screen
+void evaluateTile(const CompiledExpr& f, int64_t tx, int64_t ty, double dx, double dy, Precision precision,
+                  std::vector<float>& out) {
+    double xs[T * T], ys[T * T], zs[T * T];
+    for (int k = 0; k < T * T; ++k) {
+        xs[k] = ((double)(tx * T + k % T) + 0.5) * dx;
+        ys[k] = -((double)(ty * T + k / T) + 0.5) * dy;
+    }
+    VarBinding bindings[2] = {{xs, 1}, {ys, 1}};
+    evaluateBatch(f, bindings, T * T, zs, precision);
+    out.resize(T * T);
+    for (int k = 0; k < T * T; ++k) {
+        float z = (float)zs[k];
+        out[k] = std::isfinite(z) ? z : std::numeric_limits<float>::quiet_NaN();
+    }
+}
+
+} // namespace
+
+const std::vector<float>& HeatmapGrid::update(const CompiledExpr& f, const std::string& key,
+                                              const PlotWindow& window, HeatmapStats* stats) {
+    int W = std::max(window.width, 0), H = std::max(window.height, 0);
+    values.assign((size_t)W * H, std::numeric_limits<float>::quiet_NaN());
+    minValue = 1;
+    maxValue = 0;
+    if (W == 0 || H == 0) return values;
+
+    // Panning changes the window's span in its last bits; only a real
+    // change of pixel size (a zoom) invalidates the lattice
+    double newDx = (window.xMax - window.xMin) / W, newDy = (window.yMax - window.yMin) / H;
+    Precision precision = plotPrecision(window);
+    if (key != cachedKey || precision != cachedPrecision || std::fabs(newDx - dx) > 1e-9 * newDx ||
+        std::fabs(newDy - dy) > 1e-9 * newDy) {
+        tiles.clear();
+        cachedKey = key;
+        cachedPrecision = precision;
+        dx = newDx;
+        dy = newDy;
+    }
+
+    // Lattice cell of the window's top-left pixel
+    int64_t col0 = std::llround(window.xMin / dx), row0 = std::llround(-window.yMax / dy);
+    int64_t tx0 = floorDiv(col0, T), tx1 = floorDiv(col0 + W - 1, T);
+    int64_t ty0 = floorDiv(row0, T), ty1 = floorDiv(row0 + H - 1, T);
+
+    // Drop tiles well outside the window, then evaluate the missing ones
+    for (auto it = tiles.begin(); it != tiles.end();) {
+        bool near = it->first.first >= tx0 - KEEP_MARGIN && it->first.first <= tx1 + KEEP_MARGIN &&
+                    it->first.second >= ty0 - KEEP_MARGIN && it->first.second <= ty1 + KEEP_MARGIN;
+        it = near ? std::next(it) : tiles.erase(it);
+    }
+    std::vector<std::pair<TileKey, std::vector<float>*>> missing;
+    for (int64_t ty = ty0; ty <= ty1; ++ty) {
+        for (int64_t tx = tx0; tx <= tx1; ++tx) {
+            auto inserted = tiles.insert({{tx, ty}, {}});
+            if (inserted.second) missing.push_back({{tx, ty}, &inserted.first->second});
+        }
+    }
+    parallelFor(missing.size(), [&](size_t i) {
+        evaluateTile(f, missing[i].first.first, missing[i].first.second, dx, dy, precision, *missing[i].second);
+    });
+    size_t reused = (size_t)((tx1 - tx0 + 1) * (ty1 - ty0 + 1)) - missing.size();
+    countMetric(Metric::HEATMAP_TILE_HITS, reused);
+    countMetric(Metric::HEATMAP_TILE_MISSES, missing.size());
+    if (stats) {
+        stats->tilesComputed += missing.size();
+        stats->tilesReused += reused;
+    }
+
+    // Copy the part of each tile inside the window
+    for (int64_t ty = ty0; ty <= ty1; ++ty) {
+        for (int64_t tx = tx0; tx <= tx1; ++tx) {
+            const std::vector<float>& tile = tiles[{tx, ty}];
+            int x0 = (int)std::max<int64_t>(0, tx * T - col0), x1 = (int)std::min<int64_t>(W, tx * T + T - col0);
+            int y0 = (int)std::max<int64_t>(0, ty * T - row0), y1 = (int)std::min<int64_t>(H, ty * T + T - row0);
+            for (int py = y0; py < y1; ++py) {
+                const float* src = &tile[(size_t)(row0 + py - ty * T) * T + (col0 + x0 - tx * T)];
+                std::copy(src, src + (x1 - x0), &values[(size_t)py * W + x0]);
+            }
+        }
+    }
+
+    float lo = std::numeric_limits<float>::infinity(), hi = -lo;
+    for (float v : values) {
+        if (std::isnan(v)) continue;
+        lo = std::min(lo, v);
+        hi = std::max(hi, v);
+    }
+    if (lo <= hi) {
+        minValue = lo;
+        maxValue = hi;
+    }
+    return values;
+}
@@ -0,0 +1,48 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "sampler.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Side length in pixels of a cached tile
+const int HEATMAP_TILE = 32;
+
+struct HeatmapStats {
+    size_t tilesComputed = 0;
+    size_t tilesReused = 0;
+};
+
+// z = f(x, y) over a window's pixel grid, for heatmaps and contours. Pixels
+// sit on a lattice anchored at the world origin and are evaluated and
+// cached in HEATMAP_TILE x HEATMAP_TILE tiles of that lattice, so panning
+// only evaluates the tiles that came into view. Missing tiles are computed
+// in parallel, one batch per tile.
+class HeatmapGrid {
+public:
+    // Values at the window's pixel centres (width * height, row 0 at yMax),
+    // NaN where f is undefined. f is compiled with the variables x, y in
+    // that order; key identifies it. A new key, pixel size or precision
+    // drops every cached tile.
+    const std::vector<float>& update(const CompiledExpr& f, const std::string& key, const PlotWindow& window,
+                                     HeatmapStats* stats = nullptr);
+
+    // Range of the finite values from the last update; lo > hi if none
+    float lo() const { return minValue; }
+    float hi() const { return maxValue; }
+
+private:
+    using TileKey = std::pair<int64_t, int64_t>;   // lattice column and row / HEATMAP_TILE
+
+    std::string cachedKey;
+    double dx = 0, dy = 0;
+    Precision cachedPrecision = Precision::DOUBLE;
+    std::map<TileKey, std::vector<float>> tiles;
+    std::vector<float> values;
+    float minValue = 1, maxValue = 0;
+};
+
+#endif
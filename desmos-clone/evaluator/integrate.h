@@ -0,0 +1,109 @@
+#ifndef INTEGRATE_H
+#define INTEGRATE_H
+
+#include "parallel.h"
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// Gauss-Kronrod 7/15 rule on [-1, 1]: Kronrod nodes (node 0 is the centre;
+// odd indices are also the Gauss nodes) with their Kronrod and Gauss weights.
+const double GK_NODES[8] = {
+    0.000000000000000000000000000000000,
+    0.207784955007898467600689403773245,
+    0.405845151377397166906606412076961,
+    0.586087235467691130294144845693013,
+    0.741531185599394439863864773280788,
+    0.864864423359769072789712788640926,
+    0.949107912342758524526189684047851,
+    0.991455371120812639206854697526329,
+};
+const double GK_WEIGHTS_K[8] = {
+    0.209482141084727828012999174891714,
+    0.204432940075298892414161999234649,
+    0.190350578064785409913256402421014,
+    0.169004726639267902826583426598550,
+    0.140653259715525918745189590510238,
+    0.104790010322250183839876322541518,
+    0.063092092629978553290700663189204,
+    0.022935322010529224963732008058970,
+};
+const double GK_WEIGHTS_G[8] = {
+    0.417959183673469387755102040816327, 0,
+    0.381830050505118944950369775488975, 0,
+    0.279705391489276667901467771423780, 0,
+    0.129484966168869693270611432679082, 0,
+};
+const int GK_POINTS = 15;
+
+// The 15 abscissae of the rule mapped onto [a, b]
+inline void gaussKronrodAbscissae(double a, double b, double* xs) {
+    double c = 0.5 * (a + b), h = 0.5 * (b - a);
+    xs[0] = c;
+    for (int k = 1; k < 8; ++k) {
+        xs[2 * k - 1] = c - h * GK_NODES[k];
+        xs[2 * k] = c + h * GK_NODES[k];
+    }
+}
+
+// Combines f at gaussKronrodAbscissae(a, b) into the Kronrod estimate and
+// its error (difference from the embedded Gauss rule)
+inline void gaussKronrodCombine(double a, double b, const double* fs, double& value, double& error) {
+    double h = 0.5 * (b - a);
+    double k = GK_WEIGHTS_K[0] * fs[0], g = GK_WEIGHTS_G[0] * fs[0];
+    for (int i = 1; i < 8; ++i) {
+        double pair = fs[2 * i - 1] + fs[2 * i];
+        k += GK_WEIGHTS_K[i] * pair;
+        g += GK_WEIGHTS_G[i] * pair;
+    }
+    value = k * h;
+    error = std::fabs((k - g) * h);
+}
+
+template <typename F>
+double integrateAdaptiveImpl(F& f, double a, double b, double tol, int depth) {
+    double xs[GK_POINTS], fs[GK_POINTS];
+    gaussKronrodAbscissae(a, b, xs);
+    for (int i = 0; i < GK_POINTS; ++i) fs[i] = f(xs[i]);
+
+    double value, error;
+    gaussKronrodCombine(a, b, fs, value, error);
+    if (std::isnan(value)) return value;
+    if (error <= tol || depth <= 0) return value;
+
+    double m = 0.5 * (a + b);
+    return integrateAdaptiveImpl(f, a, m, 0.5 * tol, depth - 1) +
+           integrateAdaptiveImpl(f, m, b, 0.5 * tol, depth - 1);
+}
+
+// Adaptive Gauss-Kronrod quadrature of f over [a, b] (b < a gives the
+// negated integral). Returns NaN if f is undefined anywhere it is sampled.
+template <typename F>
+double integrateAdaptive(F f, double a, double b, double tol = 1e-10) {
+    if (!std::isfinite(a) || !std::isfinite(b)) return std::numeric_limits<double>::quiet_NaN();
+    if (a == b) return 0;
+    double scale = std::max(1.0, std::fabs(b - a));
+    return integrateAdaptiveImpl(f, a, b, tol * scale, 30);
+}
+
+// Same as integrateAdaptive, with [a, b] split into one piece per core.
+// f must be safe to call from several threads. Each call starts and joins
+// its threads, so this is for one large integral, not per evaluation.
+template <typename F>
+double integrateParallel(F f, double a, double b, double tol = 1e-10) {
+    size_t pieces = workerCount();
+    if (pieces <= 1) return integrateAdaptive(f, a, b, tol);
+
+    std::vector<double> parts(pieces);
+    parallelFor(pieces, [&](size_t i) {
+        double lo = a + (b - a) * i / pieces;
+        double hi = (i + 1 == pieces) ? b : a + (b - a) * (i + 1) / pieces;
+        parts[i] = integrateAdaptive(f, lo, hi, tol / pieces);
+    });
+
+    double sum = 0;
+    for (double p : parts) sum += p;
+    return sum;
+}
+
+#endif
@@ -0,0 +1,196 @@
+#define _USE_MATH_DEFINES
+#include "interval.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+
+const double EPSILON = 1e-12;   // divisors closer to 0 are undefined, as in applyBinary
+const double INF = std::numeric_limits<double>::infinity();
+
+Interval widen(Interval a) {
+    return {std::nextafter(a.lo, -INF), std::nextafter(a.hi, INF)};
+}
+
+Interval hull(double a, double b, double c, double d) {
+    return {std::min({a, b, c, d}), std::max({a, b, c, d})};
+}
+
+// True if [lo, hi] contains offset + k * period for some integer k
+bool containsPeriodic(Interval a, double offset, double period) {
+    double k = std::ceil((a.lo - offset) / period);
+    return offset + k * period <= a.hi;
+}
+
+Interval sinInterval(Interval a) {
+    if (!(a.hi - a.lo < 2 * M_PI) || std::fabs(a.lo) > 1e9) return {-1, 1};
+    double s0 = std::sin(a.lo), s1 = std::sin(a.hi);
+    Interval r = widen({std::min(s0, s1), std::max(s0, s1)});
+    if (containsPeriodic(a, M_PI / 2, 2 * M_PI)) r.hi = 1;
+    if (containsPeriodic(a, -M_PI / 2, 2 * M_PI)) r.lo = -1;
+    return {std::max(r.lo, -1.0), std::min(r.hi, 1.0)};
+}
+
+Interval cosInterval(Interval a) {
+    if (!(a.hi - a.lo < 2 * M_PI) || std::fabs(a.lo) > 1e9) return {-1, 1};
+    double c0 = std::cos(a.lo), c1 = std::cos(a.hi);
+    Interval r = widen({std::min(c0, c1), std::max(c0, c1)});
+    if (containsPeriodic(a, 0, 2 * M_PI)) r.hi = 1;
+    if (containsPeriodic(a, M_PI, 2 * M_PI)) r.lo = -1;
+    return {std::max(r.lo, -1.0), std::min(r.hi, 1.0)};
+}
+
+bool powInterval(Interval a, Interval b, Interval& r) {
+    // Integer exponents are defined for any base
+    if (b.lo == b.hi && std::floor(b.lo) == b.lo) {
+        double n = b.lo;
+        if (a.lo > 0 || a.hi < 0) {
+            double p0 = std::pow(a.lo, n), p1 = std::pow(a.hi, n);
+            r = widen({std::min(p0, p1), std::max(p0, p1)});
+            return true;
+        }
+        if (n < 0) return false;   // 0 to a negative power
+        if (n == 0) { r = {1, 1}; return true; }
+        double p0 = std::pow(a.lo, n), p1 = std::pow(a.hi, n);
+        r = std::fmod(n, 2) != 0 ? widen({p0, p1}) : Interval{0, std::nextafter(std::max(p0, p1), INF)};
+        return true;
+    }
+    // Otherwise only positive bases, where pow is monotonic in each argument
+    if (a.lo <= 0) return false;
+    r = widen(hull(std::pow(a.lo, b.lo), std::pow(a.lo, b.hi), std::pow(a.hi, b.lo), std::pow(a.hi, b.hi)));
+    return true;
+}
+
+// fmod(a, m) for a constant m: exact while a stays within one period
+bool modInterval(Interval a, Interval b, Interval& r) {
+    if (b.lo != b.hi || std::fabs(b.lo) < EPSILON) return false;
+    double m = std::fabs(b.lo);
+    if (a.lo >= 0) {
+        double k = std::floor(a.lo / m);
+        r = std::floor(a.hi / m) == k ? Interval{a.lo - k * m, a.hi - k * m} : Interval{0, m};
+    } else if (a.hi <= 0) {
+        double k = std::ceil(a.hi / m);
+        r = std::ceil(a.lo / m) == k ? Interval{a.lo - k * m, a.hi - k * m} : Interval{-m, 0};
+    } else {
+        r = {std::max(-m, a.lo), std::min(m, a.hi)};
+    }
+    return true;
+}
+
+template <typename F>
+Interval monotone(Interval a, F f) {
+    return widen({f(a.lo), f(a.hi)});
+}
+
+bool applyUnaryInterval(OpCode op, Interval a, Interval& r) {
+    switch (op) {
+        case OpCode::NEG: r = {-a.hi, -a.lo}; return true;
+        case OpCode::SIN: r = sinInterval(a); return true;
+        case OpCode::COS: r = cosInterval(a); return true;
+        case OpCode::SQRT:
+            if (a.lo < 0) return false;
+            r = monotone(a, [](double v) { return std::sqrt(v); });
+            r.lo = std::max(r.lo, 0.0);
+            return true;
+        case OpCode::ABS:
+            if (a.lo >= 0) r = a;
+            else if (a.hi <= 0) r = {-a.hi, -a.lo};
+            else r = {0, std::max(-a.lo, a.hi)};
+            return true;
+        case OpCode::SIGN: r = {(double)((a.lo > 0) - (a.lo < 0)), (double)((a.hi > 0) - (a.hi < 0))}; return true;
+        case OpCode::FLOOR: r = {std::floor(a.lo), std::floor(a.hi)}; return true;
+        case OpCode::CEIL: r = {std::ceil(a.lo), std::ceil(a.hi)}; return true;
+        case OpCode::ROUND: r = {std::round(a.lo), std::round(a.hi)}; return true;
+        case OpCode::LN:
+            if (a.lo <= 0) return false;
+            r = monotone(a, [](double v) { return std::log(v); });
+            return true;
+        case OpCode::LOG10:
+            if (a.lo <= 0) return false;
+            r = monotone(a, [](double v) { return std::log10(v); });
+            return true;
+        case OpCode::LOG2:
+            if (a.lo <= 0) return false;
+            r = monotone(a, [](double v) { return std::log2(v); });
+            return true;
+        case OpCode::EXP:
+            r = monotone(a, [](double v) { return std::exp(v); });
+            r.lo = std::max(r.lo, 0.0);
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool applyBinaryInterval(OpCode op, Interval a, Interval b, Interval& r) {
+    switch (op) {
+        case OpCode::ADD: r = {a.lo + b.lo, a.hi + b.hi}; return true;
+        case OpCode::SUB: r = {a.lo - b.hi, a.hi - b.lo}; return true;
+        case OpCode::MUL: r = hull(a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi); return true;
+        case OpCode::DIV:
+            if (b.lo < EPSILON && b.hi > -EPSILON) return false;
+            r = hull(a.lo / b.lo, a.lo / b.hi, a.hi / b.lo, a.hi / b.hi);
+            return true;
+        case OpCode::POW:
+        case OpCode::POWF: return powInterval(a, b, r);
+        case OpCode::MOD: return modInterval(a, b, r);
+        default: return false;
+    }
+}
+
+} // namespace
+
+bool hasIntervalForm(const CompiledExpr& prog) {
+    Interval r;
+    for (const Instruction& ins : prog.code) {
+        switch (ins.op) {
+            case OpCode::CONST:
+            case OpCode::VAR:
+            case OpCode::MAX:
+            case OpCode::MIN:
+                break;
+            default:
+                // Probe with a harmless argument: unsupported opcodes fail for any input
+                if (!applyUnaryInterval(ins.op, {1, 1}, r) && !applyBinaryInterval(ins.op, {1, 1}, {1, 1}, r))
+                    return false;
+        }
+    }
+    return true;
+}
+
+bool evaluateInterval(const CompiledExpr& prog, const Interval* vars, Interval& out) {
+    Interval local[32];
+    std::vector<Interval> heap;
+    Interval* st = local;
+    if (prog.stackSize > 32) {
+        heap.resize(prog.stackSize);
+        st = heap.data();
+    }
+
+    int top = -1;
+    for (const Instruction& ins : prog.code) {
+        switch (ins.op) {
+            case OpCode::CONST: st[++top] = {ins.value, ins.value}; break;
+            case OpCode::VAR: st[++top] = vars[ins.arg]; break;
+            case OpCode::MAX:
+            case OpCode::MIN: {
+                top -= ins.arg - 1;
+                for (uint32_t k = 1; k < ins.arg; ++k) {
+                    Interval b = st[top + k];
+                    st[top] = ins.op == OpCode::MAX ? Interval{std::max(st[top].lo, b.lo), std::max(st[top].hi, b.hi)}
+                                                    : Interval{std::min(st[top].lo, b.lo), std::min(st[top].hi, b.hi)};
+                }
+                break;
+            }
+            default:
+                if (applyUnaryInterval(ins.op, st[top], st[top])) break;
+                if (top < 1 || !applyBinaryInterval(ins.op, st[top - 1], st[top], st[top - 1])) return false;
+                --top;
+        }
+        if (std::isnan(st[top].lo) || std::isnan(st[top].hi)) return false;
+    }
+    out = st[0];
+    return top == 0;
+}
@@ -0,0 +1,22 @@
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include "compiler.h"
+
+struct Interval {
+    double lo, hi;
+};
+
+// True if every instruction of prog has an interval form: arithmetic,
+// powers, sin, cos, sqrt, abs, sign, floor, ceil, round, logarithms, exp,
+// mod, max and min
+bool hasIntervalForm(const CompiledExpr& prog);
+
+// Bounds prog over a box (one interval per variable slot) by interval
+// arithmetic. Transcendental results are widened by an ulp; rounding of
+// + - * / is not tracked. Returns false when prog has no interval form or
+// may be undefined somewhere in the box (division by an interval around 0,
+// logarithm or square root of one reaching below 0, ...).
+bool evaluateInterval(const CompiledExpr& prog, const Interval* vars, Interval& out);
+
+#endif
@@ -0,0 +1,106 @@
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+const size_t N = (size_t)Metric::COUNT;
+
+const char* const NAMES[N] = {
+    "evaluations",
+    "exceptions_caught",
+    "parses",
+    "parse_failures",
+    "analysis_hits",
+    "analysis_misses",
+    "heatmap_tile_hits",
+    "heatmap_tile_misses",
+    "area_hits",
+    "area_misses",
+    "samples_plotted",
+    "samples_undefined",
+    "samples_offscreen",
+    "instructions_saved",
+    "frames",
+    "frame_nanoseconds",
+    "slow_frames",
+};
+
+// Live threads' blocks and what exited threads counted
+struct Registry {
+    std::mutex mutex;
+    std::vector<ThreadMetrics*> live;
+    uint64_t retired[N] = {};
+};
+
+Registry& registry() {
+    static Registry* r = new Registry;   // never destroyed, threads may still exit after main
+    return *r;
+}
+
+void readAll(uint64_t totals[N]) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (size_t i = 0; i < N; ++i) totals[i] = r.retired[i];
+    for (const ThreadMetrics* t : r.live)
+        for (size_t i = 0; i < N; ++i) totals[i] += t->values[i].load(std::memory_order_relaxed);
+}
+
+// Destroyed at thread exit, which retires the thread's block
+struct Retirer {
+    ThreadMetrics* metrics;
+
+    ~Retirer() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (size_t i = 0; i < N; ++i) r.retired[i] += metrics->values[i].load(std::memory_order_relaxed);
+        r.live.erase(std::find(r.live.begin(), r.live.end(), metrics));
+    }
+};
+
+} // namespace
+
+void registerThreadMetrics(ThreadMetrics& metrics) {
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.live.push_back(&metrics);
+        metrics.registered = true;
+    }
+    thread_local Retirer retirer{&metrics};
+}
+
+uint64_t readMetric(Metric m) {
+    uint64_t totals[N];
+    readAll(totals);
+    return totals[(size_t)m];
+}
+
+const char* metricName(Metric m) {
+    return (size_t)m < N ? NAMES[(size_t)m] : "unknown";
+}
+
+std::string metricsJson() {
+    double now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    char part[64];
+    std::snprintf(part, sizeof(part), "{\"time\":%.3f", now);
+    std::string json = part;
+    uint64_t totals[N];
+    readAll(totals);   // one consistent snapshot
+    for (size_t i = 0; i < N; ++i) {
+        std::snprintf(part, sizeof(part), ",\"%s\":%llu", NAMES[i], (unsigned long long)totals[i]);
+        json += part;
+    }
+    return json + "}";
+}
+
+bool exportMetrics(const std::string& path) {
+    FILE* f = std::fopen(path.c_str(), "a");
+    if (!f) return false;
+    std::string line = metricsJson() + "\n";
+    bool ok = std::fwrite(line.data(), 1, line.size(), f) == line.size();
+    return std::fclose(f) == 0 && ok;
+}
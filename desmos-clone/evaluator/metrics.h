@@ -0,0 +1,71 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Always-on counters for the evaluation hot paths and the frame loop
+enum class Metric {
+    EVALUATIONS,           // points through evaluateCompiled, evaluateBatch(Gradient) and the complex evaluators
+    EXCEPTIONS_CAUGHT,     // errors handled without reaching the user as a crash
+    PARSES,                // expression texts parsed for the UI
+    PARSE_FAILURES,
+    ANALYSIS_HITS,         // CurveAnalyzer curves reused from the cache
+    ANALYSIS_MISSES,
+    HEATMAP_TILE_HITS,     // HeatmapGrid tiles reused while panning
+    HEATMAP_TILE_MISSES,
+    AREA_HITS,             // shaded areas reused from the UI's cache
+    AREA_MISSES,
+    SAMPLES_PLOTTED,       // explicit curve samples DrawGraphArea drew
+    SAMPLES_UNDEFINED,     // ... skipped as NaN
+    SAMPLES_OFFSCREEN,     // ... skipped outside the window
+    INSTRUCTIONS_SAVED,    // instruction evaluations SharedSampler saved by sharing subexpressions
+    FRAMES,
+    FRAME_NANOSECONDS,
+    SLOW_FRAMES,           // frames over 1/30 s
+    COUNT
+};
+
+// One thread's counters. Only the owning thread writes them, so counting is
+// a relaxed load and store with no locked instruction; readers sum every
+// live thread's block and the totals of threads that have exited. The
+// block is zero-initialized thread_local storage with no constructor, so
+// reaching it needs no initialization guard; it registers itself on the
+// thread's first count.
+struct ThreadMetrics {
+    std::atomic<uint64_t> values[(size_t)Metric::COUNT];
+    bool registered;
+};
+
+inline ThreadMetrics& threadMetrics() {
+    thread_local ThreadMetrics metrics;
+    return metrics;
+}
+
+// Adds metrics to the live blocks until its thread exits, when its counts
+// move to the exited threads' totals
+void registerThreadMetrics(ThreadMetrics& metrics);
+
+inline void countMetric(Metric m, uint64_t n = 1) {
+    ThreadMetrics& t = threadMetrics();
+    if (!t.registered) registerThreadMetrics(t);
+    std::atomic<uint64_t>& v = t.values[(size_t)m];
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Total over all threads, past and present
+uint64_t readMetric(Metric m);
+
+// snake_case name used in exports: "evaluations", "parse_failures", ...
+const char* metricName(Metric m);
+
+// Every counter as one JSON object on a single line, with the Unix time in
+// seconds first: {"time":1760000000.123,"evaluations":1234,...}
+std::string metricsJson();
+
+// Appends metricsJson() and a newline to path (JSON lines, one snapshot
+// per export). Returns false if the file cannot be written.
+bool exportMetrics(const std::string& path);
+
+#endif
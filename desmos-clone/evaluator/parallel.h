@@ -0,0 +1,46 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use for parallel loops (at least 1)
+inline unsigned workerCount() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+// True on threads currently running parallelFor work
+inline bool& inParallelRegion() {
+    thread_local bool flag = false;
+    return flag;
+}
+
+// Runs fn(i) for every i in [0, count) across the available cores.
+// Work items are handed out one at a time, so uneven items balance themselves.
+// Nested calls run serially on the calling worker. fn must not throw.
+template <typename Fn>
+void parallelFor(size_t count, Fn fn) {
+    unsigned threads = (unsigned)std::min<size_t>(workerCount(), count);
+    if (threads <= 1 || inParallelRegion()) {
+        for (size_t i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        inParallelRegion() = true;
+        for (size_t i = next++; i < count; i = next++) fn(i);
+        inParallelRegion() = false;
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& th : pool) th.join();
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include "region.h"
+#include "interval.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Evaluates f at pixel centres [x0, x1) x [y0, y1) and writes the mask
+void rasterizePixels(const CompiledExpr& f, Relation relation, const PlotWindow& window, Precision precision,
+                     int x0, int y0, int x1, int y1, uint8_t* mask) {
+    double dx = (window.xMax - window.xMin) / window.width;
+    double dy = (window.yMax - window.yMin) / window.height;
+    int w = x1 - x0, n = w * (y1 - y0);
+    std::vector<double> xs(n), ys(n), vals(n);
+    for (int i = 0; i < n; ++i) {
+        xs[i] = window.xMin + (x0 + i % w + 0.5) * dx;
+        ys[i] = window.yMax - (y0 + i / w + 0.5) * dy;
+    }
+    VarBinding bindings[2] = {{xs.data(), 1}, {ys.data(), 1}};
+    evaluateBatch(f, bindings, n, vals.data(), precision);
+    for (int i = 0; i < n; ++i)
+        mask[(size_t)(y0 + i / w) * window.width + x0 + i % w] = satisfies(vals[i], relation);
+}
+
+} // namespace
+
+void rasterizeRegion(const CompiledExpr& f, Relation relation, const PlotWindow& window,
+                     std::vector<uint8_t>& mask, RegionStats* stats) {
+    int W = window.width, H = window.height;
+    mask.assign((size_t)std::max(W, 0) * std::max(H, 0), 0);
+    if (W <= 0 || H <= 0) return;
+
+    const int T = REGION_TILE;
+    int tilesX = (W + T - 1) / T, tilesY = (H + T - 1) / T;
+    int cornersX = tilesX + 1;
+    size_t corners = (size_t)cornersX * (tilesY + 1), tiles = (size_t)tilesX * tilesY;
+    double dx = (window.xMax - window.xMin) / W;
+    double dy = (window.yMax - window.yMin) / H;
+    Precision precision = plotPrecision(window);
+
+    // Classify each tile as outside (0), inside (1) or boundary (2)
+    std::vector<uint8_t> state(tiles);
+    size_t evaluations = 0;
+    if (hasIntervalForm(f)) {
+        for (size_t t = 0; t < tiles; ++t) {
+            int px = (int)(t % tilesX) * T, py = (int)(t / tilesX) * T;
+            Interval box[2] = {{window.xMin + px * dx, window.xMin + std::min(px + T, W) * dx},
+                               {window.yMax - std::min(py + T, H) * dy, window.yMax - py * dy}};
+            Interval r;
+            if (!evaluateInterval(f, box, r)) state[t] = 2;
+            else state[t] = satisfies(r.lo, relation) + satisfies(r.hi, relation) == 1 ? 2 : satisfies(r.lo, relation);
+        }
+        evaluations = tiles;
+    } else {
+        // No interval form: sample tile corners (on pixel edges) and centres
+        // in one batch instead
+        std::vector<double> xs(corners + tiles), ys(corners + tiles), vals(corners + tiles);
+        for (size_t i = 0; i < corners; ++i) {
+            xs[i] = window.xMin + std::min((int)(i % cornersX) * T, W) * dx;
+            ys[i] = window.yMax - std::min((int)(i / cornersX) * T, H) * dy;
+        }
+        for (size_t t = 0; t < tiles; ++t) {
+            int px = (int)(t % tilesX) * T, py = (int)(t / tilesX) * T;
+            xs[corners + t] = window.xMin + 0.5 * (px + std::min(px + T, W)) * dx;
+            ys[corners + t] = window.yMax - 0.5 * (py + std::min(py + T, H)) * dy;
+        }
+        VarBinding bindings[2] = {{xs.data(), 1}, {ys.data(), 1}};
+        evaluateBatch(f, bindings, xs.size(), vals.data(), precision);
+        evaluations = xs.size();
+
+        for (size_t t = 0; t < tiles; ++t) {
+            size_t c = (t / tilesX) * cornersX + t % tilesX;
+            double samples[5] = {vals[c], vals[c + 1], vals[c + cornersX], vals[c + cornersX + 1], vals[corners + t]};
+            int inside = 0;
+            bool finite = true;
+            for (double v : samples) {
+                inside += satisfies(v, relation);
+                finite = finite && std::isfinite(v);
+            }
+            state[t] = !finite || (inside != 0 && inside != 5) ? 2 : inside == 5;
+        }
+    }
+
+    std::vector<size_t> boundary;
+    for (size_t t = 0; t < tiles; ++t) {
+        if (state[t] == 2) {
+            boundary.push_back(t);
+        } else if (state[t] == 1) {
+            int x0 = (int)(t % tilesX) * T, x1 = std::min(x0 + T, W), y0 = (int)(t / tilesX) * T;
+            for (int py = y0; py < std::min(y0 + T, H); ++py)
+                std::fill(mask.begin() + (size_t)py * W + x0, mask.begin() + (size_t)py * W + x1, 1);
+        }
+    }
+
+    parallelFor(boundary.size(), [&](size_t i) {
+        int x0 = (int)(boundary[i] % tilesX) * T, y0 = (int)(boundary[i] / tilesX) * T;
+        rasterizePixels(f, relation, window, precision, x0, y0, std::min(x0 + T, W), std::min(y0 + T, H),
+                        mask.data());
+    });
+
+    if (stats) {
+        stats->tiles = tiles;
+        stats->boundaryTiles = boundary.size();
+        stats->evaluations = evaluations + boundary.size() * T * T;
+    }
+}
+
+void rasterizeRegionExact(const CompiledExpr& f, Relation relation, const PlotWindow& window,
+                          std::vector<uint8_t>& mask) {
+    mask.assign((size_t)std::max(window.width, 0) * std::max(window.height, 0), 0);
+    if (window.width <= 0 || window.height <= 0) return;
+    Precision precision = plotPrecision(window);
+    parallelFor((size_t)window.height, [&](size_t row) {
+        rasterizePixels(f, relation, window, precision, 0, (int)row, window.width, (int)row + 1, mask.data());
+    });
+}
+
+void fillRegionColumns(const std::vector<double>& ys, Relation relation, const PlotWindow& window,
+                       std::vector<uint8_t>& mask) {
+    int W = window.width, H = window.height;
+    mask.assign((size_t)std::max(W, 0) * std::max(H, 0), 0);
+    if (W <= 0 || H <= 0 || ys.size() < 2) return;
+
+    int samples = (int)ys.size() - 1;
+    double dy = (window.yMax - window.yMin) / H;
+    bool below = relation == Relation::LESS || relation == Relation::LESS_EQUAL;
+    for (int px = 0; px < W; ++px) {
+        double f = ys[(size_t)std::lround((px + 0.5) / W * samples)];
+        if (std::isnan(f)) continue;
+
+        // Rows from split down have pixel centres below f
+        double edge = std::floor((window.yMax - f) / dy - 0.5) + 1;
+        int split = (int)std::max(0.0, std::min((double)H, edge));
+        int from = below ? split : 0, to = below ? H : split;
+        for (int py = from; py < to; ++py) mask[(size_t)py * W + px] = 1;
+    }
+}
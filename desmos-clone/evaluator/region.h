@@ -0,0 +1,61 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include "sampler.h"
+#include <cstdint>
+#include <vector>
+
+// True if value <relation> 0; NaN never is
+inline bool satisfies(double value, Relation relation) {
+    switch (relation) {
+        case Relation::LESS: return value < 0;
+        case Relation::LESS_EQUAL: return value <= 0;
+        case Relation::GREATER: return value > 0;
+        case Relation::GREATER_EQUAL: return value >= 0;
+    }
+    return false;
+}
+
+// The same comparison with its sides swapped: a < b is b > a
+inline Relation flipRelation(Relation relation) {
+    switch (relation) {
+        case Relation::LESS: return Relation::GREATER;
+        case Relation::LESS_EQUAL: return Relation::GREATER_EQUAL;
+        case Relation::GREATER: return Relation::LESS;
+        case Relation::GREATER_EQUAL: return Relation::LESS_EQUAL;
+    }
+    return relation;
+}
+
+// Side length in pixels of the rasterizer's tiles; a full tile is one
+// batch block
+const int REGION_TILE = 16;
+
+struct RegionStats {
+    size_t tiles = 0;
+    size_t boundaryTiles = 0;   // tiles evaluated pixel by pixel
+    size_t evaluations = 0;
+};
+
+// Pixel mask (1 inside, 0 outside) of the region F(x, y) <relation> 0 over
+// window's width x height pixels, row 0 at yMax. f is compiled with the
+// variables x, y in that order. Each tile is first bounded by interval
+// arithmetic and filled or cleared whole when the bounds settle it; the
+// rest are evaluated at every pixel centre. Programs without an interval
+// form (see interval.h) sample tile corners and centres instead and treat
+// a tile whose five samples agree as settled, which can miss features
+// smaller than a tile.
+void rasterizeRegion(const CompiledExpr& f, Relation relation, const PlotWindow& window,
+                     std::vector<uint8_t>& mask, RegionStats* stats = nullptr);
+
+// Same as rasterizeRegion, evaluating every pixel
+void rasterizeRegionExact(const CompiledExpr& f, Relation relation, const PlotWindow& window,
+                          std::vector<uint8_t>& mask);
+
+// Pixel mask of y <relation> f(x), filled column by column from ys as
+// returned by sampleFunction over [window.xMin, window.xMax]. Columns where
+// f is undefined stay empty.
+void fillRegionColumns(const std::vector<double>& ys, Relation relation, const PlotWindow& window,
+                       std::vector<uint8_t>& mask);
+
+#endif
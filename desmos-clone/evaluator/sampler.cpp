@@ -0,0 +1,342 @@
+#include "sampler.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+// Adaptive sampling limits
+const int INITIAL_INTERVALS = 128;
+const int MAX_DEPTH = 12;            // halvings of an initial interval
+const size_t MAX_POINTS = 40000;
+const double MAX_SEGMENT_PX = 3.0;   // split segments longer than this on screen
+const double MIN_SEGMENT_PX = 0.5;   // never split segments shorter than this
+const double MAX_TURN = 0.1;         // radians between neighbouring segments
+
+struct Sample {
+    double t, x, y;   // world coordinates
+    double sx, sy;    // pixel coordinates
+    int depth;        // depth of the interval that ends at this sample
+    bool finite() const { return !std::isnan(x); }
+};
+
+// Turning angle at b between segments a->b and b->c, 0 when undefined
+double turnAngle(const Sample& a, const Sample& b, const Sample& c) {
+    if (!a.finite() || !b.finite() || !c.finite()) return 0;
+    double ux = b.sx - a.sx, uy = b.sy - a.sy;
+    double vx = c.sx - b.sx, vy = c.sy - b.sy;
+    double lu = std::hypot(ux, uy), lv = std::hypot(vx, vy);
+    if (lu < 1e-9 || lv < 1e-9) return 0;
+    double cosA = (ux * vx + uy * vy) / (lu * lv);
+    return std::acos(std::max(-1.0, std::min(1.0, cosA)));
+}
+
+// Both endpoints beyond the same edge: nothing inside the window to refine
+bool offscreenTogether(const Sample& a, const Sample& b, const PlotWindow& w) {
+    return (a.sx < 0 && b.sx < 0) || (a.sx > w.width && b.sx > w.width) ||
+           (a.sy < 0 && b.sy < 0) || (a.sy > w.height && b.sy > w.height);
+}
+
+// Refines the parameter grid until every on-screen segment is short and the
+// curve turns little at each vertex. New parameters of each round are
+// evaluated together through evalPoints(ts, n, xs, ys), i.e. the batch path.
+template <typename EvalPoints>
+void adaptiveSample(double tMin, double tMax, const PlotWindow& w, EvalPoints evalPoints,
+                    std::vector<Point2>& out) {
+    out.clear();
+    if (!(tMax > tMin) || w.width <= 0 || w.height <= 0) return;
+
+    double scaleX = w.width / (w.xMax - w.xMin);
+    double scaleY = w.height / (w.yMax - w.yMin);
+
+    std::vector<double> ts, xs, ys;
+    auto evaluateInto = [&](std::vector<Sample>& dst, const std::vector<int>& depths) {
+        xs.resize(ts.size());
+        ys.resize(ts.size());
+        evalPoints(ts.data(), ts.size(), xs.data(), ys.data());
+        dst.clear();
+        for (size_t i = 0; i < ts.size(); ++i) {
+            Sample s{ts[i], xs[i], ys[i], 0, 0, depths[i]};
+            if (!std::isfinite(s.x) || !std::isfinite(s.y)) s.x = s.y = NaN;
+            s.sx = (s.x - w.xMin) * scaleX;
+            s.sy = (w.yMax - s.y) * scaleY;
+            dst.push_back(s);
+        }
+    };
+
+    std::vector<Sample> samples, fresh, merged;
+    std::vector<int> depths;
+    for (int i = 0; i <= INITIAL_INTERVALS; ++i) {
+        ts.push_back(tMin + (tMax - tMin) * i / INITIAL_INTERVALS);
+        depths.push_back(0);
+    }
+    evaluateInto(samples, depths);
+
+    while (samples.size() < MAX_POINTS) {
+        ts.clear();
+        depths.clear();
+        std::vector<size_t> splitAfter;
+
+        for (size_t i = 0; i + 1 < samples.size(); ++i) {
+            const Sample& a = samples[i];
+            const Sample& b = samples[i + 1];
+            int depth = b.depth;
+            if (depth >= MAX_DEPTH) continue;
+
+            bool split = false;
+            if (a.finite() && b.finite()) {
+                if (offscreenTogether(a, b, w)) continue;
+                double len = std::hypot(b.sx - a.sx, b.sy - a.sy);
+                if (len > MAX_SEGMENT_PX) {
+                    split = true;
+                } else if (len > MIN_SEGMENT_PX) {
+                    double turnA = i > 0 ? turnAngle(samples[i - 1], a, b) : 0;
+                    double turnB = i + 2 < samples.size() ? turnAngle(a, b, samples[i + 2]) : 0;
+                    split = std::max(turnA, turnB) > MAX_TURN;
+                }
+            } else {
+                // Domain edge inside this interval: narrow it down
+                split = a.finite() != b.finite();
+            }
+
+            if (split) {
+                splitAfter.push_back(i);
+                ts.push_back(0.5 * (a.t + b.t));
+                depths.push_back(depth + 1);
+            }
+        }
+        if (splitAfter.empty()) break;
+
+        evaluateInto(fresh, depths);
+
+        merged.clear();
+        size_t k = 0;
+        for (size_t i = 0; i < samples.size(); ++i) {
+            merged.push_back(samples[i]);
+            if (k < splitAfter.size() && splitAfter[k] == i) {
+                merged.push_back(fresh[k]);
+                merged.back().depth = depths[k];
+                samples[i + 1].depth = depths[k];
+                ++k;
+            }
+        }
+        samples.swap(merged);
+    }
+
+    // Emit the polyline, collapsing runs of undefined samples into one break
+    for (const Sample& s : samples) {
+        if (s.finite()) out.push_back({s.x, s.y});
+        else if (!out.empty() && !std::isnan(out.back().x)) out.push_back({NaN, NaN});
+    }
+}
+
+// Liang-Barsky: the part of segment p -> q inside the window, as the
+// parameters [t0, t1] along it. False if no part is inside.
+bool clipSegment(const Point2& p, const Point2& q, const PlotWindow& w, double& t0, double& t1) {
+    double dx = q.x - p.x, dy = q.y - p.y;
+    const double dirs[4] = {-dx, dx, -dy, dy};
+    const double room[4] = {p.x - w.xMin, w.xMax - p.x, p.y - w.yMin, w.yMax - p.y};
+    t0 = 0;
+    t1 = 1;
+    for (int k = 0; k < 4; ++k) {
+        if (dirs[k] == 0) {
+            if (room[k] < 0) return false;
+            continue;
+        }
+        double r = room[k] / dirs[k];
+        if (dirs[k] < 0) t0 = std::max(t0, r);
+        else t1 = std::min(t1, r);
+    }
+    return t0 <= t1;
+}
+
+// Appends clipped segments to a polyline, continuing the current piece
+// when a segment starts where the last one ended inside the window
+struct PolylineWriter {
+    const PlotWindow& window;
+    std::vector<Point2>& out;
+    bool connected = false;
+
+    void segment(const Point2& p, const Point2& q) {
+        double t0, t1;
+        if (!clipSegment(p, q, window, t0, t1)) {
+            lift();
+            return;
+        }
+        if (!connected || t0 > 0) {
+            lift();
+            out.push_back({p.x + t0 * (q.x - p.x), p.y + t0 * (q.y - p.y)});
+        }
+        out.push_back({p.x + t1 * (q.x - p.x), p.y + t1 * (q.y - p.y)});
+        connected = t1 == 1;
+    }
+
+    void lift() {
+        if (!out.empty() && !std::isnan(out.back().x)) out.push_back({NaN, NaN});
+        connected = false;
+    }
+};
+
+// Interval of the discontinuity search, narrowed towards the larger change
+struct Bracket {
+    size_t interval;
+    double a, fa, b, fb;
+    double startPx;   // on-screen change before bisecting
+    int rounds = 0;
+    bool settled = false, jump = false;
+};
+
+} // namespace
+
+Precision plotPrecision(const PlotWindow& window) {
+    if (!window.fastMath || window.width <= 0 || window.height <= 0) return Precision::DOUBLE;
+
+    // float32 keeps 24 bits; reserve 12 of them for rounding error that
+    // builds up through the expression, so coordinates must still resolve
+    // to 1/4096 of the window's scale
+    const double FLOAT_RESOLUTION = std::ldexp(1.0, -12);
+    double scale = std::max({std::fabs(window.xMin), std::fabs(window.xMax),
+                             std::fabs(window.yMin), std::fabs(window.yMax)});
+    double pixel = std::min((window.xMax - window.xMin) / window.width,
+                            (window.yMax - window.yMin) / window.height);
+    return scale * FLOAT_RESOLUTION <= pixel ? Precision::FLOAT : Precision::DOUBLE;
+}
+
+void sampleFunction(const CompiledExpr& f, double xMin, double xMax, int samples, std::vector<double>& ys,
+                    Precision precision) {
+    std::vector<double> xs(samples + 1);
+    double step = (xMax - xMin) / samples;
+    for (int i = 0; i <= samples; ++i) xs[i] = xMin + i * step;
+
+    ys.resize(samples + 1);
+    evaluateBatch(f, xs.data(), xs.size(), ys.data(), precision);
+    for (double& y : ys)
+        if (!std::isfinite(y)) y = NaN;
+}
+
+void buildExplicitPolyline(const CompiledExpr& f, const std::vector<double>& ys, const PlotWindow& window,
+                           std::vector<Point2>& out, PolylineStats* stats) {
+    out.clear();
+    PolylineStats local;
+    PolylineStats& st = stats ? *stats : local;
+    size_t n = ys.size();
+    for (double y : ys) {
+        if (std::isnan(y)) ++st.undefined;
+        else if (y < window.yMin || y > window.yMax) ++st.offscreen;
+    }
+    if (n < 2 || window.height <= 0) return;
+
+    double step = (window.xMax - window.xMin) / (n - 1);
+    double scaleY = window.height / (window.yMax - window.yMin);
+    // Far-off values are pulled in so differences cannot overflow; the
+    // window edge crossings move by far less than a pixel
+    double limit = 1e6 * (window.yMax - window.yMin);
+    auto point = [&](double x, double y) {
+        return Point2{x, std::max(window.yMin - limit, std::min(window.yMax + limit, y))};
+    };
+
+    // Steep intervals that reach into the window, steepest first
+    std::vector<Bracket> brackets;
+    for (size_t i = 0; i + 1 < n; ++i) {
+        double y0 = ys[i], y1 = ys[i + 1];
+        if (std::isnan(y0) || std::isnan(y1)) continue;
+        if ((y0 > window.yMax && y1 > window.yMax) || (y0 < window.yMin && y1 < window.yMin)) continue;
+        double px = std::fabs(y1 - y0) * scaleY;
+        if (px > JUMP_CHECK_PX)
+            brackets.push_back({i, window.xMin + i * step, y0, window.xMin + (i + 1) * step, y1, px});
+    }
+    if (brackets.size() > (size_t)MAX_JUMP_CHECKS) {
+        std::nth_element(brackets.begin(), brackets.begin() + MAX_JUMP_CHECKS, brackets.end(),
+                         [](const Bracket& p, const Bracket& q) { return p.startPx > q.startPx; });
+        brackets.resize(MAX_JUMP_CHECKS);
+        std::sort(brackets.begin(), brackets.end(),
+                  [](const Bracket& p, const Bracket& q) { return p.interval < q.interval; });
+    }
+
+    // A continuous curve's change halves with the interval; a jump's stays
+    // and a pole's grows. Brackets whose change drops below half a pixel
+    // are settled as continuous early.
+    std::vector<double> mids, values;
+    std::vector<Bracket*> active;
+    for (int round = 0; round < JUMP_BISECTIONS; ++round) {
+        active.clear();
+        mids.clear();
+        for (Bracket& b : brackets) {
+            if (b.settled) continue;
+            active.push_back(&b);
+            mids.push_back(0.5 * (b.a + b.b));
+        }
+        if (active.empty()) break;
+        values.resize(mids.size());
+        evaluateBatch(f, mids.data(), mids.size(), values.data());
+        st.evaluations += mids.size();
+
+        for (size_t k = 0; k < active.size(); ++k) {
+            Bracket& b = *active[k];
+            double m = mids[k], fm = values[k];
+            if (!std::isfinite(fm)) {   // undefined inside: a gap, drawn as a break
+                b.settled = b.jump = true;
+                continue;
+            }
+            if (std::fabs(fm - b.fa) >= std::fabs(b.fb - fm)) {
+                b.b = m;
+                b.fb = fm;
+            } else {
+                b.a = m;
+                b.fa = fm;
+            }
+            ++b.rounds;
+            if (std::fabs(b.fb - b.fa) * scaleY < 0.5) b.settled = true;
+        }
+    }
+    for (Bracket& b : brackets) {
+        if (b.settled) continue;
+        double px = std::fabs(b.fb - b.fa) * scaleY;
+        b.jump = px > 1 && px > 4 * std::ldexp(b.startPx, -b.rounds);
+    }
+
+    PolylineWriter pen{window, out};
+    size_t next = 0;
+    for (size_t i = 0; i + 1 < n; ++i) {
+        if (std::isnan(ys[i]) || std::isnan(ys[i + 1])) {
+            pen.lift();
+            continue;
+        }
+        Point2 p = point(window.xMin + i * step, ys[i]);
+        Point2 q = point(window.xMin + (i + 1) * step, ys[i + 1]);
+        while (next < brackets.size() && brackets[next].interval < i) ++next;
+        if (next < brackets.size() && brackets[next].interval == i && brackets[next].jump) {
+            const Bracket& b = brackets[next];
+            pen.segment(p, point(b.a, b.fa));
+            pen.lift();
+            pen.segment(point(b.b, b.fb), q);
+            ++st.breaks;
+        } else {
+            pen.segment(p, q);
+        }
+    }
+}
+
+void sampleParametric(const CompiledExpr& fx, const CompiledExpr& fy, double tMin, double tMax,
+                      const PlotWindow& window, std::vector<Point2>& out) {
+    Precision precision = plotPrecision(window);
+    adaptiveSample(tMin, tMax, window, [&](const double* ts, size_t n, double* xs, double* ys) {
+        evaluateBatch(fx, ts, n, xs, precision);
+        evaluateBatch(fy, ts, n, ys, precision);
+    }, out);
+}
+
+void samplePolar(const CompiledExpr& r, double thetaMin, double thetaMax,
+                 const PlotWindow& window, std::vector<Point2>& out) {
+    Precision precision = plotPrecision(window);
+    adaptiveSample(thetaMin, thetaMax, window, [&](const double* ts, size_t n, double* xs, double* ys) {
+        evaluateBatch(r, ts, n, xs, precision);
+        for (size_t i = 0; i < n; ++i) {
+            double radius = xs[i];
+            xs[i] = radius * std::cos(ts[i]);
+            ys[i] = radius * std::sin(ts[i]);
+        }
+    }, out);
+}
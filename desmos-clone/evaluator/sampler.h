@@ -0,0 +1,67 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "compiler.h"
+#include <vector>
+
+// World rectangle mapped onto a width x height pixel area. fastMath lets
+// the samplers evaluate in float32 where plotPrecision allows it.
+struct PlotWindow {
+    double xMin, xMax, yMin, yMax;
+    int width, height;
+    bool fastMath = false;
+};
+
+// Curve point in world coordinates. A NaN point separates polyline pieces.
+struct Point2 {
+    double x, y;
+};
+
+// Default parameter ranges for curves without explicit bounds
+const double PARAMETRIC_T_MIN = 0.0;
+const double PARAMETRIC_T_MAX = 6.283185307179586;       // 2*pi
+const double POLAR_THETA_MIN = 0.0;
+const double POLAR_THETA_MAX = 12 * 3.141592653589793;   // six turns, enough for most roses and spirals
+
+// Precision to plot window in: FLOAT if fastMath is set and float32
+// rounding of the window's coordinates stays far below a pixel, DOUBLE
+// once the view is zoomed (or panned) far enough for it to show
+Precision plotPrecision(const PlotWindow& window);
+
+// y = f(x) at samples + 1 evenly spaced xs over [xMin, xMax], NaN where undefined
+void sampleFunction(const CompiledExpr& f, double xMin, double xMax, int samples, std::vector<double>& ys,
+                    Precision precision = Precision::DOUBLE);
+
+// Bounds of the discontinuity search in buildExplicitPolyline: at most
+// MAX_JUMP_CHECKS intervals per curve (the steepest) are bisected at most
+// JUMP_BISECTIONS times each, so it adds at most 640 evaluations
+const int MAX_JUMP_CHECKS = 64;
+const int JUMP_BISECTIONS = 10;
+const double JUMP_CHECK_PX = 8.0;   // neighbouring samples closer than this on screen are joined
+
+struct PolylineStats {
+    size_t undefined = 0;     // samples where f is NaN
+    size_t offscreen = 0;     // finite samples above or below the window
+    size_t breaks = 0;        // jumps and poles the polyline was split at
+    size_t evaluations = 0;   // extra evaluations of the discontinuity search
+};
+
+// Polyline through ys = f(x) as sampled by sampleFunction over the window's
+// x range, clipped exactly to the window (a NaN point separates pieces).
+// Samples more than JUMP_CHECK_PX apart on screen are bisected towards the
+// larger change: if it stays large instead of halving with the interval,
+// the curve jumps or has a pole there, and each side is drawn up to the
+// final bracket instead of being joined across it. Bisections run
+// interval by interval in lockstep, one evaluateBatch per round.
+void buildExplicitPolyline(const CompiledExpr& f, const std::vector<double>& ys, const PlotWindow& window,
+                           std::vector<Point2>& out, PolylineStats* stats = nullptr);
+
+// (x(t), y(t)) for t in [tMin, tMax], sampled adaptively in screen space
+void sampleParametric(const CompiledExpr& fx, const CompiledExpr& fy, double tMin, double tMax,
+                      const PlotWindow& window, std::vector<Point2>& out);
+
+// r(theta) for theta in [thetaMin, thetaMax], sampled adaptively in screen space
+void samplePolar(const CompiledExpr& r, double thetaMin, double thetaMax,
+                 const PlotWindow& window, std::vector<Point2>& out);
+
+#endif
@@ -0,0 +1,203 @@
+#include "shared.h"
+#include "metrics.h"
+#include "sampler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <string>
+
+namespace {
+
+const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+// An instruction and the nodes of its operands, in stack order
+struct Node {
+    Instruction ins;
+    std::vector<uint32_t> operands;
+    uint32_t uses = 0;      // parents plus programs returning it
+    bool root = false;
+    int segment = -1;
+};
+
+size_t operandCount(const Instruction& ins) {
+    switch (ins.op) {
+        case OpCode::CONST:
+        case OpCode::VAR: return 0;
+        case OpCode::MAX:
+        case OpCode::MIN: return ins.arg;
+        default:
+            return ins.op == OpCode::NEG || (ins.op >= OpCode::SIN && ins.op <= OpCode::TRIGAMMA) ? 1 : 2;
+    }
+}
+
+// Integrals, sums and products carry subprograms that read the parent's
+// slots, which a segment renumbers
+bool shareable(const CompiledExpr& prog) {
+    return !prog.empty() && prog.variables.size() <= 1 && prog.subprograms.empty();
+}
+
+bool sameProgram(const CompiledExpr& a, const CompiledExpr& b) {
+    if (a.code.size() != b.code.size() || a.variables != b.variables || a.boundSlot != b.boundSlot ||
+        a.subprograms.size() != b.subprograms.size() || a.invariants.size() != b.invariants.size())
+        return false;
+    for (size_t i = 0; i < a.code.size(); ++i) {
+        const Instruction& p = a.code[i];
+        const Instruction& q = b.code[i];
+        if (p.op != q.op || p.arg != q.arg) return false;
+        if (p.op == OpCode::CONST && std::memcmp(&p.value, &q.value, sizeof(double)) != 0) return false;
+    }
+    for (size_t i = 0; i < a.subprograms.size(); ++i)
+        if (!sameProgram(a.subprograms[i], b.subprograms[i])) return false;
+    for (size_t i = 0; i < a.invariants.size(); ++i)
+        if (!sameProgram(a.invariants[i], b.invariants[i])) return false;
+    return true;
+}
+
+int stackDepth(const std::vector<Instruction>& code) {
+    int depth = 0, maxDepth = 0;
+    for (const Instruction& ins : code) {
+        depth += 1 - (int)operandCount(ins);
+        maxDepth = std::max(maxDepth, depth);
+    }
+    return maxDepth;
+}
+
+// Builds the DAG of a set of programs, one node per distinct subexpression
+class Dag {
+public:
+    std::vector<Node> nodes;   // operands before the nodes using them
+
+    // Node of prog's result
+    uint32_t add(const CompiledExpr& prog) {
+        std::vector<uint32_t> stack;
+        for (const Instruction& ins : prog.code) {
+            size_t k = operandCount(ins);
+            std::vector<uint32_t> operands(stack.end() - k, stack.end());
+            stack.resize(stack.size() - k);
+            stack.push_back(intern(ins, std::move(operands)));
+        }
+        return stack.back();
+    }
+
+private:
+    std::map<std::vector<uint64_t>, uint32_t> ids;
+
+    uint32_t intern(Instruction ins, std::vector<uint32_t> operands) {
+        if (ins.op != OpCode::CONST) ins.value = 0;
+        if (ins.op == OpCode::ADD || ins.op == OpCode::MUL)   // exactly commutative in IEEE arithmetic
+            std::sort(operands.begin(), operands.end());
+
+        std::vector<uint64_t> key{(uint64_t)ins.op, ins.arg, 0};
+        std::memcpy(&key[2], &ins.value, sizeof(double));
+        key.insert(key.end(), operands.begin(), operands.end());
+        auto it = ids.find(key);
+        if (it != ids.end()) return it->second;
+
+        uint32_t id = (uint32_t)nodes.size();
+        for (uint32_t o : operands) ++nodes[o].uses;
+        nodes.push_back({ins, std::move(operands)});
+        ids.emplace(std::move(key), id);
+        return id;
+    }
+};
+
+// Appends the code of node id, reading the nodes below it that have
+// segments of their own as variables (slot k for refs[k - 1])
+void emit(const std::vector<Node>& nodes, uint32_t id, bool top, std::vector<uint32_t>& refs,
+          std::vector<Instruction>& code) {
+    const Node& node = nodes[id];
+    if (!top && node.segment >= 0) {
+        auto it = std::find(refs.begin(), refs.end(), (uint32_t)node.segment);
+        if (it == refs.end()) it = refs.insert(refs.end(), (uint32_t)node.segment);
+        code.push_back({OpCode::VAR, (uint32_t)(it - refs.begin() + 1), 0});
+        return;
+    }
+    for (uint32_t o : node.operands) emit(nodes, o, false, refs, code);
+    code.push_back(node.ins);
+}
+
+} // namespace
+
+void SharedSampler::rebuild(const std::vector<const CompiledExpr*>& programs) {
+    cached.clear();
+    segments.clear();
+    roots.assign(programs.size(), -1);
+    built = SharingStats();
+    built.programs = programs.size();
+
+    Dag dag;
+    std::vector<uint32_t> rootNodes(programs.size());
+    for (size_t k = 0; k < programs.size(); ++k) {
+        const CompiledExpr& prog = *programs[k];
+        cached.push_back(prog);
+        built.instructions += prog.code.size();
+        if (!shareable(prog)) {
+            built.evaluated += prog.code.size();
+            continue;
+        }
+        rootNodes[k] = dag.add(prog);
+        Node& root = dag.nodes[rootNodes[k]];
+        ++root.uses;
+        root.root = true;
+    }
+
+    // Node ids are in postorder, so segments come after the ones they read
+    for (uint32_t id = 0; id < dag.nodes.size(); ++id) {
+        Node& node = dag.nodes[id];
+        bool shared = node.uses > 1 && !node.operands.empty();
+        if (!shared && !node.root) continue;
+        built.shared += shared;
+        node.segment = (int)segments.size();
+
+        Segment seg;
+        emit(dag.nodes, id, true, seg.refs, seg.program.code);
+        seg.program.variables.push_back("x");
+        for (uint32_t r : seg.refs) seg.program.variables.push_back("#" + std::to_string(r));
+        seg.program.stackSize = stackDepth(seg.program.code);
+        built.evaluated += seg.program.code.size();
+        segments.push_back(std::move(seg));
+    }
+    for (size_t k = 0; k < programs.size(); ++k)
+        if (shareable(*programs[k])) roots[k] = dag.nodes[rootNodes[k]].segment;
+}
+
+const std::vector<std::vector<double>>& SharedSampler::update(const std::vector<const CompiledExpr*>& programs,
+                                                              double xMin, double xMax, int samples,
+                                                              Precision precision, SharingStats* stats) {
+    bool changed = programs.size() != cached.size();
+    for (size_t k = 0; k < programs.size() && !changed; ++k)
+        changed = !sameProgram(*programs[k], cached[k]);
+    if (changed) rebuild(programs);
+    if (stats) *stats = built;
+
+    size_t n = samples + 1;
+    xs.resize(n);
+    double step = (xMax - xMin) / samples;
+    for (size_t i = 0; i < n; ++i) xs[i] = xMin + i * step;
+
+    values.resize(segments.size());
+    std::vector<VarBinding> bindings;
+    for (size_t s = 0; s < segments.size(); ++s) {
+        const Segment& seg = segments[s];
+        bindings.assign(1, VarBinding{xs.data(), 1});
+        for (uint32_t r : seg.refs) bindings.push_back({values[r].data(), 1});
+        values[s].resize(n);
+        evaluateBatch(seg.program, bindings.data(), n, values[s].data(), precision);
+    }
+
+    ys.resize(programs.size());
+    for (size_t k = 0; k < programs.size(); ++k) {
+        if (roots[k] < 0) {
+            sampleFunction(*programs[k], xMin, xMax, samples, ys[k], precision);
+            continue;
+        }
+        ys[k] = values[roots[k]];
+        for (double& y : ys[k])
+            if (!std::isfinite(y)) y = NaN;
+    }
+    if (built.instructions > built.evaluated)
+        countMetric(Metric::INSTRUCTIONS_SAVED, (built.instructions - built.evaluated) * n);
+    return ys;
+}
@@ -0,0 +1,57 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include "compiler.h"
+#include <cstdint>
+#include <vector>
+
+struct SharingStats {
+    size_t programs = 0;
+    size_t instructions = 0;   // per sample, evaluating every program on its own
+    size_t evaluated = 0;      // per sample, evaluating shared subexpressions once
+    size_t shared = 0;         // subexpressions used more than once, within or across programs
+};
+
+// Samples many curves y = f(x) over the same xs, evaluating each distinct
+// subexpression once per sample. The programs are hash-consed into one DAG:
+// a node is identified by its instruction and its operands' nodes, with the
+// operands of + and * in a fixed order, so sin(x), sin(x)+1 and 2*sin(x)
+// share one sin(x) node. Every node used more than once, and every
+// program's result, becomes a program of its own evaluated with
+// evaluateBatch; the programs using it read its values as a variable.
+// Each instruction still runs on the same operands in the same precision,
+// so the results are exactly those of sampleFunction, except in float where
+// a shared subexpression was not finite and evaluateBatch widened it to
+// double: the programs reading it then stay within float rounding. Programs with
+// integral, sum or prod, or with more than one variable, are evaluated on
+// their own.
+class SharedSampler {
+public:
+    // ys[k] = programs[k] at samples + 1 evenly spaced xs over [xMin, xMax],
+    // NaN where undefined, as sampleFunction computes it. The DAG is only
+    // rebuilt when the programs differ from the previous call's.
+    const std::vector<std::vector<double>>& update(const std::vector<const CompiledExpr*>& programs,
+                                                   double xMin, double xMax, int samples,
+                                                   Precision precision = Precision::DOUBLE,
+                                                   SharingStats* stats = nullptr);
+
+private:
+    // One DAG node's program: slot 0 is x, slot k > 0 reads the values of
+    // segment refs[k - 1], which comes earlier in evaluation order
+    struct Segment {
+        CompiledExpr program;
+        std::vector<uint32_t> refs;
+    };
+
+    void rebuild(const std::vector<const CompiledExpr*>& programs);
+
+    std::vector<CompiledExpr> cached;          // the programs the DAG was built from
+    std::vector<Segment> segments;             // in evaluation order
+    std::vector<int> roots;                    // each program's segment, -1 if evaluated on its own
+    SharingStats built;
+    std::vector<std::vector<double>> values;   // per segment
+    std::vector<std::vector<double>> ys;
+    std::vector<double> xs;
+};
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef SPECIAL_H
+#define SPECIAL_H
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+// Special functions for the gamma, digamma, trigamma, erf, normal, bessel
+// and beta built-ins.
+//
+// Only those that beat the standard library are our own. erf, erfc and
+// normcdf are std::erf and std::erfc, and beta of positive arguments is
+// std::beta. The Bessel functions are Chebyshev series evaluated with
+// Clenshaw's recurrence: fixed-length, branch-free loops over constant
+// tables. The coefficients were fitted to the long double libm functions
+// (j0l, y0l, ...) at 80 Chebyshev nodes per interval. Series are cut where
+// the terms fall below 4e-18 of the largest one. Gamma and lgamma use the
+// Lanczos approximation (g = 7, 9 terms).
+//
+// Accuracy against the long double references (bench: accuracy/special):
+//   erf                   relative error < 1e-15
+//   erfc                  relative error < 2e-15
+//   normpdf, normcdf      relative error < 4e-15 for |x| < 5, growing
+//                         like x^2 * 1e-16 further out
+//   besselj0, besselj1    absolute error < 2e-15
+//   gamma                 relative error < 2e-13 over [-170, 171]
+//   lgamma                absolute error < 5e-15 on [0.5, 3] (it has zeros
+//                         at 1 and 2), relative < 4e-15 above; absolute
+//                         error < 2e-13 for negative x
+//   beta, negative a, b   relative error about 1e-11 next to the poles
+//   digamma               absolute error < 4e-15 on [0.5, 50]
+//   trigamma              absolute error < 4e-15 on [0.5, 50]
+//
+// Poles (gamma, lgamma, digamma and trigamma at non-positive integers, beta when a
+// or b is one) return NaN, like the other domain errors in the compiled
+// paths.
+
+// --- Chebyshev tables ---
+// Each table holds c0/2, c1, ... for f(x) ~ c0/2 + sum c_k T_k(t), with t
+// the argument mapped linearly onto [-1, 1].
+
+// J0(x) as a function of w = x^2 on [0, 64]
+const double J0_SMALL[] = {
+    1.57727971474890120e-01, -8.72344235285222135e-03, 2.65178613203336810e-01,
+    -3.70094993872649779e-01, 1.58067102332097261e-01, -3.48937694114088851e-02,
+    4.81918006946760461e-03, -4.60626166206275006e-04, 3.24603288210051157e-05,
+    -1.76194690776219822e-06, 7.60816359241694214e-08, -2.67925353058720951e-09,
+    7.84869632407627672e-11, -1.94383470636990546e-12, 4.12530930639712357e-14,
+    -7.58946941750715531e-16, 1.22311557583520969e-17,
+};
+// J1(x)/x as a function of w = x^2 on [0, 64]
+const double J1_SMALL[] = {
+    8.10448463256581151e-02, -1.48975145067652109e-01, 1.60999262357209703e-01,
+    -8.26804917668179066e-02, 2.22136396549660354e-02, -3.64694060076927595e-03,
+    4.05033772835482238e-04, -3.25555486685725672e-05, 1.98587740499153560e-06,
+    -9.52198475675023045e-08, 3.68713375907886638e-09, -1.17802662306113132e-10,
+    3.16015461344107233e-12, -7.22175649088465516e-14, 1.42312715973626214e-15,
+    -2.45070348563192209e-17,
+};
+
+// Hankel amplitudes for x > 8, as functions of w = (8/x)^2 on [0, 1]:
+//   J0(x) = sqrt(2 / (pi x)) * (P0 cos(x - pi/4) - Q0 sin(x - pi/4))
+//   J1(x) = sqrt(2 / (pi x)) * (P1 cos(x - 3pi/4) - Q1 sin(x - 3pi/4))
+// Q tables hold Q / (8/x).
+const double P0_LARGE[] = {
+    9.99460349347518665e-01, -5.36522046813211761e-04, 3.07518478751953506e-06,
+    -5.17059453761895839e-08, 1.63064646351577169e-09, -7.86409138072504017e-11,
+    5.16826246106357259e-12, -4.30457857130295968e-13, 4.32659604757829053e-14,
+    -5.06891214115470778e-15, 6.74684104157857734e-16, -1.00226359329991244e-16,
+    1.63497687610814069e-17,
+};
+const double Q0_LARGE[] = {
+    -1.55558546053370091e-02, 6.83851994261163751e-05, -7.41449841105809436e-07,
+    1.79724572481957021e-08, -7.27191594037936277e-10, 4.22012192117917696e-11,
+    -3.20674745571584112e-12, 3.00614267073432155e-13, -3.33629951998685287e-14,
+    4.25512906990422506e-15, -6.10040158986009315e-16, 9.68004498715265005e-17,
+    -1.68798843311205107e-17, 3.13918880581916249e-18, -5.63022800039933435e-19,
+};
+const double P1_LARGE[] = {
+    1.00090304086001370e+00, 8.98989833085940861e-04, -3.98728430048889994e-06,
+    6.17763396063456352e-08, -1.87189074906383328e-09, 8.81689865743300570e-11,
+    -5.70486357128916974e-12, 4.69919570378514451e-13, -4.68422758806257000e-14,
+    5.45284981447527461e-15, -7.22196553861603752e-16, 1.06544547490150521e-16,
+    -1.72537223223911962e-17,
+};
+const double Q1_LARGE[] = {
+    4.67777870695353253e-02, -9.62772354915707859e-05, 9.13861525795478890e-07,
+    -2.09597813840422787e-08, 8.22919332744483117e-10, -4.68636368865463378e-11,
+    3.51521881086886106e-12, -3.26431586026177528e-13, 3.59677759479576104e-14,
+    -4.56126039309655631e-15, 6.50831825769766087e-16, -1.02681823140786735e-16,
+    1.76559782690422634e-17, -3.27725517622161344e-18, 6.55010578111750452e-19,
+};
+
+const double LANCZOS_G = 7.0;
+const double LANCZOS[9] = {
+    0.99999999999980993, 676.5203681218851, -1259.1392167224028,
+    771.32342877765313, -176.61502916214059, 12.507343278686905,
+    -0.13857109526572012, 9.9843695780195716e-6, 1.5056327351493116e-7,
+};
+
+// --- Helpers ---
+// Clenshaw's recurrence. c[k] - b2 does not depend on the previous step,
+// so each step only waits on one multiply and one add.
+template <size_t N>
+inline double chebyshev(const double (&c)[N], double t) {
+    double t2 = 2 * t, b1 = 0, b2 = 0;
+    for (size_t k = N - 1; k >= 1; --k) {
+        double b0 = t2 * b1 + (c[k] - b2);
+        b2 = b1;
+        b1 = b0;
+    }
+    return t * b1 + (c[0] - b2);
+}
+
+// Chebyshev series of a table fitted on [a, b]
+template <size_t N>
+inline double chebyshevOn(const double (&c)[N], double a, double b, double x) {
+    return chebyshev(c, (2 * x - a - b) / (b - a));
+}
+
+// sin(pi x) with the argument reduced exactly first
+inline double sinPi(double x) {
+    double r = x - 2 * std::round(x / 2);   // [-1, 1]
+    double n = std::round(r);
+    r -= n;                                 // [-0.5, 0.5]
+    double s = std::sin(M_PI * r);
+    return n != 0 ? -s : s;
+}
+
+inline bool isNonPositiveInteger(double x) {
+    return x <= 0 && std::floor(x) == x;
+}
+
+// Lanczos sum A(x) and t = x + g - 0.5, for x >= 0.5
+inline double lanczosSum(double x, double& t) {
+    x -= 1;
+    double a = LANCZOS[0];
+    for (int i = 1; i < 9; ++i) a += LANCZOS[i] / (x + i);
+    t = x + LANCZOS_G + 0.5;
+    return a;
+}
+
+// --- Functions ---
+inline double specialErf(double x) {
+    return std::erf(x);
+}
+
+inline double specialErfc(double x) {
+    return std::erfc(x);
+}
+
+inline double specialNormPdf(double x) {
+    const double INV_SQRT_2PI = 0.39894228040143267794;
+    return INV_SQRT_2PI * std::exp(-0.5 * x * x);
+}
+
+inline double specialNormCdf(double x) {
+    return 0.5 * specialErfc(-x * M_SQRT1_2);
+}
+
+inline double specialBesselJ0(double x) {
+    double ax = std::fabs(x);
+    if (ax <= 8) return chebyshevOn(J0_SMALL, 0, 64, x * x);
+    if (std::isinf(x)) return 0;
+    double u = 8 / ax, w = u * u;
+    double p = chebyshevOn(P0_LARGE, 0, 1, w), q = u * chebyshevOn(Q0_LARGE, 0, 1, w);
+    double s = std::sin(ax), c = std::cos(ax);
+    // cos(x - pi/4) = (c + s) / sqrt(2), sin(x - pi/4) = (s - c) / sqrt(2)
+    return std::sqrt(1 / (M_PI * ax)) * (p * (c + s) - q * (s - c));
+}
+
+inline double specialBesselJ1(double x) {
+    double ax = std::fabs(x);
+    if (ax <= 8) return x * chebyshevOn(J1_SMALL, 0, 64, x * x);
+    if (std::isinf(x)) return 0;
+    double u = 8 / ax, w = u * u;
+    double p = chebyshevOn(P1_LARGE, 0, 1, w), q = u * chebyshevOn(Q1_LARGE, 0, 1, w);
+    double s = std::sin(ax), c = std::cos(ax);
+    // cos(x - 3pi/4) = (s - c) / sqrt(2), sin(x - 3pi/4) = -(s + c) / sqrt(2)
+    double r = std::sqrt(1 / (M_PI * ax)) * (p * (s - c) + q * (s + c));
+    return x < 0 ? -r : r;
+}
+
+inline double specialGamma(double x) {
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    if (isNonPositiveInteger(x) || std::isnan(x)) return NaN;
+    if (x < 0.5) return M_PI / (sinPi(x) * specialGamma(1 - x));
+    if (x > 171.7) return std::numeric_limits<double>::infinity();
+    double t, a = lanczosSum(x, t);
+    double p = std::pow(t, 0.5 * (x - 0.5));   // split so t^(x - 1/2) cannot overflow early
+    return 2.5066282746310005024 * p * (p * std::exp(-t)) * a;
+}
+
+// log |gamma(x)|
+inline double specialLgamma(double x) {
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    if (isNonPositiveInteger(x) || std::isnan(x)) return NaN;
+    if (std::isinf(x)) return std::numeric_limits<double>::infinity();
+    if (x < 0.5) return std::log(M_PI / std::fabs(sinPi(x))) - specialLgamma(1 - x);
+    double t, a = lanczosSum(x, t);
+    return 0.91893853320467274178 + (x - 0.5) * std::log(t) - t + std::log(a);
+}
+
+// gamma'(x) / gamma(x): the recurrence psi(x) = psi(x + 1) - 1/x up to
+// x >= 10, then the asymptotic series through the x^-14 term
+inline double specialDigamma(double x) {
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    if (isNonPositiveInteger(x) || std::isnan(x)) return NaN;
+    if (x < 0.5) return specialDigamma(1 - x) - M_PI / std::tan(M_PI * (x - std::round(x)));
+    double shift = 0;
+    for (; x < 10; x += 1) shift += 1 / x;
+    double w = 1 / (x * x);
+    double series = w * (1.0 / 12 - w * (1.0 / 120 - w * (1.0 / 252 - w * (1.0 / 240 - w * (1.0 / 132 -
+                    w * (691.0 / 32760 - w / 12))))));
+    return std::log(x) - 0.5 / x - series - shift;
+}
+
+// psi'(x), the derivative of digamma: psi'(x) = psi'(x + 1) + 1/x^2 up to
+// x >= 10, then the asymptotic series through the x^-15 term
+inline double specialTrigamma(double x) {
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    if (isNonPositiveInteger(x) || std::isnan(x)) return NaN;
+    if (x < 0.5) {
+        double s = sinPi(x);
+        return M_PI * M_PI / (s * s) - specialTrigamma(1 - x);
+    }
+    double shift = 0;
+    for (; x < 10; x += 1) shift += 1 / (x * x);
+    double w = 1 / (x * x);
+    double series = w * (1.0 / 6 - w * (1.0 / 30 - w * (1.0 / 42 - w * (1.0 / 30 - w * (5.0 / 66 -
+                    w * (691.0 / 2730 - w * 7.0 / 6))))));
+    return (1 + 0.5 / x + series) / x + shift;
+}
+
+inline double specialBeta(double a, double b) {
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    if (isNonPositiveInteger(a) || isNonPositiveInteger(b) || std::isnan(a + b)) return NaN;
+    if (isNonPositiveInteger(a + b)) return 0;
+    if (a > 0 && b > 0) return std::beta(a, b);
+
+    // Through lgamma; gamma is negative on (-1, 0), (-3, -2), ...
+    auto negative = [](double v) { return v < 0 && std::fmod(std::floor(v), 2.0) != 0; };
+    double sign = (negative(a) != negative(b)) != negative(a + b) ? -1 : 1;
+    return sign * std::exp(specialLgamma(a) + specialLgamma(b) - specialLgamma(a + b));
+}
+
+#endif
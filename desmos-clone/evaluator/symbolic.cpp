@@ -0,0 +1,719 @@
+#include "symbolic.h"
+#include "evaluator.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+// --- Tree helpers ---
+ASTNode* copyTree(const ASTNode* node) {
+    ASTNode* copy = new ASTNode(node->type, node->value);
+    for (const ASTNode* c : node->children) copy->children.push_back(copyTree(c));
+    return copy;
+}
+
+ASTNode* makeNode(NodeType type, const std::string& value, std::vector<ASTNode*> children) {
+    ASTNode* node = new ASTNode(type, value);
+    node->children = std::move(children);
+    return node;
+}
+
+// Detaches child i from node and frees the rest of node
+ASTNode* takeChild(ASTNode* node, size_t i) {
+    ASTNode* child = node->children[i];
+    node->children[i] = nullptr;
+    freeAST(node);
+    return child;
+}
+
+bool isOp(const ASTNode* node, NodeType type, const char* op) {
+    return node->type == type && node->value == op;
+}
+
+// Numbers and negated numbers
+bool constantValue(const ASTNode* node, double& v) {
+    if (node->type == NodeType::NUMBER) {
+        v = std::stod(node->value);
+        return true;
+    }
+    if (node->type == NodeType::UNARY_OP && constantValue(node->children[0], v)) {
+        if (node->value == "-") v = -v;
+        return true;
+    }
+    return false;
+}
+
+bool isConstant(const ASTNode* node, double value) {
+    double v;
+    return constantValue(node, v) && v == value;
+}
+
+bool isInteger(double v) {
+    return std::isfinite(v) && std::floor(v) == v && std::fabs(v) < 1e15;
+}
+
+bool sameTree(const ASTNode* a, const ASTNode* b) {
+    double va, vb;
+    if (constantValue(a, va) && constantValue(b, vb)) return va == vb;
+    if (a->type != b->type || a->children.size() != b->children.size()) return false;
+    if (a->type == NodeType::VARIABLE || a->type == NodeType::FUNCTION) {
+        if (lower(a->value) != lower(b->value)) return false;
+    } else if (a->value != b->value) {
+        return false;
+    }
+    for (size_t i = 0; i < a->children.size(); ++i)
+        if (!sameTree(a->children[i], b->children[i])) return false;
+    return true;
+}
+
+bool isCall(const ASTNode* node, const char* name, size_t arity) {
+    return node->type == NodeType::FUNCTION && node->children.size() == arity && lower(node->value) == name;
+}
+
+bool isLoop(const ASTNode* node) {
+    return (isCall(node, "sum", 4) || isCall(node, "prod", 4)) && node->children[0]->type == NodeType::VARIABLE;
+}
+
+// Whether node reads var, which integral(f, a, b) binds (as x) inside f and
+// sum/prod(n, a, b, f) binds (as n) inside f
+bool dependsOn(const ASTNode* node, const std::string& var) {
+    if (node->type == NodeType::VARIABLE) return lower(node->value) == var;
+    size_t first = 0, last = node->children.size();
+    if (isCall(node, "integral", 3) && var == "x") first = 1;
+    if (isLoop(node)) {
+        first = 1;
+        if (lower(node->children[0]->value) == var) last = 3;
+    }
+    for (size_t i = first; i < last; ++i)
+        if (dependsOn(node->children[i], var)) return true;
+    return false;
+}
+
+// Copy of node with the free occurrences of var replaced by copies of value
+ASTNode* substitute(const ASTNode* node, const std::string& var, const ASTNode* value) {
+    if (node->type == NodeType::VARIABLE && lower(node->value) == var) return copyTree(value);
+    ASTNode* copy = new ASTNode(node->type, node->value);
+    bool bindsVar = (isCall(node, "integral", 3) && var == "x") ||
+                    (isLoop(node) && lower(node->children[0]->value) == var);
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        bool bound = bindsVar && i == (isLoop(node) ? 3u : 0u);
+        bool index = isLoop(node) && i == 0;
+        const ASTNode* c = node->children[i];
+        copy->children.push_back(bound || index ? copyTree(c) : substitute(c, var, value));
+    }
+    return copy;
+}
+
+// Shortest text stod reads back to v exactly
+std::string formatNumber(double v) {
+    char text[32];
+    for (int precision = 15; precision <= 17; ++precision) {
+        std::snprintf(text, sizeof(text), "%.*g", precision, v);
+        if (std::stod(text) == v) break;
+    }
+    return text;
+}
+
+// --- Rewrites ---
+// Node constructors that take ownership of their arguments. With simplify
+// set they apply the rewrites simplify() documents while building; without
+// it they build the node as asked.
+struct Builder {
+    bool simplify;
+
+    ASTNode* number(double v) {
+        if (v < 0) return neg(number(-v));
+        return new ASTNode(NodeType::NUMBER, formatNumber(v));
+    }
+
+    ASTNode* neg(ASTNode* a) {
+        double va;
+        if (simplify) {
+            if (a->type == NodeType::NUMBER && constantValue(a, va) && va == 0) return a;
+            if (isOp(a, NodeType::UNARY_OP, "-")) return takeChild(a, 0);
+            if (isOp(a, NodeType::BINARY_OP, "-")) {
+                std::swap(a->children[0], a->children[1]);
+                return a;
+            }
+        }
+        return makeNode(NodeType::UNARY_OP, "-", {a});
+    }
+
+    // Splits node into c * rest with c numeric; rest is null for constants
+    static double coefficient(ASTNode* node, ASTNode*& rest) {
+        double c;
+        if (constantValue(node, c)) {
+            rest = nullptr;
+            return c;
+        }
+        if (isOp(node, NodeType::UNARY_OP, "-")) return -coefficient(node->children[0], rest);
+        if (isOp(node, NodeType::BINARY_OP, "*") && constantValue(node->children[0], c)) {
+            rest = node->children[1];
+            return c;
+        }
+        rest = node;
+        return 1;
+    }
+
+    // a + sign * b, combining like terms
+    ASTNode* combine(ASTNode* a, ASTNode* b, double sign) {
+        ASTNode *ra, *rb;
+        double ca = coefficient(a, ra), cb = coefficient(b, rb);
+        if (!ra && !rb) {
+            freeAST(a);
+            freeAST(b);
+            return number(ca + sign * cb);
+        }
+        if (ra && rb && sameTree(ra, rb)) {
+            ASTNode* rest = copyTree(ra);
+            freeAST(a);
+            freeAST(b);
+            return mul(number(ca + sign * cb), rest);
+        }
+        return nullptr;
+    }
+
+    ASTNode* add(ASTNode* a, ASTNode* b) {
+        if (simplify) {
+            if (isConstant(a, 0)) { freeAST(a); return b; }
+            if (isConstant(b, 0)) { freeAST(b); return a; }
+            if (isOp(b, NodeType::UNARY_OP, "-")) return sub(a, takeChild(b, 0));
+            if (isOp(a, NodeType::UNARY_OP, "-")) return sub(b, takeChild(a, 0));
+            if (ASTNode* r = combine(a, b, 1)) return r;
+        }
+        return makeNode(NodeType::BINARY_OP, "+", {a, b});
+    }
+
+    ASTNode* sub(ASTNode* a, ASTNode* b) {
+        if (simplify) {
+            if (isConstant(b, 0)) { freeAST(b); return a; }
+            if (isConstant(a, 0)) { freeAST(a); return neg(b); }
+            if (isOp(b, NodeType::UNARY_OP, "-")) return add(a, takeChild(b, 0));
+            if (ASTNode* r = combine(a, b, -1)) return r;
+        }
+        return makeNode(NodeType::BINARY_OP, "-", {a, b});
+    }
+
+    // Splits c * rest into c and rest; other nodes have factor 1
+    static double factor(ASTNode* node, ASTNode*& rest) {
+        double c;
+        if (isOp(node, NodeType::BINARY_OP, "*") && constantValue(node->children[0], c)) {
+            rest = node->children[1];
+            return c;
+        }
+        rest = node;
+        return 1;
+    }
+
+    // Frees what factor() split off, keeping rest
+    static void releaseFactor(ASTNode* node, ASTNode* rest) {
+        if (rest == node) return;
+        node->children[1] = nullptr;
+        freeAST(node);
+    }
+
+    // Splits node into base^exponent with a numeric exponent (1 if none)
+    static const ASTNode* powerBase(const ASTNode* node, double& exponent) {
+        if (isOp(node, NodeType::BINARY_OP, "^") && constantValue(node->children[1], exponent))
+            return node->children[0];
+        exponent = 1;
+        return node;
+    }
+
+    ASTNode* mul(ASTNode* a, ASTNode* b) {
+        if (!simplify) return makeNode(NodeType::BINARY_OP, "*", {a, b});
+        double va, vb;
+        bool ca = constantValue(a, va), cb = constantValue(b, vb);
+        if (ca && cb) {
+            freeAST(a);
+            freeAST(b);
+            return number(va * vb);
+        }
+        if ((ca && va == 0) || (cb && vb == 0)) {
+            freeAST(a);
+            freeAST(b);
+            return number(0);
+        }
+        if (cb) std::swap(a, b), std::swap(ca, cb), std::swap(va, vb);
+        if (ca && va == 1) { freeAST(a); return b; }
+        if (ca && va < 0) {
+            freeAST(a);
+            return neg(mul(number(-va), b));   // -2*u reads better than (-2)*u
+        }
+        if (!ca && isOp(a, NodeType::UNARY_OP, "-")) return neg(mul(takeChild(a, 0), b));
+        if (isOp(b, NodeType::UNARY_OP, "-")) return neg(mul(a, takeChild(b, 0)));
+
+        // Numeric factors move to the front and merge
+        double c;
+        if (isOp(b, NodeType::BINARY_OP, "*") && constantValue(b->children[0], c)) {
+            ASTNode* rest = b->children[1];
+            b->children[1] = nullptr;
+            freeAST(b);
+            if (ca) {
+                freeAST(a);
+                return mul(number(va * c), rest);
+            }
+            return mul(number(c), mul(a, rest));
+        }
+        if (!ca && isOp(a, NodeType::BINARY_OP, "*") && constantValue(a->children[0], c)) {
+            ASTNode* rest = a->children[1];
+            a->children[1] = nullptr;
+            freeAST(a);
+            return mul(number(c), mul(rest, b));
+        }
+
+        // u * (p / q) -> (u * p) / q
+        if (isOp(b, NodeType::BINARY_OP, "/")) {
+            ASTNode *p = b->children[0], *q = b->children[1];
+            b->children.clear();
+            freeAST(b);
+            return div(mul(a, p), q);
+        }
+        if (isOp(a, NodeType::BINARY_OP, "/")) {
+            ASTNode *p = a->children[0], *q = a->children[1];
+            a->children.clear();
+            freeAST(a);
+            return div(mul(p, b), q);
+        }
+
+        // u^m * u^n -> u^(m + n)
+        double ea, eb;
+        const ASTNode* base = powerBase(a, ea);
+        if (!ca && sameTree(base, powerBase(b, eb))) {
+            ASTNode* r = pow(copyTree(base), number(ea + eb));
+            freeAST(a);
+            freeAST(b);
+            return r;
+        }
+        return makeNode(NodeType::BINARY_OP, "*", {a, b});
+    }
+
+    ASTNode* div(ASTNode* a, ASTNode* b) {
+        if (!simplify) return makeNode(NodeType::BINARY_OP, "/", {a, b});
+        double va, vb;
+        bool ca = constantValue(a, va), cb = constantValue(b, vb);
+        if (ca && cb && vb != 0 && (va / vb) * vb == va && isInteger(va / vb)) {
+            freeAST(a);
+            freeAST(b);
+            return number(va / vb);
+        }
+        if ((ca && va == 0) || (cb && vb == 1)) { freeAST(b); return a; }
+        if (cb && vb == -1) { freeAST(b); return neg(a); }
+        if (sameTree(a, b)) {
+            freeAST(a);
+            freeAST(b);
+            return number(1);
+        }
+        if (isOp(a, NodeType::UNARY_OP, "-")) return neg(div(takeChild(a, 0), b));
+        if (isOp(b, NodeType::UNARY_OP, "-")) return neg(div(a, takeChild(b, 0)));
+
+        // (p / q) / b -> p / (q * b) and a / (p / q) -> (a * q) / p
+        if (isOp(a, NodeType::BINARY_OP, "/")) {
+            ASTNode *p = a->children[0], *q = a->children[1];
+            a->children.clear();
+            freeAST(a);
+            return div(p, mul(q, b));
+        }
+        if (isOp(b, NodeType::BINARY_OP, "/")) {
+            ASTNode *p = b->children[0], *q = b->children[1];
+            b->children.clear();
+            freeAST(b);
+            return div(mul(a, q), p);
+        }
+
+        // Numeric factors cancel where one divides the other
+        ASTNode *ra, *rb;
+        if (cb && factor(a, ra) != 1 && isInteger(factor(a, ra) / vb)) {
+            double q = factor(a, ra) / vb;
+            releaseFactor(a, ra);
+            freeAST(b);
+            return mul(number(q), ra);
+        }
+        double fa = factor(a, ra), fb = factor(b, rb);
+        if (fa != 1 && fb != 1) {
+            double up = fa / fb, down = fb / fa;
+            if (isInteger(up) || isInteger(down)) {
+                releaseFactor(a, ra);
+                releaseFactor(b, rb);
+                ASTNode* q = isInteger(up) ? div(ra, rb) : div(ra, mul(number(down), rb));
+                return isInteger(up) ? mul(number(up), q) : q;
+            }
+        }
+
+        // u^m / u^n -> u^(m - n)
+        double ea, eb;
+        const ASTNode* base = powerBase(a, ea);
+        if (!ca && sameTree(base, powerBase(b, eb))) {
+            ASTNode* r = pow(copyTree(base), number(ea - eb));
+            freeAST(a);
+            freeAST(b);
+            return r;
+        }
+        return makeNode(NodeType::BINARY_OP, "/", {a, b});
+    }
+
+    ASTNode* pow(ASTNode* a, ASTNode* b) {
+        if (!simplify) return makeNode(NodeType::BINARY_OP, "^", {a, b});
+        double va, vb;
+        bool ca = constantValue(a, va), cb = constantValue(b, vb);
+        if ((cb && vb == 0) || (ca && va == 1)) {
+            freeAST(a);
+            freeAST(b);
+            return number(1);
+        }
+        if (cb && vb == 1) { freeAST(b); return a; }
+        if (ca && cb && isInteger(std::pow(va, vb)) && !(va == 0 && vb < 0)) {
+            freeAST(a);
+            freeAST(b);
+            return number(std::pow(va, vb));
+        }
+        if (ca && va == 0 && cb && vb > 0) {
+            freeAST(b);
+            return a;
+        }
+
+        // (u^m)^n -> u^(m n) for integers m and n
+        double inner;
+        if (cb && isInteger(vb) && isOp(a, NodeType::BINARY_OP, "^") && constantValue(a->children[1], inner) &&
+            isInteger(inner)) {
+            freeAST(b);
+            return pow(takeChild(a, 0), number(inner * vb));
+        }
+        return makeNode(NodeType::BINARY_OP, "^", {a, b});
+    }
+
+    // Calls on numbers fold when the result is an integer
+    ASTNode* call(const std::string& name, std::vector<ASTNode*> args) {
+        ASTNode* node = makeNode(NodeType::FUNCTION, name, std::move(args));
+        if (!simplify) return node;
+        if (isCall(node, "ln", 1) && isOp(node->children[0], NodeType::VARIABLE, "e")) {
+            freeAST(node);
+            return number(1);
+        }
+        double v;
+        for (const ASTNode* arg : node->children)
+            if (!constantValue(arg, v)) return node;
+        try {
+            v = evaluate(node, 0);
+        } catch (const std::exception&) {
+            countMetric(Metric::EXCEPTIONS_CAUGHT);
+            return node;
+        }
+        if (!isInteger(v)) return node;
+        freeAST(node);
+        return number(v);
+    }
+
+    // Rebuilds node bottom-up through the constructors above
+    ASTNode* rebuild(const ASTNode* node) {
+        if (node->type == NodeType::NUMBER || node->type == NodeType::VARIABLE) return copyTree(node);
+        std::vector<ASTNode*> c;
+        for (const ASTNode* child : node->children) c.push_back(rebuild(child));
+        if (node->type == NodeType::UNARY_OP) {
+            if (node->value == "-") return neg(c[0]);
+            if (node->value == "+" && simplify) return c[0];
+        }
+        if (node->type == NodeType::BINARY_OP && c.size() == 2) {
+            if (node->value == "+") return add(c[0], c[1]);
+            if (node->value == "-") return sub(c[0], c[1]);
+            if (node->value == "*") return mul(c[0], c[1]);
+            if (node->value == "/") return div(c[0], c[1]);
+            if (node->value == "^") return pow(c[0], c[1]);
+        }
+        if (node->type == NodeType::FUNCTION) return call(node->value, std::move(c));
+        return makeNode(node->type, node->value, std::move(c));
+    }
+};
+
+// --- Differentiation ---
+struct Arity {
+    const char* name;
+    size_t min, max;
+};
+
+const Arity ARITIES[] = {
+    {"sin", 1, 1},     {"cos", 1, 1},      {"tan", 1, 1},      {"cot", 1, 1},      {"sec", 1, 1},
+    {"csc", 1, 1},     {"sqrt", 1, 1},     {"abs", 1, 1},      {"sign", 1, 1},     {"floor", 1, 1},
+    {"ceil", 1, 1},    {"round", 1, 1},    {"ln", 1, 1},       {"log", 1, 2},      {"log10", 1, 1},
+    {"log2", 1, 1},    {"exp", 1, 1},      {"pow", 2, 2},      {"mod", 2, 2},      {"atan2", 2, 2},
+    {"max", 1, 1000},  {"min", 1, 1000},   {"gamma", 1, 1},    {"lgamma", 1, 1},   {"erf", 1, 1},
+    {"erfc", 1, 1},    {"normpdf", 1, 1},  {"normcdf", 1, 1},  {"besselj0", 1, 1}, {"besselj1", 1, 1},
+    {"beta", 2, 2},    {"integral", 3, 3}, {"sum", 4, 4},      {"prod", 4, 4},     {"digamma", 1, 1},
+};
+
+class Differentiator {
+public:
+    Differentiator(const std::string& v, bool simplify) : var(v), b{simplify} {}
+
+    // Throws for what derive() cannot handle before anything is allocated
+    void check(const ASTNode* node) const {
+        if (!dependsOn(node, var)) return;
+        if (node->type == NodeType::FUNCTION) {
+            std::string f = lower(node->value);
+            if (f == "trigamma") throw std::runtime_error("trigamma has no symbolic derivative");
+            const Arity* arity = std::find_if(std::begin(ARITIES), std::end(ARITIES),
+                                              [&](const Arity& entry) { return f == entry.name; });
+            if (arity == std::end(ARITIES)) throw std::runtime_error("Unknown function: " + node->value);
+            if (node->children.size() < arity->min || node->children.size() > arity->max)
+                throw std::runtime_error("Wrong number of arguments to " + f);
+            if ((f == "sum" || f == "prod") && !isLoop(node))
+                throw std::runtime_error(f + " requires 4 args: " + f + "(n, a, b, f)");
+        }
+        for (const ASTNode* c : node->children) check(c);
+    }
+
+    ASTNode* derive(const ASTNode* node) {
+        if (!dependsOn(node, var)) return b.number(0);
+        const auto& c = node->children;
+        switch (node->type) {
+            case NodeType::VARIABLE: return b.number(1);
+            case NodeType::UNARY_OP: return node->value == "-" ? b.neg(derive(c[0])) : derive(c[0]);
+            case NodeType::BINARY_OP:
+                if (node->value == "+") return b.add(derive(c[0]), derive(c[1]));
+                if (node->value == "-") return b.sub(derive(c[0]), derive(c[1]));
+                if (node->value == "*")
+                    return b.add(b.mul(derive(c[0]), copyTree(c[1])), b.mul(copyTree(c[0]), derive(c[1])));
+                if (node->value == "/") {
+                    // u'/w - u w'/w^2, which loses a whole term when u or w is constant
+                    ASTNode* first = b.div(derive(c[0]), copyTree(c[1]));
+                    ASTNode* second = b.div(b.mul(copyTree(c[0]), derive(c[1])), b.pow(copyTree(c[1]), b.number(2)));
+                    return b.sub(first, second);
+                }
+                return power(c[0], c[1], false);
+            case NodeType::FUNCTION: return function(node);
+            default: return b.number(0);
+        }
+    }
+
+private:
+    std::string var;
+    Builder b;
+
+    ASTNode* call(const char* name, const ASTNode* arg) { return b.call(name, {copyTree(arg)}); }
+
+    // Runs a freshly built tree through the rewrites too
+    ASTNode* tidy(ASTNode* tree) {
+        if (!b.simplify) return tree;
+        ASTNode* r = b.rebuild(tree);
+        freeAST(tree);
+        return r;
+    }
+
+    // outer(u) * u'
+    ASTNode* chain(ASTNode* outer, const ASTNode* u) { return b.mul(outer, derive(u)); }
+
+    ASTNode* raise(ASTNode* u, ASTNode* w, bool asCall) {
+        return asCall ? b.call("pow", {u, w}) : b.pow(u, w);
+    }
+
+    // u^w or pow(u, w); the powers built keep the form of the original,
+    // since ^ is undefined for negative bases where pow is not
+    ASTNode* power(const ASTNode* u, const ASTNode* w, bool asCall) {
+        bool uVaries = dependsOn(u, var), wVaries = dependsOn(w, var);
+        if (!wVaries) {
+            ASTNode* lowered = raise(copyTree(u), b.sub(copyTree(w), b.number(1)), asCall);
+            return b.mul(b.mul(copyTree(w), lowered), derive(u));
+        }
+        ASTNode* whole = raise(copyTree(u), copyTree(w), asCall);
+        if (!uVaries) return b.mul(b.mul(whole, call("ln", u)), derive(w));
+        ASTNode* inner = b.add(b.mul(derive(w), call("ln", u)), b.div(b.mul(copyTree(w), derive(u)), copyTree(u)));
+        return b.mul(whole, inner);
+    }
+
+    // d max(p, q) = (p' + q') / 2 + sign(p - q) (p' - q') / 2, and with the
+    // sign term subtracted for min: the slope of the larger (smaller) one,
+    // averaged where they tie
+    ASTNode* extremum(const ASTNode* node, bool isMax) {
+        const auto& c = node->children;
+        if (c.size() == 1) return derive(c[0]);
+        ASTNode* p = makeNode(NodeType::FUNCTION, node->value, {});
+        for (size_t i = 0; i + 1 < c.size(); ++i) p->children.push_back(copyTree(c[i]));
+        const ASTNode* q = c.back();
+
+        ASTNode *dp = extremum(p, isMax), *dq = derive(q);
+        ASTNode* mean = b.div(b.add(copyTree(dp), copyTree(dq)), b.number(2));
+        ASTNode* sign = b.call("sign", {b.sub(p->children.size() == 1 ? copyTree(p->children[0]) : copyTree(p),
+                                              copyTree(q))});
+        ASTNode* half = b.div(b.mul(sign, b.sub(dp, dq)), b.number(2));
+        freeAST(p);
+        return isMax ? b.add(mean, half) : b.sub(mean, half);
+    }
+
+    ASTNode* function(const ASTNode* node) {
+        std::string f = lower(node->value);
+        const auto& c = node->children;
+        const ASTNode* u = c[0];
+
+        if (f == "sin") return chain(call("cos", u), u);
+        if (f == "cos") return chain(b.neg(call("sin", u)), u);
+        if (f == "tan") return chain(b.pow(call("sec", u), b.number(2)), u);
+        if (f == "cot") return chain(b.neg(b.pow(call("csc", u), b.number(2))), u);
+        if (f == "sec") return chain(b.mul(call("sec", u), call("tan", u)), u);
+        if (f == "csc") return chain(b.neg(b.mul(call("csc", u), call("cot", u))), u);
+        if (f == "sqrt") return b.div(derive(u), b.mul(b.number(2), call("sqrt", u)));
+        if (f == "abs") return chain(call("sign", u), u);
+        if (f == "sign" || f == "floor" || f == "ceil" || f == "round") return b.number(0);
+        if (f == "ln" || (f == "log" && c.size() == 1)) return b.div(derive(u), copyTree(u));
+        if (f == "log10" || f == "log2") {
+            ASTNode* base = b.call("ln", {b.number(f == "log10" ? 10 : 2)});
+            return b.div(derive(u), b.mul(copyTree(u), base));
+        }
+        if (f == "exp") return chain(call("exp", u), u);
+        if (f == "pow") return power(c[0], c[1], true);
+        if (f == "log") {
+            // log(a, b) = ln(a) / ln(b)
+            ASTNode* quotient = makeNode(NodeType::BINARY_OP, "/", {
+                makeNode(NodeType::FUNCTION, "ln", {copyTree(c[0])}),
+                makeNode(NodeType::FUNCTION, "ln", {copyTree(c[1])})});
+            ASTNode* r = derive(quotient);
+            freeAST(quotient);
+            return r;
+        }
+        if (f == "mod") {
+            // mod(a, b) = a - trunc(a / b) b, with trunc(a / b) = (a - mod(a, b)) / b
+            ASTNode* quotient = b.div(b.sub(copyTree(c[0]), copyTree(node)), copyTree(c[1]));
+            return b.sub(derive(c[0]), b.mul(quotient, derive(c[1])));
+        }
+        if (f == "atan2") {
+            // atan2(y, x)' = (x y' - y x') / (x^2 + y^2)
+            ASTNode* num = b.sub(b.mul(copyTree(c[1]), derive(c[0])), b.mul(copyTree(c[0]), derive(c[1])));
+            ASTNode* den = b.add(b.pow(copyTree(c[1]), b.number(2)), b.pow(copyTree(c[0]), b.number(2)));
+            return b.div(num, den);
+        }
+        if (f == "max" || f == "min") return extremum(node, f == "max");
+        if (f == "erf" || f == "erfc") {
+            // +-2/sqrt(pi) exp(-u^2)
+            ASTNode* scale = b.div(b.number(2), b.call("sqrt", {new ASTNode(NodeType::VARIABLE, "pi")}));
+            ASTNode* outer = b.mul(scale, b.call("exp", {b.neg(b.pow(copyTree(u), b.number(2)))}));
+            return chain(f == "erf" ? outer : b.neg(outer), u);
+        }
+        if (f == "normpdf") return chain(b.neg(b.mul(copyTree(u), call("normpdf", u))), u);
+        if (f == "normcdf") return chain(call("normpdf", u), u);
+        if (f == "besselj0") return chain(b.neg(call("besselj1", u)), u);
+        if (f == "besselj1") return chain(b.sub(call("besselj0", u), b.div(call("besselj1", u), copyTree(u))), u);
+        if (f == "gamma") return chain(b.mul(call("gamma", u), call("digamma", u)), u);
+        if (f == "lgamma") return chain(call("digamma", u), u);
+        if (f == "digamma") return chain(call("trigamma", u), u);
+        if (f == "beta") {
+            // beta(p, q) ((psi(p) - psi(p + q)) p' + (psi(q) - psi(p + q)) q')
+            auto psiSum = [&] { return b.call("digamma", {b.add(copyTree(c[0]), copyTree(c[1]))}); };
+            ASTNode* dp = b.mul(b.sub(call("digamma", c[0]), psiSum()), derive(c[0]));
+            ASTNode* dq = b.mul(b.sub(call("digamma", c[1]), psiSum()), derive(c[1]));
+            return b.mul(copyTree(node), b.add(dp, dq));
+        }
+        if (f == "integral") {
+            // Leibniz: f(b) b' - f(a) a', plus the integral of df/dvar
+            // unless var is x, which f binds
+            ASTNode* upper = b.mul(tidy(substitute(c[0], "x", c[2])), derive(c[2]));
+            ASTNode* lowerTerm = b.mul(tidy(substitute(c[0], "x", c[1])), derive(c[1]));
+            ASTNode* r = b.sub(upper, lowerTerm);
+            if (var == "x") return r;
+            return b.add(r, b.call("integral", {derive(c[0]), copyTree(c[1]), copyTree(c[2])}));
+        }
+        if (f == "sum" || f == "prod") {
+            // The bounds are rounded, so only the body contributes:
+            // (prod f)' = prod f * sum f'/f
+            ASTNode* body = derive(c[3]);
+            if (f == "prod") body = b.div(body, copyTree(c[3]));
+            ASTNode* s = b.call("sum", {copyTree(c[0]), copyTree(c[1]), copyTree(c[2]), body});
+            return f == "sum" ? s : b.mul(copyTree(node), s);
+        }
+        throw std::runtime_error("Unknown function: " + node->value);
+    }
+};
+
+// --- Formatting ---
+// Binding strength for parenthesization. Unary minus always gets
+// parentheses inside an operator, since the parser gives it the lowest
+// precedence of all; -2*x reads back as -(2*x) either way.
+int precedence(const ASTNode* node) {
+    switch (node->type) {
+        case NodeType::NUMBER:
+            if (node->value[0] == '-') return 0;
+            return node->value.find_first_of("eE") == std::string::npos ? 4 : 2;   // 1.5*10^(-7)
+        case NodeType::UNARY_OP: return 0;
+        case NodeType::BINARY_OP:
+            if (node->value == "+" || node->value == "-") return 1;
+            if (node->value == "*" || node->value == "/") return 2;
+            return 3;
+        default: return 4;
+    }
+}
+
+void format(const ASTNode* node, std::string& out);
+
+void formatChild(const ASTNode* node, bool parenthesize, std::string& out) {
+    if (parenthesize) out += '(';
+    format(node, out);
+    if (parenthesize) out += ')';
+}
+
+void format(const ASTNode* node, std::string& out) {
+    switch (node->type) {
+        case NodeType::NUMBER: {
+            size_t e = node->value.find_first_of("eE");
+            if (e == std::string::npos) {
+                out += node->value;
+            } else {
+                out += node->value.substr(0, e) + "*10^";
+                std::string exponent = std::to_string(std::stoi(node->value.substr(e + 1)));
+                out += exponent[0] == '-' ? "(" + exponent + ")" : exponent;
+            }
+            return;
+        }
+        case NodeType::VARIABLE: out += node->value; return;
+        case NodeType::UNARY_OP:
+            out += node->value;
+            formatChild(node->children[0], precedence(node->children[0]) < 2, out);
+            return;
+        case NodeType::BINARY_OP: {
+            int p = precedence(node);
+            int left = precedence(node->children[0]), right = precedence(node->children[1]);
+            bool power = node->value == "^";
+            formatChild(node->children[0], power ? left <= p : left < p, out);
+            out += p == 1 ? " " + node->value + " " : node->value;
+            formatChild(node->children[1], power ? right < p : right <= p, out);
+            return;
+        }
+        case NodeType::FUNCTION:
+            out += node->value + "(";
+            for (size_t i = 0; i < node->children.size(); ++i) {
+                if (i) out += ", ";
+                format(node->children[i], out);
+            }
+            out += ")";
+            return;
+    }
+}
+
+} // namespace
+
+ASTNode* differentiate(const ASTNode* node, const std::string& variable, bool simplifyResult) {
+    Differentiator d(lower(variable), simplifyResult);
+    d.check(node);
+    if (!simplifyResult) return d.derive(node);
+    ASTNode* simplified = simplify(node);
+    ASTNode* result = d.derive(simplified);
+    freeAST(simplified);
+    return result;
+}
+
+ASTNode* simplify(const ASTNode* node) {
+    Builder b{true};
+    return b.rebuild(node);
+}
+
+std::string formatExpression(const ASTNode* node) {
+    std::string out;
+    format(node, out);
+    return out;
+}
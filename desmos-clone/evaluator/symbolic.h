@@ -0,0 +1,31 @@
+#ifndef SYMBOLIC_H
+#define SYMBOLIC_H
+
+#include "../parser/parser.h"
+#include <string>
+
+// Derivative of node with respect to variable (case-insensitive) as a new
+// tree the caller frees. Every built-in has a rule except trigamma, so
+// gamma and lgamma differentiate twice but not three times; the
+// kinks of abs, max, min and mod get one-sided or averaged slopes like
+// evaluateBatchGradient, and floor, ceil, round and sign have derivative 0.
+// integral(f, a, b) follows the Leibniz rule, sum and prod differentiate
+// their body. With simplifyResult the tree is built through simplify's
+// rewrites as it grows, which keeps nested chain rules from swelling;
+// without it the textbook rules are applied literally. Throws
+// std::runtime_error for trigamma, unknown functions and wrong arities.
+ASTNode* differentiate(const ASTNode* node, const std::string& variable, bool simplifyResult = true);
+
+// Copy of node with constants folded (where the result is an integer, so
+// ln(2) stays readable), identities like u + 0, 1 * u and u^1 removed,
+// numeric factors gathered at the front of products and like terms
+// combined: 2*u + 3*u -> 5*u, u * u^2 -> u^3. The result can be undefined
+// at fewer points than node (0 * u and u / u simplify even where u is not
+// defined). The caller frees it.
+ASTNode* simplify(const ASTNode* node);
+
+// node as text the parser reads back to an equal expression, with few
+// parentheses: 2*x + 1, -x/sqrt(9 - x^2)
+std::string formatExpression(const ASTNode* node);
+
+#endif
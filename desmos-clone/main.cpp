@@ -2,9 +2,36 @@
 #include "evaluator/evaluator.h"
 #include "ui/ui.h"
 
+#include <cstdio>
+#include <string>
 
-int main() {
-    runUI();  
+// desmos [--record FILE | --replay FILE [--headless]] [--metrics FILE]
+//   --record FILE   log every frame's input to FILE
+//   --replay FILE   play a recording back and print frame time percentiles
+//   --headless      replay in a hidden window
+//   --metrics FILE  append runtime counters to FILE every few seconds
+int main(int argc, char** argv) {
+    UIOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--record" && i + 1 < argc) {
+            options.recordPath = argv[++i];
+        } else if (a == "--replay" && i + 1 < argc) {
+            options.replayPath = argv[++i];
+        } else if (a == "--headless") {
+            options.headless = true;
+        } else if (a == "--metrics" && i + 1 < argc) {
+            options.metricsPath = argv[++i];
+        } else {
+            std::fprintf(stderr, "usage: desmos [--record FILE | --replay FILE [--headless]] [--metrics FILE]\n");
+            return 2;
+        }
+    }
+    if (!options.recordPath.empty() && !options.replayPath.empty()) {
+        std::fprintf(stderr, "desmos: --record and --replay are exclusive\n");
+        return 2;
+    }
+    runUI(options);
     return 0;
 }
 
@@ -1,13 +1,36 @@
 #include "parser.h"
 #include <vector>
 #include <cctype>   // for isdigit, isalpha, isspace
-#include <iostream> // for std::cerr
+#include <iostream> // for printAST
 #include <algorithm>
-#include <stack> // for AST building
-#include <regex> 
+
+// --- Diagnostics ---
+void ParseDiagnostics::report(ParseError code, SourceSpan span) {
+    if (count < CAPACITY) items[count] = {code, {span.begin + offset, span.end + offset}};
+    ++count;
+}
+
+const char* parseErrorMessage(ParseError code) {
+    switch (code) {
+        case ParseError::UNKNOWN_CHARACTER: return "Unknown character";
+        case ParseError::EXTRA_DECIMAL_POINT: return "Second decimal point in a number";
+        case ParseError::MISPLACED_COMMA: return "Comma outside a function call";
+        case ParseError::UNMATCHED_CLOSE: return "')' without a matching '('";
+        case ParseError::UNMATCHED_OPEN: return "'(' is never closed";
+        case ParseError::MISSING_OPERAND: return "Operator is missing an operand";
+        case ParseError::MISSING_ARGUMENT: return "Function call is missing an argument";
+        case ParseError::MISSING_OPERATOR: return "Missing operator between values";
+        case ParseError::EMPTY: return "Nothing to evaluate";
+    }
+    return "Parse error";
+}
+
+static void report(ParseDiagnostics* diagnostics, ParseError code, SourceSpan span) {
+    if (diagnostics) diagnostics->report(code, span);
+}
 
 // Tokenizer
-std::vector<Token> tokenize(const std::string& input) {
+std::vector<Token> tokenize(const std::string& input, ParseDiagnostics* diagnostics) {
     std::vector<Token> tokens;
     size_t i = 0;
 
@@ -30,7 +53,7 @@ std::vector<Token> tokenize(const std::string& input) {
         if (!tokens.empty() && shouldInsertMul(tokens.back(), ch)) {
             // If prev token is IDENTIFIER and next char is '(' -> don't insert '*'
             if (!(tokens.back().type == TokenType::IDENTIFIER && ch == '(')) {
-                tokens.emplace_back(TokenType::STAR, "*");
+                tokens.emplace_back(TokenType::STAR, "*", SourceSpan{(uint32_t)i, (uint32_t)i});
             }
         }
 
@@ -38,11 +61,12 @@ std::vector<Token> tokenize(const std::string& input) {
         if (std::isdigit(ch) || (ch == '.' && i + 1 < input.size() && std::isdigit(input[i + 1]))) {
             std::string numStr;
             bool hasDecimal = false;
+            size_t start = i;
 
             while (i < input.size() && (std::isdigit(input[i]) || input[i] == '.')) {
                 if (input[i] == '.') {
                     if (hasDecimal) {
-                        std::cerr << "Error: Multiple decimal points in number at position " << i << "\n";
+                        report(diagnostics, ParseError::EXTRA_DECIMAL_POINT, {(uint32_t)i, (uint32_t)i + 1});
                         break;
                     }
                     hasDecimal = true;
@@ -51,40 +75,42 @@ std::vector<Token> tokenize(const std::string& input) {
                 ++i;
             }
 
-            tokens.emplace_back(TokenType::NUMBER, numStr);
+            tokens.emplace_back(TokenType::NUMBER, numStr, SourceSpan{(uint32_t)start, (uint32_t)i});
             continue;
         }
 
         if (std::isalpha(ch)) {
             std::string idStr;
+            size_t start = i;
             while (i < input.size() && (std::isalnum(input[i]) || input[i] == '_')) {
                 idStr += input[i];
                 ++i;
             }
-            tokens.emplace_back(TokenType::IDENTIFIER, idStr);
+            tokens.emplace_back(TokenType::IDENTIFIER, idStr, SourceSpan{(uint32_t)start, (uint32_t)i});
             continue;
         }
 
+        SourceSpan one{(uint32_t)i, (uint32_t)i + 1};
         switch (ch) {
-            case '+': tokens.emplace_back(TokenType::PLUS, "+"); break;
-            case '-': tokens.emplace_back(TokenType::MINUS, "-"); break;
-            case '*': tokens.emplace_back(TokenType::STAR, "*"); break;
-            case '/': tokens.emplace_back(TokenType::SLASH, "/"); break;
-            case '^': tokens.emplace_back(TokenType::CARET, "^"); break;
-            case '=': tokens.emplace_back(TokenType::EQUAL, "="); break;
-            case '(': tokens.emplace_back(TokenType::LPAREN, "("); break;
-            case ')': tokens.emplace_back(TokenType::RPAREN, ")"); break;
-            case ',': tokens.emplace_back(TokenType::COMMA, ","); break;
+            case '+': tokens.emplace_back(TokenType::PLUS, "+", one); break;
+            case '-': tokens.emplace_back(TokenType::MINUS, "-", one); break;
+            case '*': tokens.emplace_back(TokenType::STAR, "*", one); break;
+            case '/': tokens.emplace_back(TokenType::SLASH, "/", one); break;
+            case '^': tokens.emplace_back(TokenType::CARET, "^", one); break;
+            case '=': tokens.emplace_back(TokenType::EQUAL, "=", one); break;
+            case '(': tokens.emplace_back(TokenType::LPAREN, "(", one); break;
+            case ')': tokens.emplace_back(TokenType::RPAREN, ")", one); break;
+            case ',': tokens.emplace_back(TokenType::COMMA, ",", one); break;
             default:
-                std::cerr << "Error: Unknown character '" << ch << "' at position " << i << "\n";
-                tokens.emplace_back(TokenType::INVALID, std::string(1, ch));
+                report(diagnostics, ParseError::UNKNOWN_CHARACTER, one);
+                tokens.emplace_back(TokenType::INVALID, std::string(1, ch), one);
                 break;
         }
 
         ++i;
     }
 
-    tokens.emplace_back(TokenType::END_OF_INPUT, "");
+    tokens.emplace_back(TokenType::END_OF_INPUT, "", SourceSpan{(uint32_t)input.size(), (uint32_t)input.size()});
     return tokens;
 }
 
@@ -111,10 +137,15 @@ bool isRightAssociative(TokenType type) {
 }
 
 // toPostfix
-std::vector<Token> toPostfix(const std::vector<Token>& tokens) {
+std::vector<Token> toPostfix(const std::vector<Token>& tokens, ParseDiagnostics* diagnostics) {
     std::vector<Token> output;
     std::vector<Token> opStack;
     std::vector<int> argCountStack;
+    // Per open parenthesis: output size where the current argument began, and
+    // whether an earlier argument was empty. An argument that adds nothing to
+    // the output is empty, whatever the operands around the call.
+    std::vector<size_t> argStart;
+    std::vector<bool> emptyArg;
 
     for (size_t i = 0; i < tokens.size(); ++i) {
         const Token& token = tokens[i];
@@ -136,12 +167,14 @@ std::vector<Token> toPostfix(const std::vector<Token>& tokens) {
                 opStack.pop_back();
             }
             if (opStack.empty()) {
-                std::cerr << "Error: Misplaced comma or missing '(' before comma.\n";
+                report(diagnostics, ParseError::MISPLACED_COMMA, token.span);
                 return {};
             }
             if (!argCountStack.empty()) {
                 argCountStack.back() += 1;  // Increment arg count on each comma
             }
+            if (output.size() == argStart.back()) emptyArg.back() = true;
+            argStart.back() = output.size();
         }
 
         else if (token.type == TokenType::PLUS || token.type == TokenType::MINUS) {
@@ -153,9 +186,9 @@ std::vector<Token> toPostfix(const std::vector<Token>& tokens) {
 
             if (isUnary) {
                 if (token.type == TokenType::MINUS)
-                    opStack.push_back(Token(TokenType::UMINUS, "u-"));
+                    opStack.push_back(Token(TokenType::UMINUS, "u-", token.span));
                 else
-                    opStack.push_back(Token(TokenType::UPLUS, "u+"));
+                    opStack.push_back(Token(TokenType::UPLUS, "u+", token.span));
                 continue;
             }
 
@@ -189,6 +222,8 @@ std::vector<Token> toPostfix(const std::vector<Token>& tokens) {
 
         else if (token.type == TokenType::LPAREN) {
             opStack.push_back(token);
+            argStart.push_back(output.size());
+            emptyArg.push_back(false);
         }
 
         else if (token.type == TokenType::RPAREN) {
@@ -199,15 +234,23 @@ std::vector<Token> toPostfix(const std::vector<Token>& tokens) {
             }
 
             if (opStack.empty()) {
-                std::cerr << "Error: Mismatched parentheses.\n";
+                report(diagnostics, ParseError::UNMATCHED_CLOSE, token.span);
                 return {};
             }
 
             opStack.pop_back(); // Pop LPAREN
+            bool anyEmpty = emptyArg.back() || output.size() == argStart.back();
+            argStart.pop_back();
+            emptyArg.pop_back();
 
             // If function on top, pop and append with arg count
             if (!opStack.empty() && opStack.back().type == TokenType::IDENTIFIER) {
                 std::string funcName = opStack.back().value;
+                SourceSpan call{opStack.back().span.begin, token.span.end};
+                if (anyEmpty) {
+                    report(diagnostics, ParseError::MISSING_ARGUMENT, call);
+                    return {};
+                }
 
                 int argCount = 0;
                 if (!argCountStack.empty()) {
@@ -221,7 +264,7 @@ std::vector<Token> toPostfix(const std::vector<Token>& tokens) {
                 }
 
                 opStack.pop_back();
-                output.push_back(Token(TokenType::IDENTIFIER, funcName + "@" + std::to_string(argCount)));
+                output.push_back(Token(TokenType::IDENTIFIER, funcName + "@" + std::to_string(argCount), call));
             }
         }
 
@@ -232,7 +275,7 @@ std::vector<Token> toPostfix(const std::vector<Token>& tokens) {
 
     while (!opStack.empty()) {
         if (opStack.back().type == TokenType::LPAREN || opStack.back().type == TokenType::RPAREN) {
-            std::cerr << "Error: Mismatched parentheses at end.\n";
+            report(diagnostics, ParseError::UNMATCHED_OPEN, opStack.back().span);
             return {};
         }
         output.push_back(opStack.back());
@@ -244,88 +287,94 @@ std::vector<Token> toPostfix(const std::vector<Token>& tokens) {
 
 
 
-ASTNode* buildAST(const std::vector<Token>& postfix) {
-    std::stack<ASTNode*> nodeStack;
+// Splits a postfix function token "name@N" into its name and argument
+// count. False for anything else, which is a variable.
+static bool splitCall(const std::string& value, std::string& name, int& argCount) {
+    size_t at = value.rfind('@');
+    if (at == std::string::npos || at == 0 || at + 1 == value.size()) return false;
+    argCount = 0;
+    for (size_t i = at + 1; i < value.size(); ++i) {
+        if (!std::isdigit((unsigned char)value[i])) return false;
+        argCount = argCount * 10 + (value[i] - '0');
+    }
+    name.assign(value, 0, at);
+    return true;
+}
+
+ASTNode* buildAST(const std::vector<Token>& postfix, ParseDiagnostics* diagnostics) {
+    // Subtrees and the source they span, bottom of the stack first
+    std::vector<ASTNode*> nodeStack;
+    std::vector<SourceSpan> spans;
 
+    auto fail = [&](ParseError code, SourceSpan span) -> ASTNode* {
+        report(diagnostics, code, span);
+        for (ASTNode* node : nodeStack) freeAST(node);
+        return nullptr;
+    };
+    auto push = [&](ASTNode* node, SourceSpan span) {
+        nodeStack.push_back(node);
+        spans.push_back(span);
+    };
+
+    std::string funcName;
+    int argCount = 0;
     for (const Token& token : postfix) {
         if (token.type == TokenType::NUMBER) {
-            nodeStack.push(new ASTNode(NodeType::NUMBER, token.value));
+            push(new ASTNode(NodeType::NUMBER, token.value), token.span);
         }
 
         else if (token.type == TokenType::IDENTIFIER) {
-            // Handle function calls like func@N
-            std::regex funcRegex(R"((\w+)@(\d+))");
-            std::smatch match;
-
-            if (std::regex_match(token.value, match, funcRegex)) {
-                std::string funcName = match[1];
-                int argCount = std::stoi(match[2]);
-
-                if (nodeStack.size() < static_cast<size_t>(argCount)) {
-                    std::cerr << "Error: Not enough arguments for function '" << funcName << "'\n";
-                    return nullptr;
-                }
+            // Function calls arrive as func@N; no built-in takes zero arguments
+            if (splitCall(token.value, funcName, argCount)) {
+                if (argCount == 0 || nodeStack.size() < static_cast<size_t>(argCount))
+                    return fail(ParseError::MISSING_ARGUMENT, token.span);
 
                 ASTNode* funcNode = new ASTNode(NodeType::FUNCTION, funcName);
-                std::vector<ASTNode*> args;
-
-                for (int i = 0; i < argCount; ++i) {
-                    args.push_back(nodeStack.top());
-                    nodeStack.pop();
-                }
-
-                std::reverse(args.begin(), args.end()); // Preserve argument order
-                funcNode->children = args;
-                nodeStack.push(funcNode);
+                funcNode->children.assign(nodeStack.end() - argCount, nodeStack.end());   // in argument order
+                nodeStack.resize(nodeStack.size() - argCount);
+                spans.resize(spans.size() - argCount);
+                push(funcNode, token.span);
             }
             else {
                 // Regular variable
-                nodeStack.push(new ASTNode(NodeType::VARIABLE, token.value));
+                push(new ASTNode(NodeType::VARIABLE, token.value), token.span);
             }
         }
 
         else if (token.type == TokenType::UMINUS || token.type == TokenType::UPLUS) {
-            if (nodeStack.empty()) {
-                std::cerr << "Error: Unary operator missing operand.\n";
-                return nullptr;
-            }
-
-            ASTNode* child = nodeStack.top();
-            nodeStack.pop();
+            if (nodeStack.empty())
+                return fail(ParseError::MISSING_OPERAND, token.span);
 
             // Use "-" for UMINUS and "+" for UPLUS as node value
             std::string opSymbol = (token.type == TokenType::UMINUS) ? "-" : "+";
 
             ASTNode* unaryNode = new ASTNode(NodeType::UNARY_OP, opSymbol);
-            unaryNode->children.push_back(child);
-            nodeStack.push(unaryNode);
+            unaryNode->children.push_back(nodeStack.back());
+            nodeStack.back() = unaryNode;
+            spans.back().begin = std::min(spans.back().begin, token.span.begin);
         }
 
         else if (isOperator(token.type)) {
-            if (nodeStack.size() < 2) {
-                std::cerr << "Error: Not enough operands for operator '" << token.value << "'\n";
-                return nullptr;
-            }
-
-            ASTNode* right = nodeStack.top();
-            nodeStack.pop();
-            ASTNode* left = nodeStack.top();
-            nodeStack.pop();
+            if (nodeStack.size() < 2)
+                return fail(ParseError::MISSING_OPERAND, token.span);
 
             ASTNode* opNode = new ASTNode(NodeType::BINARY_OP, token.value);
-            opNode->children.push_back(left);
-            opNode->children.push_back(right);
-
-            nodeStack.push(opNode);
+            opNode->children.push_back(nodeStack[nodeStack.size() - 2]);
+            opNode->children.push_back(nodeStack.back());
+            nodeStack.pop_back();
+            nodeStack.back() = opNode;
+            SourceSpan right = spans.back();
+            spans.pop_back();
+            spans.back().end = right.end;
         }
     }
 
-    if (nodeStack.size() != 1) {
-        std::cerr << "Error: Invalid AST. Stack size = " << nodeStack.size() << "\n";
-        return nullptr;
-    }
+    if (nodeStack.empty())
+        return fail(ParseError::EMPTY, {});
+    if (nodeStack.size() > 1)
+        return fail(ParseError::MISSING_OPERATOR, spans[1]);   // the value that follows the first
 
-    return nodeStack.top();
+    return nodeStack.back();
 }
 
 
@@ -344,3 +393,85 @@ void freeAST(ASTNode* node) {
         freeAST(child);
     delete node;
 }
+
+
+static std::string trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t");
+    if (b == std::string::npos) return "";
+    size_t e = s.find_last_not_of(" \t");
+    return s.substr(b, e - b + 1);
+}
+
+// Where trim(s.substr(from)) starts in s
+static uint32_t trimmedStart(const std::string& s, size_t from) {
+    size_t b = s.find_first_not_of(" \t", from);
+    return (uint32_t)(b == std::string::npos ? s.size() : b);
+}
+
+ExprDefinition classifyExpression(const std::string& text) {
+    // The first <, <=, > or >= outside parentheses splits an inequality
+    int parens = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '(') ++parens;
+        else if (text[i] == ')') --parens;
+        else if ((text[i] == '<' || text[i] == '>') && parens == 0) {
+            bool orEqual = i + 1 < text.size() && text[i + 1] == '=';
+            Relation rel = text[i] == '<' ? (orEqual ? Relation::LESS_EQUAL : Relation::LESS)
+                                          : (orEqual ? Relation::GREATER_EQUAL : Relation::GREATER);
+            size_t right = i + (orEqual ? 2 : 1);
+            return {ExprKind::INEQUALITY, trim(text.substr(0, i)), trim(text.substr(right)), rel,
+                    trimmedStart(text, 0), trimmedStart(text, right)};
+        }
+    }
+
+    // y ~ model: a regression fitted to the loaded points
+    size_t tilde = text.find('~');
+    std::string fitted = tilde == std::string::npos ? "" : trim(text.substr(0, tilde));
+    if (fitted == "y" || fitted == "Y")
+        return {ExprKind::REGRESSION, trim(text.substr(tilde + 1)), "", Relation::LESS, trimmedStart(text, tilde + 1)};
+
+    std::string lhs, rhs = trim(text);
+    uint32_t rhsOffset = trimmedStart(text, 0);
+    size_t eq = text.find('=');
+    if (eq != std::string::npos) {
+        lhs = text.substr(0, eq);
+        rhs = trim(text.substr(eq + 1));
+        rhsOffset = trimmedStart(text, eq + 1);
+        lhs.erase(std::remove_if(lhs.begin(), lhs.end(), ::isspace), lhs.end());
+        std::transform(lhs.begin(), lhs.end(), lhs.begin(), ::tolower);
+    }
+
+    if (lhs == "r" || lhs == "r(theta)")
+        return {ExprKind::POLAR, rhs, "", Relation::LESS, rhsOffset};
+    if (lhs == "z" || lhs == "z(x,y)")
+        return {ExprKind::HEATMAP, rhs, "", Relation::LESS, rhsOffset};
+    if (lhs == "w" || lhs == "w(z)")
+        return {ExprKind::COMPLEX, rhs, "", Relation::LESS, rhsOffset};
+
+    // A parenthesised pair "(a, b)" spanning the whole right-hand side
+    if (rhs.size() >= 2 && rhs.front() == '(' && rhs.back() == ')') {
+        int depth = 0;
+        size_t comma = std::string::npos;
+        bool spansAll = true;
+        for (size_t i = 0; i < rhs.size(); ++i) {
+            if (rhs[i] == '(') ++depth;
+            else if (rhs[i] == ')') {
+                if (--depth == 0 && i + 1 < rhs.size()) { spansAll = false; break; }
+            }
+            else if (rhs[i] == ',' && depth == 1) {
+                if (comma != std::string::npos) { comma = std::string::npos; break; }
+                comma = i;
+            }
+        }
+        if (spansAll && comma != std::string::npos) {
+            return {ExprKind::PARAMETRIC,
+                    trim(rhs.substr(1, comma - 1)),
+                    trim(rhs.substr(comma + 1, rhs.size() - comma - 2)),
+                    Relation::LESS,
+                    rhsOffset + trimmedStart(rhs, 1),
+                    rhsOffset + trimmedStart(rhs, comma + 1)};
+        }
+    }
+
+    return {ExprKind::EXPLICIT, rhs, "", Relation::LESS, rhsOffset};
+}
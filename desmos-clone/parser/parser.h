@@ -2,6 +2,8 @@
 #define PARSER_H
 
 
+#include <cstddef>
+#include <cstdint>
 #include <string> 
 #include <vector> 
 
@@ -24,13 +26,20 @@ enum class TokenType {
 };
 
 
+// Characters [begin, end) of the text passed to tokenize
+struct SourceSpan {
+    uint32_t begin = 0, end = 0;
+};
+
 struct Token{
     TokenType type;
     std::string value;
+    SourceSpan span;   // empty for the '*' of implicit multiplication
 
-    Token(TokenType t , const std::string& val){
+    Token(TokenType t , const std::string& val, SourceSpan s = {}){
         type = t;
         value = val;
+        span = s;
     }
 };
 
@@ -56,10 +65,91 @@ struct ASTNode {
 
 
 
-std::vector<Token> tokenize(const std::string& input);
-std::vector<Token> toPostfix(const std::vector<Token>& tokens);
-ASTNode* buildAST(const std::vector<Token>& postfix);
+// What an expression row plots, decided from its text:
+//   f(x) / y = f(x)         -> EXPLICIT   (body = f(x))
+//   (x(t), y(t))            -> PARAMETRIC (body = x(t), bodyY = y(t))
+//   r = f(theta)            -> POLAR      (body = f(theta))
+//   a < b, a >= b, ...      -> INEQUALITY (body = a, bodyY = b, relation)
+//   z = f(x, y)             -> HEATMAP    (body = f(x, y))
+//   y ~ f(x, a, b, ...)     -> REGRESSION (body = f, fitted to loaded points)
+//   w = f(z)                -> COMPLEX    (body = f(z), domain coloring)
+enum class ExprKind {
+    EXPLICIT,
+    PARAMETRIC,
+    POLAR,
+    INEQUALITY,
+    HEATMAP,
+    REGRESSION,
+    COMPLEX
+};
+
+enum class Relation {
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL
+};
+
+struct ExprDefinition {
+    ExprKind kind;
+    std::string body;
+    std::string bodyY;
+    Relation relation = Relation::LESS;
+    uint32_t bodyOffset = 0;    // where body and bodyY start in the classified text
+    uint32_t bodyYOffset = 0;
+};
+
+// --- Diagnostics ---
+enum class ParseError : uint8_t {
+    UNKNOWN_CHARACTER,
+    EXTRA_DECIMAL_POINT,
+    MISPLACED_COMMA,
+    UNMATCHED_CLOSE,    // ')' with no '(' before it
+    UNMATCHED_OPEN,     // '(' never closed
+    MISSING_OPERAND,    // operator with nothing on one side
+    MISSING_ARGUMENT,   // function call with an empty argument
+    MISSING_OPERATOR,   // two values side by side, like 1.2 .3
+    EMPTY
+};
+
+struct Diagnostic {
+    ParseError code;
+    SourceSpan span;
+};
+
+// Problems found by tokenize, toPostfix and buildAST. Reporting one copies
+// a code and a span into fixed storage, with no allocation, formatting or
+// I/O; past CAPACITY they are only counted.
+class ParseDiagnostics {
+public:
+    static const size_t CAPACITY = 8;
+
+    uint32_t offset = 0;   // added to reported spans, for text cut out of a longer string
+
+    void report(ParseError code, SourceSpan span);
+    void clear() { count = 0; }
+    bool empty() const { return count == 0; }
+    size_t size() const { return count < CAPACITY ? count : CAPACITY; }   // stored, in order found
+    size_t total() const { return count; }                                // including those only counted
+    const Diagnostic& operator[](size_t i) const { return items[i]; }
+
+private:
+    Diagnostic items[CAPACITY] = {};
+    size_t count = 0;
+};
+
+// Short description of code, a string literal: "Unknown character", ...
+const char* parseErrorMessage(ParseError code);
+
+// Each stage reports what it finds to diagnostics, if given, and writes
+// nothing to the console. tokenize always returns the tokens, with INVALID
+// ones for unknown characters; toPostfix returns {} and buildAST null on
+// errors they cannot step over.
+std::vector<Token> tokenize(const std::string& input, ParseDiagnostics* diagnostics = nullptr);
+std::vector<Token> toPostfix(const std::vector<Token>& tokens, ParseDiagnostics* diagnostics = nullptr);
+ASTNode* buildAST(const std::vector<Token>& postfix, ParseDiagnostics* diagnostics = nullptr);
 void printAST(ASTNode* node, int depth = 0);
 void freeAST(ASTNode* node);
+ExprDefinition classifyExpression(const std::string& text);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,34 @@
+#include "points.h"
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+bool isSeparator(char c) {
+    return c == ',' || c == ';' || c == ' ' || c == '\t';
+}
+
+} // namespace
+
+bool loadPoints(const std::string& path, std::vector<double>& xs, std::vector<double>& ys) {
+    FILE* f = std::fopen(path.c_str(), "r");
+    if (!f) return false;
+
+    xs.clear();
+    ys.clear();
+    char line[512];
+    while (std::fgets(line, sizeof(line), f)) {
+        char* p = line;
+        char* end;
+        double x = std::strtod(p, &end);
+        if (end == p) continue;
+        p = end;
+        while (isSeparator(*p)) ++p;
+        double y = std::strtod(p, &end);
+        if (end == p) continue;
+        xs.push_back(x);
+        ys.push_back(y);
+    }
+    std::fclose(f);
+    return !xs.empty();
+}
@@ -0,0 +1,13 @@
+#ifndef POINTS_H
+#define POINTS_H
+
+#include <string>
+#include <vector>
+
+// Reads a point file for fitting: one x, y pair per line, separated by a
+// comma, semicolon or whitespace. Lines that do not start with two numbers
+// (a header, comments) are skipped. Returns false if the file cannot be
+// read or holds no points.
+bool loadPoints(const std::string& path, std::vector<double>& xs, std::vector<double>& ys);
+
+#endif
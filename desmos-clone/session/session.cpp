@@ -0,0 +1,339 @@
+#include "session.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char MAGIC[4] = {'D', 'S', 'M', 'S'};
+const uint32_t FORMAT_VERSION = 2;   // 2 added the points
+const size_t HEADER_SIZE = 64;
+const uint32_t MAX_STRING = 1 << 20;
+const int MAX_PROGRAM_DEPTH = 8;   // nested integral/sum/prod subprograms
+const size_t MIN_ENTRY_SIZE = 14;  // empty text, color, visibility, kind, empty block
+
+// Values are stored in native byte order (little-endian on every platform
+// the app targets)
+class Writer {
+public:
+    std::vector<uint8_t> buf;
+
+    template <typename T>
+    void put(T v) {
+        size_t at = buf.size();
+        buf.resize(at + sizeof(T));
+        std::memcpy(buf.data() + at, &v, sizeof(T));
+    }
+
+    void putString(const std::string& s) {
+        put<uint32_t>((uint32_t)s.size());
+        buf.insert(buf.end(), s.begin(), s.end());
+    }
+
+    void putDoubles(const double* v, size_t n) {
+        size_t at = buf.size();
+        buf.resize(at + n * sizeof(double));
+        if (n) std::memcpy(buf.data() + at, v, n * sizeof(double));
+    }
+
+    void putProgram(const CompiledExpr& prog) {
+        put<uint32_t>((uint32_t)prog.variables.size());
+        for (const auto& v : prog.variables) putString(v);
+        put<uint32_t>((uint32_t)prog.code.size());
+        put<uint32_t>((uint32_t)prog.stackSize);
+        for (const Instruction& ins : prog.code) {
+            put<uint8_t>((uint8_t)ins.op);
+            put<uint8_t>(0); put<uint8_t>(0); put<uint8_t>(0);
+            put<uint32_t>(ins.arg);
+            put<double>(ins.value);
+        }
+        put<int32_t>(prog.boundSlot);
+        put<uint32_t>((uint32_t)prog.subprograms.size());
+        for (const CompiledExpr& sub : prog.subprograms) putProgram(sub);
+        put<uint32_t>((uint32_t)prog.invariants.size());
+        for (const CompiledExpr& inv : prog.invariants) putProgram(inv);
+    }
+};
+
+// Bounds-checked reader over a byte range; any overrun sets ok = false
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size) : p(data), end(data + size) {}
+    bool ok = true;
+
+    template <typename T>
+    T get() {
+        T v{};
+        if ((size_t)(end - p) < sizeof(T)) { ok = false; p = end; return v; }
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+
+    std::string getString() {
+        uint32_t n = get<uint32_t>();
+        if (n > MAX_STRING || (size_t)(end - p) < n) { ok = false; p = end; return ""; }
+        std::string s((const char*)p, n);
+        p += n;
+        return s;
+    }
+
+    bool getDoubles(std::vector<double>& v, uint64_t n) {
+        if ((uint64_t)(end - p) / sizeof(double) < n) { ok = false; p = end; return false; }
+        v.resize((size_t)n);
+        if (n) std::memcpy(v.data(), p, (size_t)n * sizeof(double));
+        p += n * sizeof(double);
+        return true;
+    }
+
+    // Sub-reader over the next n bytes
+    Reader take(size_t n) {
+        if ((size_t)(end - p) < n) { ok = false; n = end - p; }
+        Reader r(p, n);
+        p += n;
+        return r;
+    }
+
+    bool getProgram(CompiledExpr& prog, int depth = 0) {
+        if (depth > MAX_PROGRAM_DEPTH) return false;
+        uint32_t vars = get<uint32_t>();
+        if (vars > 64) return false;
+        prog.variables.clear();
+        for (uint32_t i = 0; i < vars && ok; ++i) prog.variables.push_back(getString());
+
+        uint32_t len = get<uint32_t>();
+        prog.stackSize = (int)get<uint32_t>();
+        if (!ok || (size_t)(end - p) / 16 < len) return false;
+        prog.code.resize(len);
+        for (Instruction& ins : prog.code) {
+            ins.op = (OpCode)get<uint8_t>();
+            p += 3;
+            ins.arg = get<uint32_t>();
+            ins.value = get<double>();
+        }
+
+        prog.boundSlot = get<int32_t>();
+        uint32_t subs = get<uint32_t>();
+        if (!ok || subs > len) return false;
+        prog.subprograms.resize(subs);
+        for (CompiledExpr& sub : prog.subprograms)
+            if (!getProgram(sub, depth + 1)) return false;
+
+        uint32_t invariants = get<uint32_t>();
+        if (!ok || invariants > vars) return false;
+        prog.invariants.resize(invariants);
+        for (CompiledExpr& inv : prog.invariants)
+            if (!getProgram(inv, depth + 1)) return false;
+        return ok && validateProgram(prog);
+    }
+
+private:
+    const uint8_t* p;
+    const uint8_t* end;
+};
+
+// True if vars are the variables the UI binds when it plots an entry of
+// kind, so a program cannot read slots the caller never provides
+bool variablesFit(ExprKind kind, const std::vector<std::string>& vars) {
+    using V = std::vector<std::string>;
+    switch (kind) {
+        case ExprKind::EXPLICIT:
+        case ExprKind::REGRESSION: return vars == V{"x"};
+        case ExprKind::PARAMETRIC: return vars == V{"t"};
+        case ExprKind::POLAR: return vars == V{"theta"};
+        case ExprKind::HEATMAP: return vars == V{"x", "y"};
+        case ExprKind::INEQUALITY: return vars == V{"x"} || vars == V{"x", "y"};
+        default: return false;   // complex entries are always reparsed
+    }
+}
+
+uint32_t checksum(const uint8_t* data, size_t n) {
+    uint32_t h = 2166136261u;   // FNV-1a
+    for (size_t i = 0; i < n; ++i) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Read-only view of a whole file, memory-mapped where available
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return;
+        copy.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        ptr = copy.data();
+        len = copy.size();
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* m = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m != MAP_FAILED) {
+                ptr = (const uint8_t*)m;
+                len = (size_t)st.st_size;
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (ptr) ::munmap((void*)ptr, len);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return ptr; }
+    size_t size() const { return len; }
+
+private:
+    const uint8_t* ptr = nullptr;
+    size_t len = 0;
+#ifdef _WIN32
+    std::vector<uint8_t> copy;
+#endif
+};
+
+} // namespace
+
+bool saveSession(const std::string& path, const Session& session) {
+    Writer payload;
+    for (const auto& e : session.entries) {
+        payload.putString(e.text);
+        for (int i = 0; i < 4; ++i) payload.put<uint8_t>(e.color[i]);
+        payload.put<uint8_t>(e.visible ? 1 : 0);
+        payload.put<uint8_t>((uint8_t)e.kind);
+
+        Writer block;
+        uint8_t programs = e.compiled.empty() ? 0 : (e.compiledY.empty() ? 1 : 2);
+        block.put<uint8_t>(programs);
+        if (programs >= 1) block.putProgram(e.compiled);
+        if (programs == 2) block.putProgram(e.compiledY);
+        payload.put<uint32_t>((uint32_t)block.buf.size());
+        payload.buf.insert(payload.buf.end(), block.buf.begin(), block.buf.end());
+    }
+    size_t points = std::min(session.pointsX.size(), session.pointsY.size());
+    payload.putString(session.pointsName);
+    payload.put<uint64_t>(points);
+    payload.putDoubles(session.pointsX.data(), points);
+    payload.putDoubles(session.pointsY.data(), points);
+
+    Writer header;
+    header.buf.insert(header.buf.end(), MAGIC, MAGIC + 4);
+    header.put<uint32_t>(FORMAT_VERSION);
+    header.put<uint32_t>(BYTECODE_VERSION);
+    header.put<uint32_t>((uint32_t)session.entries.size());
+    header.put<double>(session.xMin);
+    header.put<double>(session.xMax);
+    header.put<double>(session.yMin);
+    header.put<double>(session.yMax);
+    header.put<uint64_t>(payload.buf.size());
+    header.put<uint32_t>(checksum(payload.buf.data(), payload.buf.size()));
+    header.buf.resize(HEADER_SIZE, 0);
+
+    // Write to a temporary file first so a failed save never clobbers the old
+    // one; rename replaces it atomically (on Windows only a failed write is safe)
+    std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(header.buf.data(), 1, header.buf.size(), f) == header.buf.size() &&
+              std::fwrite(payload.buf.data(), 1, payload.buf.size(), f) == payload.buf.size();
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    std::remove(path.c_str());   // rename does not replace an existing file here
+#endif
+    if (std::rename(tmp.c_str(), path.c_str()) == 0) return true;
+    std::remove(tmp.c_str());
+    return false;
+}
+
+bool loadSession(const std::string& path, Session& session) {
+    MappedFile file(path);
+    if (!file.data() || file.size() < HEADER_SIZE) return false;
+    if (std::memcmp(file.data(), MAGIC, 4) != 0) return false;
+
+    Reader header(file.data() + 4, HEADER_SIZE - 4);
+    uint32_t formatVersion = header.get<uint32_t>();
+    uint32_t bytecodeVersion = header.get<uint32_t>();
+    uint32_t count = header.get<uint32_t>();
+    Session s;
+    s.xMin = header.get<double>();
+    s.xMax = header.get<double>();
+    s.yMin = header.get<double>();
+    s.yMax = header.get<double>();
+    uint64_t payloadSize = header.get<uint64_t>();
+    uint32_t sum = header.get<uint32_t>();
+
+    if (formatVersion < 1 || formatVersion > FORMAT_VERSION) return false;
+    if (payloadSize != file.size() - HEADER_SIZE) return false;
+    const uint8_t* payload = file.data() + HEADER_SIZE;
+    if (checksum(payload, payloadSize) != sum) return false;
+    if (count > payloadSize / MIN_ENTRY_SIZE) return false;
+    if (!(s.xMin < s.xMax) || !(s.yMin < s.yMax)) {
+        s.xMin = s.yMin = -10;
+        s.xMax = s.yMax = 10;
+    }
+
+    bool useCompiled = bytecodeVersion == BYTECODE_VERSION;
+    Reader r(payload, payloadSize);
+    s.entries.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        SessionEntry e;
+        e.text = r.getString();
+        for (int c = 0; c < 4; ++c) e.color[c] = r.get<uint8_t>();
+        e.visible = r.get<uint8_t>() != 0;
+        uint8_t kind = r.get<uint8_t>();
+        e.kind = kind <= (uint8_t)ExprKind::COMPLEX ? (ExprKind)kind : ExprKind::EXPLICIT;
+        e.compiledLoaded = false;
+
+        Reader block = r.take(r.get<uint32_t>());
+        if (!r.ok) return false;
+
+        if (useCompiled) {
+            uint8_t programs = block.get<uint8_t>();
+            bool ok = block.ok && programs <= 2;
+            if (ok && programs >= 1) ok = block.getProgram(e.compiled);
+            if (ok && programs == 2) ok = block.getProgram(e.compiledY);
+            bool shapeOk = (e.kind == ExprKind::PARAMETRIC) ? programs == 2 : programs == 1;
+            shapeOk = shapeOk && variablesFit(e.kind, e.compiled.variables) &&
+                      (programs < 2 || variablesFit(e.kind, e.compiledY.variables));
+            e.compiledLoaded = ok && shapeOk;
+            if (!e.compiledLoaded) {
+                e.compiled = CompiledExpr();
+                e.compiledY = CompiledExpr();
+            }
+        }
+        s.entries.push_back(std::move(e));
+    }
+    if (formatVersion >= 2) {
+        s.pointsName = r.getString();
+        uint64_t points = r.get<uint64_t>();
+        r.getDoubles(s.pointsX, points);
+        r.getDoubles(s.pointsY, points);
+    }
+    if (!r.ok) return false;
+
+    session = std::move(s);
+    return true;
+}
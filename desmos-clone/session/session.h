@@ -0,0 +1,44 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "../evaluator/compiler.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SessionEntry {
+    std::string text;
+    uint8_t color[4];        // r, g, b, a
+    bool visible;
+    ExprKind kind;
+    bool compiledLoaded;     // compiled/compiledY came from the file and passed validation
+    CompiledExpr compiled;   // empty when the expression did not compile
+    CompiledExpr compiledY;
+};
+
+struct Session {
+    double xMin = -10, xMax = 10, yMin = -10, yMax = 10;
+    std::vector<SessionEntry> entries;
+    std::string pointsName;                  // the points regressions are fitted to
+    std::vector<double> pointsX, pointsY;    // same length
+};
+
+// Binary session file:
+//   header   magic "DSMS", format version, bytecode version, entry count,
+//            viewport, payload size, payload checksum
+//   payload  per entry: text, color, visibility, kind, then the compiled
+//            programs as one length-prefixed block; then the points'
+//            name, count, xs and ys (format version 2 on; version 1
+//            files load with no points)
+// Compiled blocks are only used when the bytecode version matches, every
+// program validates and each reads exactly the variables its kind binds
+// (x, t, theta, or x and y); otherwise compiledLoaded is false and the
+// caller reparses the text. The checksum catches corruption, not crafted
+// files, so nothing else about a loaded program is trusted.
+bool saveSession(const std::string& path, const Session& session);
+
+// Memory-maps and validates path. Returns false if the file is missing,
+// truncated, corrupt or of an unknown format version.
+bool loadSession(const std::string& path, Session& session);
+
+#endif
@@ -0,0 +1,286 @@
+// Batch evaluator: tabulates expressions over many x values without the UI.
+//
+//   tabulate [options] -e EXPR [-e EXPR ...]
+//
+//   -e EXPR            expression in x to evaluate (repeatable)
+//   --range A B N      evaluate at N evenly spaced x from A to B (inclusive)
+//                      instead of reading x values from stdin
+//   --binary-in        stdin holds raw native doubles instead of text numbers
+//   --binary-out       write raw native doubles instead of text
+//   --with-x           include x as the first output column
+//   --no-output        evaluate only (for measuring throughput)
+//
+// Output has one row per x and one column per expression. Undefined values
+// are written as nan. Throughput is reported on stderr when done.
+//
+// Built by the tabulate CMake target (see the top-level README).
+
+#include "parser/parser.h"
+#include "evaluator/compiler.h"
+#include "evaluator/parallel.h"
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+const size_t CHUNK = 1 << 16;            // x values per parallel work item
+const size_t IO_BUFFER = 1 << 20;
+
+struct Options {
+    std::vector<std::string> expressions;
+    bool useRange = false;
+    double rangeStart = 0, rangeEnd = 0;
+    size_t rangeCount = 0;
+    bool binaryIn = false;
+    bool binaryOut = false;
+    bool withX = false;
+    bool noOutput = false;
+};
+
+void usage() {
+    std::fprintf(stderr,
+        "usage: tabulate [--range A B N] [--binary-in] [--binary-out] [--with-x] [--no-output] -e EXPR [-e EXPR ...]\n");
+}
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "-e" && i + 1 < argc) {
+            opt.expressions.push_back(argv[++i]);
+        } else if (a == "--range" && i + 3 < argc) {
+            opt.useRange = true;
+            opt.rangeStart = std::strtod(argv[++i], nullptr);
+            opt.rangeEnd = std::strtod(argv[++i], nullptr);
+            opt.rangeCount = std::strtoull(argv[++i], nullptr, 10);
+        } else if (a == "--binary-in") {
+            opt.binaryIn = true;
+        } else if (a == "--binary-out") {
+            opt.binaryOut = true;
+        } else if (a == "--with-x") {
+            opt.withX = true;
+        } else if (a == "--no-output") {
+            opt.noOutput = true;
+        } else {
+            return false;
+        }
+    }
+    return !opt.expressions.empty();
+}
+
+// Supplies x values chunk by chunk, from a range or from stdin
+class XSource {
+public:
+    explicit XSource(const Options& o) : opt(o), buffer(IO_BUFFER) {}
+
+    // Appends up to max values to xs; returns false when exhausted
+    bool next(std::vector<double>& xs, size_t max) {
+        xs.clear();
+        if (opt.useRange) {
+            size_t n = std::min(max, opt.rangeCount - produced);
+            double step = opt.rangeCount > 1 ? (opt.rangeEnd - opt.rangeStart) / (opt.rangeCount - 1) : 0;
+            xs.resize(n);
+            for (size_t i = 0; i < n; ++i) xs[i] = opt.rangeStart + (produced + i) * step;
+            produced += n;
+            return n > 0;
+        }
+        if (opt.binaryIn) {
+            xs.resize(max);
+            size_t n = std::fread(xs.data(), sizeof(double), max, stdin);
+            xs.resize(n);
+            return n > 0;
+        }
+        return nextText(xs, max);
+    }
+
+private:
+    const Options& opt;
+    size_t produced = 0;
+    std::vector<char> buffer;
+    size_t begin = 0, end = 0;
+    bool eof = false;
+
+    bool nextText(std::vector<double>& xs, size_t max) {
+        while (xs.size() < max) {
+            // Skip separators, refilling when the buffer runs dry
+            while (begin < end && !isNumberChar(buffer[begin])) ++begin;
+            if (end - begin < 64 && !eof) refill();
+            while (begin < end && !isNumberChar(buffer[begin])) ++begin;
+            if (begin == end) break;
+
+            double v;
+            auto res = std::from_chars(buffer.data() + begin, buffer.data() + end, v);
+            if (res.ec != std::errc()) {
+                // Not a number (e.g. "nan" or a stray sign): skip the token
+                while (begin < end && isNumberChar(buffer[begin])) ++begin;
+                continue;
+            }
+            begin = res.ptr - buffer.data();
+            xs.push_back(v);
+        }
+        return !xs.empty();
+    }
+
+    void refill() {
+        std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+        size_t n = std::fread(buffer.data() + end, 1, buffer.size() - end, stdin);
+        end += n;
+        if (n == 0) eof = true;
+    }
+
+    static bool isNumberChar(char c) {
+        return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' ||
+               c == 'e' || c == 'E' || c == 'n' || c == 'a' || c == 'i' || c == 'f';
+    }
+};
+
+// Buffered stdout writer
+class Output {
+public:
+    Output() : buffer(IO_BUFFER) {}
+    ~Output() { flush(); }
+
+    void write(const void* data, size_t n) {
+        if (n >= buffer.size()) {
+            flush();
+            std::fwrite(data, 1, n, stdout);   // large blocks go straight out
+            return;
+        }
+        if (used + n > buffer.size()) flush();
+        std::memcpy(buffer.data() + used, data, n);
+        used += n;
+    }
+
+    // Reserves room for up to n bytes of text; commit with advance()
+    char* reserve(size_t n) {
+        if (used + n > buffer.size()) flush();
+        return buffer.data() + used;
+    }
+    void advance(size_t n) { used += n; }
+
+    void flush() {
+        if (used) std::fwrite(buffer.data(), 1, used, stdout);
+        used = 0;
+    }
+
+private:
+    std::vector<char> buffer;
+    size_t used = 0;
+};
+
+void writeText(Output& out, const double* const* columns, size_t cols, size_t rows) {
+    const size_t MAX_NUMBER = 32;
+    for (size_t r = 0; r < rows; ++r) {
+        char* start = out.reserve(cols * (MAX_NUMBER + 1) + 1);
+        char* p = start;
+        for (size_t c = 0; c < cols; ++c) {
+            if (c) *p++ = ',';
+            double v = columns[c][r];
+            if (v != v) { std::memcpy(p, "nan", 3); p += 3; }
+            else p = std::to_chars(p, p + MAX_NUMBER, v).ptr;
+        }
+        *p++ = '\n';
+        out.advance(p - start);
+    }
+}
+
+void writeBinary(Output& out, const double* const* columns, size_t cols, size_t rows,
+                 std::vector<double>& scratch) {
+    if (cols == 1) {
+        out.write(columns[0], rows * sizeof(double));
+        return;
+    }
+    scratch.resize(rows * cols);
+    for (size_t r = 0; r < rows; ++r)
+        for (size_t c = 0; c < cols; ++c)
+            scratch[r * cols + c] = columns[c][r];
+    out.write(scratch.data(), scratch.size() * sizeof(double));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return 2;
+    }
+
+    // Compile every expression once up front
+    std::vector<CompiledExpr> programs;
+    for (const auto& src : opt.expressions) {
+        ExprDefinition def = classifyExpression(src);
+        ParseDiagnostics diagnostics;
+        diagnostics.offset = def.bodyOffset;
+        ASTNode* ast = buildAST(toPostfix(tokenize(def.body, &diagnostics), &diagnostics), &diagnostics);
+        if (!diagnostics.empty()) {
+            freeAST(ast);
+            std::fprintf(stderr, "tabulate: %s at column %u in '%s'\n", parseErrorMessage(diagnostics[0].code),
+                         diagnostics[0].span.begin + 1, src.c_str());
+            return 1;
+        }
+        try {
+            programs.push_back(compileExpression(ast, {"x"}));
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "tabulate: %s in '%s'\n", e.what(), src.c_str());
+            freeAST(ast);
+            return 1;
+        }
+        freeAST(ast);
+    }
+
+    // Work proceeds in rounds of a few chunks per core: chunks of a round are
+    // evaluated in parallel, then written in order
+    const size_t chunksPerRound = workerCount() * 4;
+    const size_t exprCount = programs.size();
+    std::vector<std::vector<double>> xs(chunksPerRound);
+    std::vector<std::vector<double>> results(chunksPerRound * exprCount);
+    std::vector<double> scratch;
+    std::vector<const double*> columns;
+
+    XSource source(opt);
+    Output out;
+    size_t rows = 0;
+    auto startTime = std::chrono::steady_clock::now();
+
+    for (bool more = true; more;) {
+        size_t chunks = 0;
+        while (chunks < chunksPerRound && (more = source.next(xs[chunks], CHUNK)))
+            ++chunks;
+        if (chunks == 0) break;
+
+        parallelFor(chunks * exprCount, [&](size_t job) {
+            size_t c = job / exprCount, e = job % exprCount;
+            std::vector<double>& dst = results[c * exprCount + e];
+            dst.resize(xs[c].size());
+            evaluateBatch(programs[e], xs[c].data(), xs[c].size(), dst.data());
+        });
+
+        for (size_t c = 0; c < chunks; ++c) {
+            rows += xs[c].size();
+            if (opt.noOutput) continue;
+
+            columns.clear();
+            if (opt.withX) columns.push_back(xs[c].data());
+            for (size_t e = 0; e < exprCount; ++e) columns.push_back(results[c * exprCount + e].data());
+
+            if (opt.binaryOut) writeBinary(out, columns.data(), columns.size(), xs[c].size(), scratch);
+            else writeText(out, columns.data(), columns.size(), xs[c].size());
+        }
+    }
+    out.flush();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    double evals = (double)rows * exprCount;
+    std::fprintf(stderr, "tabulate: %.0f evaluations (%zu rows x %zu expressions) in %.3f s, %.1f M evals/s on %u threads\n",
+                 evals, rows, exprCount, seconds, seconds > 0 ? evals / seconds / 1e6 : 0.0, workerCount());
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const char* MAGIC = "desmos-input 1";
+const int HELD_KEYS[] = {KEY_LEFT_CONTROL, KEY_RIGHT_CONTROL, KEY_LEFT_SHIFT, KEY_RIGHT_SHIFT};
+const int MOUSE_BUTTONS = 3;   // left, right, middle
+
+struct FrameInput {
+    double time = 0;
+    Vector2 mouse = {0, 0};
+    float wheel = 0;
+    unsigned buttonsDown = 0, buttonsPressed = 0;
+    bool close = false;
+    std::vector<int> keysPressed, keysHeld, chars;
+    std::string dropped;
+};
+
+InputMode mode = InputMode::LIVE;
+FILE* file = nullptr;
+FrameInput frame;
+size_t nextChar = 0;
+size_t frameCount = 0;
+char line[4096];
+bool pending = false;   // a replay's line holds the next frame's f record
+
+void captureLive() {
+    frame = FrameInput();
+    frame.time = GetTime();
+    frame.mouse = GetMousePosition();
+    frame.wheel = GetMouseWheelMove();
+    for (int b = 0; b < MOUSE_BUTTONS; ++b) {
+        if (IsMouseButtonDown(b)) frame.buttonsDown |= 1u << b;
+        if (IsMouseButtonPressed(b)) frame.buttonsPressed |= 1u << b;
+    }
+    frame.close = WindowShouldClose();
+    for (int k = GetKeyPressed(); k != 0; k = GetKeyPressed()) frame.keysPressed.push_back(k);
+    for (int k : HELD_KEYS)
+        if (IsKeyDown(k)) frame.keysHeld.push_back(k);
+    for (int c = GetCharPressed(); c != 0; c = GetCharPressed()) frame.chars.push_back(c);
+    if (IsFileDropped()) {
+        FilePathList dropped = LoadDroppedFiles();
+        if (dropped.count > 0) frame.dropped = dropped.paths[0];
+        UnloadDroppedFiles(dropped);
+    }
+}
+
+void writeFrame() {
+    std::fprintf(file, "f %.6f %.2f %.2f %g %u %u %d\n", frame.time, frame.mouse.x, frame.mouse.y, frame.wheel,
+                 frame.buttonsDown, frame.buttonsPressed, frame.close ? 1 : 0);
+    for (int k : frame.keysPressed) std::fprintf(file, "k %d\n", k);
+    for (int k : frame.keysHeld) std::fprintf(file, "h %d\n", k);
+    for (int c : frame.chars) std::fprintf(file, "c %d\n", c);
+    if (!frame.dropped.empty()) std::fprintf(file, "p %s\n", frame.dropped.c_str());
+}
+
+// Reads the lines of one frame, up to the next f line
+bool readFrame() {
+    if (!pending && !std::fgets(line, sizeof(line), file)) return false;
+    pending = false;
+
+    frame = FrameInput();
+    int close = 0;
+    if (std::sscanf(line, "f %lf %f %f %f %u %u %d", &frame.time, &frame.mouse.x, &frame.mouse.y, &frame.wheel,
+                    &frame.buttonsDown, &frame.buttonsPressed, &close) != 7)
+        return false;
+    frame.close = close != 0;
+
+    while (std::fgets(line, sizeof(line), file)) {
+        int value;
+        if (line[0] == 'f') {
+            pending = true;
+            break;
+        }
+        if (line[0] == 'p' && line[1] == ' ') {
+            frame.dropped = line + 2;
+            frame.dropped.erase(frame.dropped.find_last_not_of("\r\n") + 1);
+        } else if (std::sscanf(line + 1, "%d", &value) == 1) {
+            if (line[0] == 'k') frame.keysPressed.push_back(value);
+            else if (line[0] == 'h') frame.keysHeld.push_back(value);
+            else if (line[0] == 'c') frame.chars.push_back(value);
+        }
+    }
+    return true;
+}
+
+bool contains(const std::vector<int>& keys, int key) {
+    return std::find(keys.begin(), keys.end(), key) != keys.end();
+}
+
+// Nearest-rank percentile p (0-100) of sorted values
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)std::ceil(p / 100 * sorted.size());
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+void reportRow(FILE* out, const char* name, std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    double total = 0;
+    for (double v : values) total += v;
+    std::fprintf(out, "%-12s %9.3f %9.3f %9.3f %9.3f\n", name, percentile(values, 50) * 1e3,
+                 percentile(values, 95) * 1e3, percentile(values, 99) * 1e3,
+                 values.empty() ? 0.0 : total / values.size() * 1e3);
+}
+
+} // namespace
+
+bool StartInput(InputMode m, const std::string& path) {
+    StopInput();
+    if (m == InputMode::LIVE) return true;
+    file = std::fopen(path.c_str(), m == InputMode::RECORD ? "w" : "r");
+    if (!file) return false;
+    if (m == InputMode::RECORD) {
+        std::fprintf(file, "%s\n", MAGIC);
+    } else {
+        char header[64];
+        if (!std::fgets(header, sizeof(header), file) || std::strncmp(header, MAGIC, std::strlen(MAGIC)) != 0) {
+            StopInput();
+            return false;
+        }
+    }
+    mode = m;
+    pending = false;
+    return true;
+}
+
+bool PollInput() {
+    nextChar = 0;
+    if (mode == InputMode::REPLAY) {
+        if (!readFrame()) return false;
+    } else {
+        captureLive();
+        if (mode == InputMode::RECORD) writeFrame();
+    }
+    ++frameCount;
+    return true;
+}
+
+void StopInput() {
+    if (file) std::fclose(file);
+    file = nullptr;
+    mode = InputMode::LIVE;
+}
+
+size_t InputFrameCount() { return frameCount; }
+
+Vector2 InputMousePosition() { return frame.mouse; }
+bool InputMouseDown(int button) { return (frame.buttonsDown >> button) & 1; }
+bool InputMousePressed(int button) { return (frame.buttonsPressed >> button) & 1; }
+bool InputKeyDown(int key) { return contains(frame.keysHeld, key); }
+bool InputKeyPressed(int key) { return contains(frame.keysPressed, key); }
+int InputCharPressed() { return nextChar < frame.chars.size() ? frame.chars[nextChar++] : 0; }
+float InputWheelMove() { return frame.wheel; }
+const char* InputDroppedFile() { return frame.dropped.empty() ? nullptr : frame.dropped.c_str(); }
+bool InputCloseRequested() { return frame.close; }
+
+// --- Frame profile ---
+void FrameProfile::beginFrame() {
+    if (!enabled) return;
+    std::fill(current.begin(), current.end(), 0.0);
+    frameStart = last = Clock::now();
+}
+
+void FrameProfile::mark(const char* stage) {
+    if (!enabled) return;
+    auto now = Clock::now();
+    size_t i = 0;
+    while (i < stages.size() && std::strcmp(stages[i], stage) != 0) ++i;
+    if (i == stages.size()) {
+        stages.push_back(stage);
+        times.emplace_back(frames.size(), 0.0);   // stages first seen late cost 0 before
+        current.push_back(0);
+    }
+    current[i] += std::chrono::duration<double>(now - last).count();
+    last = now;
+}
+
+void FrameProfile::endFrame() {
+    if (!enabled) return;
+    for (size_t i = 0; i < stages.size(); ++i) times[i].push_back(current[i]);
+    frames.push_back(std::chrono::duration<double>(Clock::now() - frameStart).count());
+}
+
+void FrameProfile::report(FILE* out) const {
+    std::fprintf(out, "%zu frames, milliseconds\n%-12s %9s %9s %9s %9s\n", frames.size(), "stage", "p50", "p95",
+                 "p99", "mean");
+    for (size_t i = 0; i < stages.size(); ++i) reportRow(out, stages[i], times[i]);
+    reportRow(out, "frame", frames);
+}
@@ -0,0 +1,79 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "raylib.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// --- Input recording and replay ---
+// The frame loop reads its input through these functions instead of
+// raylib's. PollInput takes one frame's snapshot from the devices, and
+// appends it to the recording if there is one, or reads it back from a
+// replay, so the rest of the frame sees exactly the recorded events.
+//
+// Recording file, text, one record per line:
+//   desmos-input 1
+//   f <time> <mouse x> <mouse y> <wheel> <buttons down> <buttons pressed> <close>
+//   k <key>         key pressed this frame
+//   h <key>         key held (only modifiers are tracked, see InputKeyDown)
+//   c <codepoint>   character typed
+//   p <path>        file dropped onto the window
+// Button masks have bit b set for raylib mouse button b. Each frame's
+// events follow its f line.
+
+enum class InputMode { LIVE, RECORD, REPLAY };
+
+// Opens path for writing (RECORD) or reading (REPLAY). False if the file
+// cannot be opened or is not a recording.
+bool StartInput(InputMode mode, const std::string& path);
+
+// Takes the next frame's input. False when a replay has no frames left.
+bool PollInput();
+
+// Closes the recording or replay
+void StopInput();
+
+// Frames taken so far
+size_t InputFrameCount();
+
+// raylib's queries, answered from the current frame
+Vector2 InputMousePosition();
+bool InputMouseDown(int button);
+bool InputMousePressed(int button);
+bool InputKeyDown(int key);      // Control and Shift only; false for other keys
+bool InputKeyPressed(int key);
+int InputCharPressed();          // next typed character, 0 when there are no more
+float InputWheelMove();
+const char* InputDroppedFile();  // null unless a file was dropped this frame
+bool InputCloseRequested();
+
+// --- Frame profile ---
+// Wall time of each stage of a frame: mark charges the time since the
+// previous mark (or beginFrame) to the named stage, identified by its
+// name, in order of first use. A disabled profile records nothing, so the
+// interactive loop does not grow it without bound.
+class FrameProfile {
+public:
+    explicit FrameProfile(bool enabled) : enabled(enabled) {}
+
+    void beginFrame();
+    void mark(const char* stage);
+    void endFrame();
+
+    // p50, p95 and p99 of each stage and of whole frames, in milliseconds
+    void report(FILE* out) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    bool enabled;
+    std::vector<const char*> stages;
+    std::vector<std::vector<double>> times;   // seconds, times[stage][frame]
+    std::vector<double> current;              // this frame, per stage
+    std::vector<double> frames;
+    Clock::time_point frameStart, last;
+};
+
+#endif
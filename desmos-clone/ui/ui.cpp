@@ -1,14 +1,31 @@
 #include "../parser/parser.h"
 #include "../evaluator/evaluator.h"
+#include "../evaluator/analysis.h"
+#include "../evaluator/compiler.h"
+#include "../evaluator/integrate.h"
+#include "../evaluator/sampler.h"
+#include "../evaluator/region.h"
+#include "../evaluator/heatmap.h"
+#include "../evaluator/fit.h"
+#include "../evaluator/complex.h"
+#include "../evaluator/symbolic.h"
+#include "../evaluator/metrics.h"
+#include "../evaluator/shared.h"
+#include "../session/session.h"
+#include "../session/points.h"
 #include "ui.h"
+#include "replay.h"
 #include "raylib.h"
 
 #include <vector>
+#include <map>
 #include <cstring>
+#include <cstdlib>
 #include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <stdexcept> 
+#include <chrono>
 
 static Texture2D eyeOpenTex;
 static Texture2D eyeClosedTex;
@@ -47,6 +64,8 @@ static Color expressionColors[] = {
 static int maxColors = sizeof(expressionColors) / sizeof(Color);
 
 // --- Expression struct ---
+static unsigned nextRevision = 0;
+
 struct Expression {
     std::string text;
     bool isActive;
@@ -54,11 +73,35 @@ struct Expression {
     bool valid;            // New: validity flag after parsing/evaluation
     std::string error;     // New: error message string
     Color color;
-    ASTNode* ast;
+    ExprKind kind;
+    ASTNode* ast;          // f(x), x(t) or r(theta); null when restored from a session
+    ASTNode* astY;         // y(t) for parametric curves
+    CompiledExpr compiled; // what gets plotted and analysed
+    CompiledExpr compiledY;
+    int shadeWith;         // SHADE_NONE, SHADE_AXIS or the index of a second curve
+    Relation relation;     // inequalities, see RegionRelation
+    bool showContours;     // heatmaps: contour lines over the colours
+    std::vector<std::string> paramNames;   // regressions: fitted parameters, in slot order
+    FitResult fit;
+    ComplexProgram complexProg;   // w = f(z)
+    std::string derivedText;      // d/dx entries: the derivative, simplified
+    ParseDiagnostics diagnostics; // syntax errors in text, shown instead of error
+    unsigned revision;            // new on every compile; caches key by it, not by text
     Expression(const std::string& t, Color c)
-        : text(t), isActive(false), isVisible(true), valid(false), error(""), color(c), ast(nullptr) {}
+        : text(t), isActive(false), isVisible(true), valid(false), error(""), color(c),
+          kind(ExprKind::EXPLICIT), ast(nullptr), astY(nullptr), shadeWith(-1), relation(Relation::LESS),
+          showContours(false), revision(++nextRevision) {}
 };
 
+const int SHADE_NONE = -1;
+const int SHADE_AXIS = -2;
+
+// Key for per-expression caches. Text alone is not enough: a d/dx @k row
+// keeps its text when row k changes, and a regression refits on new points.
+std::string CacheKey(const Expression& e) {
+    return e.text + '#' + std::to_string(e.revision);
+}
+
 // --- Viewport struct ---
 struct Viewport {
     double xMin = -10.0, xMax = 10.0, yMin = -10.0, yMax = 10.0;
@@ -80,6 +123,11 @@ struct Viewport {
     }
 };
 static Viewport viewport;
+static bool fastPlotting = true;   // float32 sampling where plotPrecision allows it
+
+// Points loaded for y ~ f(x) regressions (dropped onto the window)
+static std::vector<double> dataX, dataY;
+static std::string dataName;
 
 // --- UI Helper Functions ---
 void DrawRoundedRect(int x, int y, int w, int h, float r, Color c) {
@@ -89,47 +137,219 @@ void DrawRoundedRectLines(int x, int y, int w, int h, float r, Color c) {
     DrawRectangleRoundedLines({(float)x,(float)y,(float)w,(float)h}, r, 6, c);
 }
 bool IsMouseOverRect(int x, int y, int w, int h) {
-    Vector2 m = GetMousePosition();
+    Vector2 m = InputMousePosition();
     return m.x >= x && m.x <= x + w && m.y >= y && m.y <= y + h;
 }
 
 // --- Expression parsing with error & validity tracking ---
-void parseExpression(Expression& expr) {
-    if (expr.ast) {
-        freeAST(expr.ast);
-        expr.ast = nullptr;
+// src's tree, or null with its problems added to diagnostics, their spans
+// shifted by offset (where src starts in the row's text)
+ASTNode* parseSource(const std::string& src, ParseDiagnostics& diagnostics, uint32_t offset = 0) {
+    countMetric(Metric::PARSES);
+    size_t before = diagnostics.total();
+    diagnostics.offset = offset;
+    auto tokens = tokenize(src, &diagnostics);
+    auto pf = toPostfix(tokens, &diagnostics);
+    ASTNode* a = diagnostics.total() == before ? buildAST(pf, &diagnostics) : nullptr;
+    diagnostics.offset = 0;
+    if (!a || diagnostics.total() != before) {   // unknown characters are only skipped by the parser
+        freeAST(a);
+        countMetric(Metric::PARSE_FAILURES);
+        return nullptr;
+    }
+    return a;
+}
+
+// For text that is not shown with its own highlighting, like the curve a
+// derivative entry refers to: throws the first problem's message
+ASTNode* parseSource(const std::string& src) {
+    ParseDiagnostics diagnostics;
+    ASTNode* a = parseSource(src, diagnostics);
+    if (!a) throw std::runtime_error(parseErrorMessage(diagnostics[0].code));
+    return a;
+}
+
+// --- Inequalities ---
+// y < f(x), written either way round, compiles f over x alone and is filled
+// column by column under or over the curve. Anything else compiles
+// F(x, y) = left - right over x and y and is rasterized per pixel.
+bool IsExplicitRegion(const Expression& e) {
+    return e.kind == ExprKind::INEQUALITY && e.compiled.variables.size() == 1;
+}
+
+bool IsY(const std::string& side) {
+    return side == "y" || side == "Y";
+}
+
+// Relation as drawn: y <rel> f(x) for explicit regions, F(x, y) <rel> 0 otherwise
+Relation RegionRelation(const ExprDefinition& def, bool explicitRegion) {
+    bool yOnRight = !IsY(def.body) && IsY(def.bodyY);
+    return explicitRegion && yOnRight ? flipRelation(def.relation) : def.relation;
+}
+
+// --- Regressions ---
+// Fits every free name of the model besides x to the loaded points, from
+// 1 as the starting value, and compiles the fitted curve over x alone
+void FitRegression(Expression& expr) {
+    std::vector<std::string> names = freeVariables(expr.ast, {"x"});
+    std::vector<std::string> vars = {"x"};
+    vars.insert(vars.end(), names.begin(), names.end());
+    CompiledExpr model = compileExpression(expr.ast, vars);
+    if (dataX.empty()) throw std::runtime_error("Drop a file of x, y points to fit");
+
+    FitResult fit = fitLeastSquares(model, dataX, dataY, std::vector<double>(names.size(), 1.0));
+    ASTNode* fitted = substituteVariables(expr.ast, names, fit.params);
+    try {
+        expr.compiled = compileExpression(fitted, {"x"});
+    } catch (...) {
+        freeAST(fitted);
+        throw;
+    }
+    freeAST(fitted);
+    expr.paramNames = std::move(names);
+    expr.fit = std::move(fit);
+}
+
+// --- Derivative entries ---
+// "d/dx f" plots f' and shows it simplified under the row. "d/dx @k"
+// tracks the curve in row k (from 1): it is rebuilt from that row's text
+// whenever any row is committed, and may itself be a derivative entry.
+bool IsDerivative(const std::string& text) {
+    return text.compare(0, 4, "d/dx") == 0;
+}
+
+ASTNode* DifferentiateEntry(const std::vector<Expression>& expressions, const std::string& text, size_t depth) {
+    if (depth > expressions.size()) throw std::runtime_error("Derivative refers back to itself");
+    if (!IsDerivative(text)) {
+        ExprDefinition def = classifyExpression(text);
+        if (def.kind != ExprKind::EXPLICIT) throw std::runtime_error("d/dx needs a curve y = f(x)");
+        return parseSource(def.body);
+    }
+
+    size_t b = text.find_first_not_of(" \t", 4);
+    std::string arg = b == std::string::npos ? "" : text.substr(b);
+    ASTNode* f;
+    if (!arg.empty() && arg[0] == '@') {
+        size_t end = arg.find_first_not_of("0123456789", 1);
+        int k = end == 1 ? 0 : std::atoi(arg.c_str() + 1);
+        if (end != std::string::npos || k < 1 || k > (int)expressions.size())
+            throw std::runtime_error("d/dx @k needs a row number from 1 to " + std::to_string(expressions.size()));
+        f = DifferentiateEntry(expressions, expressions[k - 1].text, depth + 1);
+    } else {
+        f = DifferentiateEntry(expressions, arg, depth + 1);
+    }
+
+    ASTNode* d;
+    try {
+        d = differentiate(f, "x");
+    } catch (...) {
+        freeAST(f);
+        throw;
+    }
+    freeAST(f);
+    return d;
+}
+
+void parseExpression(Expression& expr, const std::vector<Expression>& expressions) {
+    freeAST(expr.ast);
+    freeAST(expr.astY);
+    expr.ast = expr.astY = nullptr;
+    expr.compiled = CompiledExpr();
+    expr.compiledY = CompiledExpr();
+    expr.paramNames.clear();
+    expr.fit = FitResult();
+    expr.complexProg = ComplexProgram();
+    expr.derivedText.clear();
+    expr.diagnostics.clear();
+    expr.revision = ++nextRevision;
+
+    if (IsDerivative(expr.text)) {
+        expr.kind = ExprKind::EXPLICIT;
+        expr.error.clear();
+        try {
+            expr.ast = DifferentiateEntry(expressions, expr.text, 0);
+            expr.compiled = compileExpression(expr.ast, {"x"});
+            expr.derivedText = "= " + formatExpression(expr.ast);
+            expr.valid = true;
+        } catch (const std::exception& e) {
+            countMetric(Metric::EXCEPTIONS_CAUGHT);
+            expr.error = e.what();
+            freeAST(expr.ast);
+            expr.ast = nullptr;
+            expr.compiled = CompiledExpr();
+            expr.valid = false;
+        }
+        return;
     }
 
+    ExprDefinition def = classifyExpression(expr.text);
+    expr.kind = def.kind;
+
     // Strip LHS like f(x)=
-    size_t eq = expr.text.find('=');
-    if (eq != std::string::npos) {
-        expr.text = expr.text.substr(eq + 1);
+    if (def.kind == ExprKind::EXPLICIT) {
+        expr.text = def.body;
+        def.bodyOffset = 0;
     }
 
     expr.error.clear();
     expr.valid = false;
 
-    if (expr.text.empty() || expr.text.back() == '(') return;
+    if (def.body.empty() || def.body.back() == '(') return;
+
+    // Syntax errors stay diagnostics, without an exception or a message string
+    expr.ast = parseSource(def.body, expr.diagnostics, def.bodyOffset);
+    if (expr.ast && (def.kind == ExprKind::INEQUALITY || def.kind == ExprKind::PARAMETRIC))
+        expr.astY = parseSource(def.bodyY, expr.diagnostics, def.bodyYOffset);
+    if (!expr.diagnostics.empty()) {
+        freeAST(expr.ast);
+        expr.ast = nullptr;
+        return;
+    }
 
     try {
-        auto tokens = tokenize(expr.text);
-        auto pf = toPostfix(tokens);
-        ASTNode* a = buildAST(pf);
-        if (!a) throw std::runtime_error("Parse failed");
-        expr.ast = a;
+        if (def.kind == ExprKind::EXPLICIT) {
+            expr.compiled = compileExpression(expr.ast, {"x"});
 
-        // Test evaluation at 0 to check for immediate runtime errors
-        double testVal = evaluate(expr.ast, 0);
-        if (std::isnan(testVal) || std::isinf(testVal))
-            throw std::runtime_error("Expression evaluates to NaN or Inf");
+            // Test evaluation at 0 to check for immediate runtime errors
+            double testVal = evaluate(expr.ast, 0);
+            if (std::isnan(testVal) || std::isinf(testVal))
+                throw std::runtime_error("Expression evaluates to NaN or Inf");
+        } else if (def.kind == ExprKind::INEQUALITY) {
+            bool yLeft = IsY(def.body), yRight = !yLeft && IsY(def.bodyY);
+            try {
+                if (yLeft || yRight) expr.compiled = compileExpression(yLeft ? expr.astY : expr.ast, {"x"});
+            } catch (const std::runtime_error&) {   // f reads y as well
+                countMetric(Metric::EXCEPTIONS_CAUGHT);
+            }
+            if (expr.compiled.empty()) {
+                ASTNode diff(NodeType::BINARY_OP, "-");
+                diff.children = {expr.ast, expr.astY};
+                expr.compiled = compileExpression(&diff, {"x", "y"});
+            }
+            expr.relation = RegionRelation(def, IsExplicitRegion(expr));
+        } else if (def.kind == ExprKind::HEATMAP) {
+            expr.compiled = compileExpression(expr.ast, {"x", "y"});
+        } else if (def.kind == ExprKind::COMPLEX) {
+            expr.complexProg = compileComplex(expr.ast);
+        } else if (def.kind == ExprKind::REGRESSION) {
+            FitRegression(expr);
+        } else if (def.kind == ExprKind::PARAMETRIC) {
+            expr.compiled = compileExpression(expr.ast, {"t"});
+            expr.compiledY = compileExpression(expr.astY, {"t"});
+        } else {
+            expr.compiled = compileExpression(expr.ast, {"theta"});
+        }
 
         expr.valid = true;
     } catch (const std::exception& e) {
+        countMetric(Metric::EXCEPTIONS_CAUGHT);
         expr.error = e.what();
-        if (expr.ast) {
-            freeAST(expr.ast);
-            expr.ast = nullptr;
-        }
+        freeAST(expr.ast);
+        freeAST(expr.astY);
+        expr.ast = expr.astY = nullptr;
+        expr.compiled = CompiledExpr();
+        expr.compiledY = CompiledExpr();
+        expr.complexProg = ComplexProgram();
         expr.valid = false;
     }
 }
@@ -140,9 +360,8 @@ void DrawHeader() {
     DrawText("Graphing Calculator", 20, 20, 24, WHITE);
     DrawLine(0, HEADER_HEIGHT, WINDOW_WIDTH, HEADER_HEIGHT, BORDER_COLOR);
 }
-void DrawAddExpressionButton(int yPos) {
+void DrawAddExpressionButton(int yPos, bool hover) {
     Color btnColor = DESMOS_BLUE;
-    bool hover = IsMouseOverRect(10, yPos, LEFT_PANEL_WIDTH - 20, EXPRESSION_HEIGHT);
     
     if (hover) {
         btnColor.r = (unsigned char)(btnColor.r * 0.9f);
@@ -161,102 +380,294 @@ void DrawAddExpressionButton(int yPos) {
             18, WHITE);
 }
 
-// --- Updated Left Panel with inline editing support & error display ---
-void DrawLeftPanel(std::vector<Expression>& expressions, int& activeExpression) {
-    DrawRectangle(0, HEADER_HEIGHT, LEFT_PANEL_WIDTH, WINDOW_HEIGHT - HEADER_HEIGHT, PANEL_BG);
-    DrawLine(LEFT_PANEL_WIDTH, HEADER_HEIGHT, LEFT_PANEL_WIDTH, WINDOW_HEIGHT, BORDER_COLOR);
+// --- Expression list layout ---
+// Rows (and the Add Expression button after the last one) sit at fixed
+// offsets in a scrollable area, so the visible range and the row under the
+// mouse follow from the scroll position by index math alone.
+const int LIST_TOP = HEADER_HEIGHT + 20;
+const int LIST_BOTTOM = WINDOW_HEIGHT - 210;
+const int ROW_STRIDE = EXPRESSION_HEIGHT + EXPRESSION_MARGIN;
+static float listScroll = 0;
 
-    int yPos = HEADER_HEIGHT + 20;
-    Vector2 mousePos = GetMousePosition();
-    bool mouseClicked = IsMouseButtonPressed(MOUSE_LEFT_BUTTON);
-
-    for (size_t i = 0; i < expressions.size(); ++i) {
-        Expression& e = expressions[i];
-        bool hover = IsMouseOverRect(10, yPos, LEFT_PANEL_WIDTH - 20, EXPRESSION_HEIGHT);
-        Color bg = (activeExpression == (int)i) ? WHITE : (hover ? WHITE : EXPRESSION_BG);
-        DrawRoundedRect(10, yPos, LEFT_PANEL_WIDTH - 20, EXPRESSION_HEIGHT, 0.1f, bg);
-        if (activeExpression == (int)i || hover)
-            DrawRoundedRectLines(10, yPos, LEFT_PANEL_WIDTH - 20, EXPRESSION_HEIGHT, 0.1f, BORDER_COLOR);
-
-        DrawCircle(25, yPos + EXPRESSION_HEIGHT / 2, 8, e.color);
-
-        if (activeExpression == (int)i) {
-            // Editing mode: show input box
-            static char inputBuffer[256] = {0};
-            static int inputLength = 0;
-
-            // Initialize inputBuffer on first frame of editing
-            static int lastActive = -1;
-            if (lastActive != activeExpression) {
-                strncpy(inputBuffer, e.text.c_str(), 255);
-                inputBuffer[255] = '\0';
-                inputLength = (int)strlen(inputBuffer);
-                lastActive = activeExpression;
-            }
+void ClampListScroll(size_t count) {
+    float maxScroll = (float)std::max(0, (int)(count + 1) * ROW_STRIDE - EXPRESSION_MARGIN - (LIST_BOTTOM - LIST_TOP));
+    listScroll = std::max(0.0f, std::min(listScroll, maxScroll));
+}
 
-            // Draw text box background
-            DrawRoundedRect(45, yPos + 10, LEFT_PANEL_WIDTH - 90, 30, 0.1f, EXPRESSION_BG);
-            DrawRoundedRectLines(45, yPos + 10, LEFT_PANEL_WIDTH - 90, 30, 0.1f, BORDER_COLOR);
+int RowTop(size_t row) {
+    return LIST_TOP + (int)row * ROW_STRIDE - (int)listScroll;
+}
 
-            // Draw editable text using Raylib GuiTextBox-like logic:
-            // We handle input manually here
+// Row under the point: an expression index, count for the Add Expression
+// button, or -1 for margins and anything outside the list
+int RowAt(Vector2 p, size_t count) {
+    if (p.x < 10 || p.x > LEFT_PANEL_WIDTH - 10 || p.y < LIST_TOP || p.y >= LIST_BOTTOM) return -1;
+    int offset = (int)p.y - LIST_TOP + (int)listScroll;
+    int row = offset / ROW_STRIDE;
+    if (offset % ROW_STRIDE > EXPRESSION_HEIGHT || row > (int)count) return -1;
+    return row;
+}
 
-            // Draw input text
-            DrawText(inputBuffer, 50, yPos + 18, 18, TEXT_COLOR);
+void ScrollToRow(size_t row, size_t count) {
+    int top = (int)row * ROW_STRIDE;
+    if (top < listScroll) listScroll = (float)top;
+    else if (top + EXPRESSION_HEIGHT > listScroll + (LIST_BOTTOM - LIST_TOP))
+        listScroll = (float)(top + EXPRESSION_HEIGHT - (LIST_BOTTOM - LIST_TOP));
+    ClampListScroll(count);
+}
 
-            // Handle keyboard input while editing
-            int c = GetCharPressed();
-            while (c > 0 && inputLength < 255) {
-                if (c >= 32 && c < 127) {
-                    inputBuffer[inputLength++] = (char)c;
-                    inputBuffer[inputLength] = '\0';
-                }
-                c = GetCharPressed();
-            }
-            if (IsKeyPressed(KEY_BACKSPACE) && inputLength > 0) {
-                inputBuffer[--inputLength] = '\0';
-            }
+void DrawListScrollbar(size_t count) {
+    int viewH = LIST_BOTTOM - LIST_TOP;
+    int contentH = (int)(count + 1) * ROW_STRIDE - EXPRESSION_MARGIN;
+    if (contentH <= viewH) return;
+    int thumbH = std::max(20, viewH * viewH / contentH);
+    int thumbY = LIST_TOP + (int)((viewH - thumbH) * (listScroll / (contentH - viewH)));
+    DrawRoundedRect(LEFT_PANEL_WIDTH - 7, thumbY, 4, thumbH, 1.0f, BORDER_COLOR);
+}
 
-            // Commit on Enter or focus loss (click outside)
-            if (IsKeyPressed(KEY_ENTER) || (mouseClicked && !IsMouseOverRect(10, yPos, LEFT_PANEL_WIDTH - 20, EXPRESSION_HEIGHT))) {
-                e.text = std::string(inputBuffer);
-                parseExpression(e);
-                activeExpression = -1; // end editing
-            }
-        } else {
-            // Display mode: show text or placeholder
-            const char* disp = e.text.empty() ? "Enter an equation..." : e.text.c_str();
-            Color dispColor = e.text.empty() ? PLACEHOLDER_COLOR : TEXT_COLOR;
-            DrawText(disp, 45, yPos + 15, 18, dispColor);
-
-            // On click, enter editing mode
-            if (hover && mouseClicked) {
-                activeExpression = (int)i;
+// --- Area shading ---
+bool CanShade(const Expression& e) {
+    return e.valid && !e.compiled.empty() && e.kind == ExprKind::EXPLICIT;
+}
+
+// Clicking the colour dot cycles: no shading, to the x-axis, then to each
+// other explicit curve in turn
+int NextShadeTarget(const std::vector<Expression>& expressions, int i) {
+    int cur = expressions[i].shadeWith;
+    if (cur == SHADE_NONE) return SHADE_AXIS;
+    for (int j = (cur == SHADE_AXIS ? 0 : cur + 1); j < (int)expressions.size(); ++j)
+        if (j != i && CanShade(expressions[j])) return j;
+    return SHADE_NONE;
+}
+
+// Signed area between f and its shade target over the visible x range.
+// Cached per pair of expressions until either is recompiled or the window changes.
+double ShadedArea(const std::vector<Expression>& expressions, const Expression& f) {
+    static std::map<std::string, double> cache;
+    static double cachedMin = 0, cachedMax = 0;
+    if (cachedMin != viewport.xMin || cachedMax != viewport.xMax) {
+        cache.clear();
+        cachedMin = viewport.xMin;
+        cachedMax = viewport.xMax;
+    }
+
+    const Expression* g = f.shadeWith >= 0 ? &expressions[f.shadeWith] : nullptr;
+    std::string key = CacheKey(f) + '\n' + (g ? CacheKey(*g) : "");
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+        countMetric(Metric::AREA_HITS);
+        return it->second;
+    }
+    countMetric(Metric::AREA_MISSES);
+
+    // Points where either side is undefined contribute nothing
+    double area = integrateParallel([&](double x) {
+        double y = evaluateCompiled(f.compiled, &x) - (g ? evaluateCompiled(g->compiled, &x) : 0.0);
+        return std::isfinite(y) ? y : 0.0;
+    }, viewport.xMin, viewport.xMax, 1e-8);
+    cache[key] = area;
+    return area;
+}
+
+// --- Expression row with inline editing support & error display ---
+static char inputBuffer[256] = {0};
+static int inputLength = 0;
+static int lastActive = -1;
+static bool derivativesStale = false;   // a row was committed; d/dx @k rows may follow it
+
+// Reparses every derivative entry against the rows' current text
+void RefreshDerivatives(std::vector<Expression>& expressions) {
+    for (auto& e : expressions)
+        if (IsDerivative(e.text)) parseExpression(e, expressions);
+    derivativesStale = false;
+}
+
+// References in text after row (from 0) is deleted: @k to that row becomes
+// its text, so the derivative keeps its curve, and later rows shift up
+std::string RenumberReferences(const std::string& text, int row, const std::string& removed) {
+    std::string out;
+    for (size_t p = 0; p < text.size();) {
+        size_t end = std::min(text.find_first_not_of("0123456789", p + 1), text.size());
+        if (text[p] != '@' || end == p + 1) {
+            out += text[p++];
+            continue;
+        }
+        int k = std::atoi(text.c_str() + p + 1);
+        if (k == row + 1) out += RenumberReferences(removed, row, "");
+        else out += "@" + std::to_string(k > row + 1 ? k - 1 : k);
+        p = end;
+    }
+    return out;
+}
+
+void RenumberDerivatives(std::vector<Expression>& expressions, int row, const std::string& removed) {
+    for (auto& e : expressions)
+        if (IsDerivative(e.text)) e.text = RenumberReferences(e.text, row, removed);
+    derivativesStale = true;
+}
+
+// Underlines characters [span.begin, span.end) of text drawn at (x, y).
+// Empty spans, where something is missing, get a short mark.
+void UnderlineSpan(const std::string& text, SourceSpan span, int x, int y, int fontSize) {
+    char prefix[256];
+    auto width = [&](uint32_t n) {
+        size_t len = std::min<size_t>({n, text.size(), sizeof(prefix) - 1});
+        memcpy(prefix, text.data(), len);
+        prefix[len] = '\0';
+        return MeasureText(prefix, fontSize);
+    };
+    int x0 = x + width(span.begin);
+    int x1 = std::max(x + width(span.end), x0 + fontSize / 3);
+    DrawRectangle(x0, y + fontSize + 1, x1 - x0, 2, ERROR_COLOR);
+}
+
+void DrawExpressionRow(const std::vector<Expression>& expressions, Expression& e, int i, int yPos,
+                       bool hover, int& activeExpression, bool mouseClicked, Vector2 mousePos) {
+    Color bg = (activeExpression == i) ? WHITE : (hover ? WHITE : EXPRESSION_BG);
+    DrawRoundedRect(10, yPos, LEFT_PANEL_WIDTH - 20, EXPRESSION_HEIGHT, 0.1f, bg);
+    if (activeExpression == i || hover)
+        DrawRoundedRectLines(10, yPos, LEFT_PANEL_WIDTH - 20, EXPRESSION_HEIGHT, 0.1f, BORDER_COLOR);
+
+    DrawCircle(25, yPos + EXPRESSION_HEIGHT / 2, 8, e.color);
+
+    if (activeExpression == i) {
+        // Editing mode: show input box
+
+        // Initialize inputBuffer on first frame of editing
+        if (lastActive != activeExpression) {
+            strncpy(inputBuffer, e.text.c_str(), 255);
+            inputBuffer[255] = '\0';
+            inputLength = (int)strlen(inputBuffer);
+            lastActive = activeExpression;
+        }
+
+        // Draw text box background
+        DrawRoundedRect(45, yPos + 10, LEFT_PANEL_WIDTH - 90, 30, 0.1f, EXPRESSION_BG);
+        DrawRoundedRectLines(45, yPos + 10, LEFT_PANEL_WIDTH - 90, 30, 0.1f, BORDER_COLOR);
+
+        // Draw editable text using Raylib GuiTextBox-like logic:
+        // We handle input manually here
+
+        // Draw input text
+        DrawText(inputBuffer, 50, yPos + 18, 18, TEXT_COLOR);
+
+        // Handle keyboard input while editing
+        int c = InputCharPressed();
+        while (c > 0 && inputLength < 255) {
+            if (c >= 32 && c < 127) {
+                inputBuffer[inputLength++] = (char)c;
+                inputBuffer[inputLength] = '\0';
             }
+            c = InputCharPressed();
+        }
+        if (InputKeyPressed(KEY_BACKSPACE) && inputLength > 0) {
+            inputBuffer[--inputLength] = '\0';
+        }
+
+        // Commit on Enter or focus loss (click outside)
+        if (InputKeyPressed(KEY_ENTER) || (mouseClicked && !hover)) {
+            e.text = std::string(inputBuffer);
+            parseExpression(e, expressions);
+            derivativesStale = true;
+            activeExpression = -1; // end editing
+        }
+    } else {
+        // Display mode: show text or placeholder
+        const char* disp = e.text.empty() ? "Enter an equation..." : e.text.c_str();
+        Color dispColor = e.text.empty() ? PLACEHOLDER_COLOR : TEXT_COLOR;
+        DrawText(disp, 45, yPos + 15, 18, dispColor);
+
+        // On click, enter editing mode
+        if (hover && mouseClicked) {
+            activeExpression = i;
         }
+    }
+
+    // Show error below expression if any, with a syntax error's range
+    // underlined in the text
+    if (!e.diagnostics.empty()) {
+        const Diagnostic& d = e.diagnostics[0];
+        DrawText(parseErrorMessage(d.code), 45, yPos + EXPRESSION_HEIGHT - 15, 12, ERROR_COLOR);
+        if (activeExpression != i) UnderlineSpan(e.text, d.span, 45, yPos + 15, 18);
+    } else if (!e.valid && !e.error.empty()) {
+        DrawText(e.error.c_str(), 45, yPos + EXPRESSION_HEIGHT - 15, 12, ERROR_COLOR);
+    }
+
+    // Area of the shaded region, or a ring around the dot when it is shaded
+    // (or when a heatmap shows contours)
+    if (e.kind == ExprKind::HEATMAP && e.showContours) DrawCircleLines(25, yPos + EXPRESSION_HEIGHT / 2, 11, e.color);
+    if (e.shadeWith != SHADE_NONE && CanShade(e)) {
+        DrawCircleLines(25, yPos + EXPRESSION_HEIGHT / 2, 11, e.color);
+        if (activeExpression != i) {
+            char area[48];
+            snprintf(area, sizeof(area), "area = %.6g", ShadedArea(expressions, e));
+            DrawText(area, 45, yPos + EXPRESSION_HEIGHT - 15, 12, PLACEHOLDER_COLOR);
+        }
+    }
+
+    // The derivative a d/dx entry plots
+    if (!e.derivedText.empty() && activeExpression != i)
+        DrawText(e.derivedText.c_str(), 45, yPos + EXPRESSION_HEIGHT - 15, 12, PLACEHOLDER_COLOR);
 
-        // Show error below expression if any
-        if (!e.valid && !e.error.empty()) {
-            DrawText(e.error.c_str(), 45, yPos + EXPRESSION_HEIGHT - 15, 12, ERROR_COLOR);
+    // Fitted parameters and goodness of fit
+    if (e.kind == ExprKind::REGRESSION && e.valid && !e.fit.params.empty() && activeExpression != i) {
+        std::string stats;
+        char part[48];
+        for (size_t k = 0; k < e.paramNames.size(); ++k) {
+            snprintf(part, sizeof(part), "%s = %.4g  ", e.paramNames[k].c_str(), e.fit.params[k]);
+            stats += part;
         }
+        snprintf(part, sizeof(part), "R^2 = %.4f", e.fit.rSquared);
+        stats += part;
+        DrawText(stats.c_str(), 45, yPos + EXPRESSION_HEIGHT - 15, 12, e.fit.converged ? PLACEHOLDER_COLOR : ERROR_COLOR);
+    }
+
+    // Draw visibility (eye) icon
+    Rectangle eye = {(float)(LEFT_PANEL_WIDTH - 40), (float)(yPos + 10), 30, 30};
+    bool eyeHover = hover && CheckCollisionPointRec(mousePos, eye);
+    if (eyeHover) DrawRoundedRect(eye.x, eye.y, eye.width, eye.height, 0.2f, BORDER_COLOR);
+    DrawTexture(e.isVisible ? eyeOpenTex : eyeClosedTex, eye.x + 5, eye.y + 5, WHITE);
+
+    // Draw delete icon
+    Rectangle del = {(float)(LEFT_PANEL_WIDTH - 70), (float)(yPos + 10), 25, 30};
+    bool delHover = hover && CheckCollisionPointRec(mousePos, del);
+    if (delHover) DrawRoundedRect(del.x, del.y, del.width, del.height, 0.2f, BORDER_COLOR);
+    DrawTexture(deleteTex, del.x + 2, del.y + 5, WHITE);
+}
+
+// --- Left panel: only the rows in view are laid out and drawn ---
+void DrawLeftPanel(std::vector<Expression>& expressions, int& activeExpression) {
+    DrawRectangle(0, HEADER_HEIGHT, LEFT_PANEL_WIDTH, WINDOW_HEIGHT - HEADER_HEIGHT, PANEL_BG);
+    DrawLine(LEFT_PANEL_WIDTH, HEADER_HEIGHT, LEFT_PANEL_WIDTH, WINDOW_HEIGHT, BORDER_COLOR);
 
-        // Draw visibility (eye) icon
-        Rectangle eye = {(float)(LEFT_PANEL_WIDTH - 40), (float)(yPos + 10), 30, 30};
-        bool eyeHover = CheckCollisionPointRec(mousePos, eye);
-        if (eyeHover) DrawRoundedRect(eye.x, eye.y, eye.width, eye.height, 0.2f, BORDER_COLOR);
-        DrawTexture(e.isVisible ? eyeOpenTex : eyeClosedTex, eye.x + 5, eye.y + 5, WHITE);
+    Vector2 mousePos = InputMousePosition();
+    bool mouseClicked = InputMousePressed(MOUSE_LEFT_BUTTON);
+    size_t count = expressions.size();
 
-        // Draw delete icon
-        Rectangle del = {(float)(LEFT_PANEL_WIDTH - 70), (float)(yPos + 10), 25, 30};
-        bool delHover = CheckCollisionPointRec(mousePos, del);
-        if (delHover) DrawRoundedRect(del.x, del.y, del.width, del.height, 0.2f, BORDER_COLOR);
-        DrawTexture(deleteTex, del.x + 2, del.y + 5, WHITE);
+    ClampListScroll(count);
+    int hoverRow = RowAt(mousePos, count);
+    size_t first = (size_t)listScroll / ROW_STRIDE;
+    size_t last = std::min(count, ((size_t)listScroll + (LIST_BOTTOM - LIST_TOP)) / ROW_STRIDE);
 
-        yPos += EXPRESSION_HEIGHT + EXPRESSION_MARGIN;
+    BeginScissorMode(0, LIST_TOP, LEFT_PANEL_WIDTH, LIST_BOTTOM - LIST_TOP);
+
+    // The row being edited keeps receiving input while scrolled out of view
+    int editing = activeExpression;
+    if (editing >= 0 && ((size_t)editing < first || (size_t)editing > last)) {
+        DrawExpressionRow(expressions, expressions[editing], editing, RowTop(editing), false,
+                          activeExpression, mouseClicked, mousePos);
+    }
+
+    for (size_t i = first; i <= last && i < count; ++i) {
+        DrawExpressionRow(expressions, expressions[i], (int)i, RowTop(i), hoverRow == (int)i,
+                          activeExpression, mouseClicked, mousePos);
     }
 
-    int buttonY = yPos;
-    DrawAddExpressionButton(buttonY);
+    if (last == count) DrawAddExpressionButton(RowTop(count), hoverRow == (int)count);
+    if (derivativesStale) RefreshDerivatives(expressions);
+
+    EndScissorMode();
+    DrawListScrollbar(count);
 
     int settingsY = WINDOW_HEIGHT - 200;
     DrawLine(10, settingsY, LEFT_PANEL_WIDTH - 10, settingsY, BORDER_COLOR);
@@ -267,9 +678,9 @@ void DrawLeftPanel(std::vector<Expression>& expressions, int& activeExpression)
     Rectangle zout = {110, (float)(settingsY+35), 25, 25};
     Rectangle reset = {140, (float)(settingsY+35), 50, 25};
 
-    bool zin_h = CheckCollisionPointRec(GetMousePosition(), zin);
-    bool zout_h = CheckCollisionPointRec(GetMousePosition(), zout);
-    bool reset_h = CheckCollisionPointRec(GetMousePosition(), reset);
+    bool zin_h = CheckCollisionPointRec(InputMousePosition(), zin);
+    bool zout_h = CheckCollisionPointRec(InputMousePosition(), zout);
+    bool reset_h = CheckCollisionPointRec(InputMousePosition(), reset);
 
     DrawRoundedRect((int)zin.x,(int)zin.y,(int)zin.width,(int)zin.height,.2f, zin_h ? BORDER_COLOR : EXPRESSION_BG);
     DrawRoundedRect((int)zout.x,(int)zout.y,(int)zout.width,(int)zout.height,.2f, zout_h ? BORDER_COLOR : EXPRESSION_BG);
@@ -278,10 +689,401 @@ void DrawLeftPanel(std::vector<Expression>& expressions, int& activeExpression)
     DrawText("+", (int)zin.x + 8, (int)zin.y + 5, 16, TEXT_COLOR);
     DrawText("-", (int)zout.x + 9, (int)zout.y + 5, 16, TEXT_COLOR);
     DrawText("Reset", (int)reset.x + 8, (int)reset.y + 5, 12, TEXT_COLOR);
+
+    // Float32 plotting toggle; says when deep zoom has switched back to double
+    Rectangle fast = {20, (float)(settingsY+75), 16, 16};
+    DrawRectangleLines((int)fast.x, (int)fast.y, (int)fast.width, (int)fast.height, TEXT_COLOR);
+    if (fastPlotting) DrawRectangle((int)fast.x + 4, (int)fast.y + 4, 8, 8, DESMOS_BLUE);
+    DrawText("Fast plotting (float32)", 44, settingsY + 76, 14, TEXT_COLOR);
+    if (fastPlotting) {
+        PlotWindow w{viewport.xMin, viewport.xMax, viewport.yMin, viewport.yMax,
+                     viewport.screenW, viewport.screenH, true};
+        if (plotPrecision(w) == Precision::DOUBLE)
+            DrawText("zoomed in: using double", 44, settingsY + 94, 12, PLACEHOLDER_COLOR);
+    }
+
+    char points[96];
+    if (dataX.empty()) snprintf(points, sizeof(points), "Drop a file of x, y points to fit y ~ f(x)");
+    else snprintf(points, sizeof(points), "Points: %s (%zu)", dataName.c_str(), dataX.size());
+    DrawText(points, 20, settingsY + 120, 12, PLACEHOLDER_COLOR);
+}
+
+// --- Curve drawing ---
+void DrawThickSegment(int x0, int y0, int x1, int y1, Color c) {
+    for (int off = -1; off <= 1; off++) {
+        DrawLine(x0 + off, y0, x1 + off, y1, c);
+        DrawLine(x0, y0 + off, x1, y1 + off, c);
+    }
+}
+
+// Polyline from the adaptive sampler; NaN points break the line. Points far
+// outside the graph are clamped so huge values do not overflow int pixels.
+// With dash > 0 the line is drawn in dashes of that many pixels, measured
+// along the line and continuing across its pieces.
+void DrawCurve(const std::vector<Point2>& pts, Color c, double dash = 0) {
+    const double LIMIT = 1e5;
+    bool hasPrev = false;
+    double pX = 0, pY = 0, run = 0;
+    for (const auto& p : pts) {
+        if (std::isnan(p.x)) { hasPrev = false; continue; }
+        double fx = (p.x - viewport.xMin) / (viewport.xMax - viewport.xMin) * viewport.screenW;
+        double fy = (p.y - viewport.yMin) / (viewport.yMax - viewport.yMin) * viewport.screenH;
+        fx = std::max(-LIMIT, std::min(LIMIT, fx));
+        fy = std::max(-LIMIT, std::min(LIMIT, fy));
+        double sx = viewport.screenX + (int)fx;
+        double sy = viewport.screenY + viewport.screenH - (int)fy;
+        if (hasPrev && dash <= 0) DrawThickSegment((int)pX, (int)pY, (int)sx, (int)sy, c);
+        if (hasPrev && dash > 0) {
+            double len = std::hypot(sx - pX, sy - pY);
+            for (double t = 0; t < len;) {
+                double dashes = std::floor(run / dash);
+                double next = std::min(len, t + std::max((dashes + 1) * dash - run, 1e-6));
+                if (std::fmod(dashes, 2) == 0)
+                    DrawThickSegment((int)(pX + (sx - pX) * t / len), (int)(pY + (sy - pY) * t / len),
+                                     (int)(pX + (sx - pX) * next / len), (int)(pY + (sy - pY) * next / len), c);
+                run += next - t;
+                t = next;
+            }
+        }
+        pX = sx; pY = sy; hasPrev = true;
+    }
+}
+
+// --- Feature markers (zeros, extrema, intersections) ---
+static CurveAnalyzer analyzer;
+static SharedSampler sharedSampler;
+
+void DrawFeatureMarkers(const std::vector<Expression>& expressions, int numPoints) {
+    std::vector<AnalysisCurve> curves;
+    std::vector<const Expression*> owners;
+    for (const auto& expr : expressions) {
+        if (!expr.isVisible || expr.compiled.empty() || !expr.valid) continue;
+        if (expr.kind != ExprKind::EXPLICIT) continue;
+        curves.push_back({CacheKey(expr), &expr.compiled});
+        owners.push_back(&expr);
+    }
+    const auto& points = analyzer.update(curves, viewport.xMin, viewport.xMax, numPoints);
+
+    const float MARKER_RADIUS = 4.0f;
+    const float HOVER_RADIUS = 7.0f;
+    Vector2 mouse = InputMousePosition();
+    const FeaturePoint* hovered = nullptr;
+    float bestDist = HOVER_RADIUS * HOVER_RADIUS;
+
+    for (const auto& p : points) {
+        if (p.y < viewport.yMin || p.y > viewport.yMax) continue;
+        int sx = viewport.worldToScreenX(p.x);
+        int sy = viewport.worldToScreenY(p.y);
+        DrawCircle(sx, sy, MARKER_RADIUS + 1, owners[p.curveA]->color);
+        DrawCircle(sx, sy, MARKER_RADIUS - 1, WHITE);
+
+        float dx = mouse.x - sx, dy = mouse.y - sy;
+        if (dx * dx + dy * dy <= bestDist) {
+            bestDist = dx * dx + dy * dy;
+            hovered = &p;
+        }
+    }
+
+    if (hovered) {
+        const char* kind = "Zero";
+        if (hovered->kind == PointKind::MINIMUM) kind = "Minimum";
+        else if (hovered->kind == PointKind::MAXIMUM) kind = "Maximum";
+        else if (hovered->kind == PointKind::INTERSECTION) kind = "Intersection";
+
+        char label[64];
+        snprintf(label, sizeof(label), "%s (%.4g, %.4g)", kind, hovered->x, hovered->y);
+        int sx = viewport.worldToScreenX(hovered->x);
+        int sy = viewport.worldToScreenY(hovered->y);
+        int w = MeasureText(label, 14) + 12;
+        DrawCircle(sx, sy, MARKER_RADIUS + 2, owners[hovered->curveA]->color);
+        DrawRectangle(sx + 8, sy - 28, w, 22, {255,255,255,230});
+        DrawRectangleLines(sx + 8, sy - 28, w, 22, BORDER_COLOR);
+        DrawText(label, sx + 14, sy - 24, 14, TEXT_COLOR);
+    }
+}
+
+// Translucent columns between each shaded curve and the axis or its second
+// curve, drawn under the curves themselves
+void DrawAreaShading(const std::vector<Expression>& expressions, int numPoints) {
+    std::vector<double> ys, gs;
+    double step = (viewport.xMax - viewport.xMin) / numPoints;
+    BeginScissorMode(viewport.screenX, viewport.screenY, viewport.screenW, viewport.screenH);
+    for (const auto& expr : expressions) {
+        if (!expr.isVisible || expr.shadeWith == SHADE_NONE || !CanShade(expr)) continue;
+        const Expression* g = expr.shadeWith >= 0 ? &expressions[expr.shadeWith] : nullptr;
+        if (g && !CanShade(*g)) continue;
+
+        sampleFunction(expr.compiled, viewport.xMin, viewport.xMax, numPoints, ys);
+        if (g) sampleFunction(g->compiled, viewport.xMin, viewport.xMax, numPoints, gs);
+
+        Color fill = Fade(expr.color, 0.25f);
+        auto clampY = [](double y) {
+            return std::max(viewport.yMin - 1, std::min(viewport.yMax + 1, y));
+        };
+        int prevX = viewport.worldToScreenX(viewport.xMin);
+        for (int i = 0; i <= numPoints; i++) {
+            double y0 = g ? gs[i] : 0.0;
+            if (std::isnan(ys[i]) || std::isnan(y0)) continue;
+            int sx = viewport.worldToScreenX(viewport.xMin + i * step);
+            if (i > 0 && sx == prevX) continue;   // one column per pixel
+            prevX = sx;
+            DrawLine(sx, viewport.worldToScreenY(clampY(ys[i])), sx, viewport.worldToScreenY(clampY(y0)), fill);
+        }
+    }
+    EndScissorMode();
+}
+
+// --- Graph layers: pixel buffers drawn as textures ---
+static Texture2D heatmapLayer = {0, 0, 0, 0, 0};
+static Texture2D regionLayer = {0, 0, 0, 0, 0};
+static Texture2D pointLayer = {0, 0, 0, 0, 0};
+static Texture2D complexLayer = {0, 0, 0, 0, 0};
+
+// (Re)creates layer as a blank RGBA texture of the given size
+void EnsureLayer(Texture2D& layer, int w, int h) {
+    if (layer.id != 0 && layer.width == w && layer.height == h) return;
+    if (layer.id != 0) UnloadTexture(layer);
+    Image blank = GenImageColor(w, h, BLANK);
+    layer = LoadTextureFromImage(blank);
+    UnloadImage(blank);
+}
+
+// src drawn over dst, straight alpha
+void BlendPixel(Color& dst, Color src) {
+    float a = src.a / 255.0f, b = dst.a / 255.0f * (1 - a), out = a + b;
+    if (out <= 0) return;
+    dst.r = (unsigned char)((src.r * a + dst.r * b) / out);
+    dst.g = (unsigned char)((src.g * a + dst.g * b) / out);
+    dst.b = (unsigned char)((src.b * a + dst.b * b) / out);
+    dst.a = (unsigned char)(out * 255);
+}
+
+// --- Heatmaps ---
+static std::vector<Color> heatmapPixels;
+
+// Viridis, sampled at five points and interpolated
+Color HeatColor(float t) {
+    static const Color STOPS[5] = {{68, 1, 84, 255}, {59, 82, 139, 255}, {33, 145, 140, 255},
+                                   {94, 201, 98, 255}, {253, 231, 37, 255}};
+    t = std::max(0.0f, std::min(1.0f, t)) * 4;
+    int i = std::min(3, (int)t);
+    float f = t - i;
+    Color a = STOPS[i], b = STOPS[i + 1];
+    return {(unsigned char)(a.r + (b.r - a.r) * f), (unsigned char)(a.g + (b.g - a.g) * f),
+            (unsigned char)(a.b + (b.b - a.b) * f), 255};
+}
+
+// 1, 2 or 5 times a power of ten, near span
+double NiceStep(double span) {
+    double p = std::pow(10.0, std::floor(std::log10(span)));
+    double m = span / p;
+    return (m < 1.5 ? 1 : m < 3.5 ? 2 : m < 7.5 ? 5 : 10) * p;
+}
+
+// Each visible z = f(x, y) is coloured over its own range in the window,
+// with optional contour lines at about ten nice levels. The values come
+// from a HeatmapGrid per expression, which keeps tiles across frames.
+void DrawHeatmaps(const std::vector<Expression>& expressions, const PlotWindow& window) {
+    static std::map<std::string, HeatmapGrid> grids;
+    int W = window.width, H = window.height;
+    std::map<std::string, HeatmapGrid> kept;
+    bool any = false;
+    for (const auto& expr : expressions) {
+        if (!expr.isVisible || !expr.valid || expr.compiled.empty() || expr.kind != ExprKind::HEATMAP) continue;
+        if (W <= 0 || H <= 0) break;
+        if (!any) {
+            EnsureLayer(heatmapLayer, W, H);
+            heatmapPixels.assign((size_t)W * H, BLANK);
+            any = true;
+        }
+
+        std::string gridKey = CacheKey(expr);
+        auto slot = kept.emplace(gridKey, HeatmapGrid());
+        HeatmapGrid& grid = slot.first->second;
+        auto old = grids.find(gridKey);
+        if (slot.second && old != grids.end()) grid = std::move(old->second);
+        const std::vector<float>& z = grid.update(expr.compiled, gridKey, window);
+        if (grid.lo() > grid.hi()) continue;
+
+        float range = grid.hi() - grid.lo();
+        double step = range > 0 ? NiceStep(range / 10) : 0;
+        for (int py = 0; py < H; ++py) {
+            for (int px = 0; px < W; ++px) {
+                size_t i = (size_t)py * W + px;
+                if (std::isnan(z[i])) continue;
+                Color c = HeatColor(range > 0 ? (z[i] - grid.lo()) / range : 0.5f);
+                if (expr.showContours && step > 0) {
+                    double level = std::floor(z[i] / step);
+                    bool edge = (px + 1 < W && !std::isnan(z[i + 1]) && std::floor(z[i + 1] / step) != level) ||
+                                (py + 1 < H && !std::isnan(z[i + W]) && std::floor(z[i + W] / step) != level);
+                    if (edge) c = {255, 255, 255, 255};
+                }
+                c.a = 220;
+                BlendPixel(heatmapPixels[i], c);
+            }
+        }
+    }
+    grids = std::move(kept);
+    if (!any) return;
+
+    UpdateTexture(heatmapLayer, heatmapPixels.data());
+    DrawTexture(heatmapLayer, viewport.screenX, viewport.screenY, WHITE);
+}
+
+// --- Complex functions ---
+static std::vector<uint8_t> complexPixels;
+
+// The last visible w = f(z) is drawn as an opaque domain coloring under
+// everything else. The image is only recomputed when the function or the
+// window changes.
+void DrawDomainColoring(const std::vector<Expression>& expressions, const PlotWindow& window) {
+    static std::string drawnKey;
+    const Expression* shown = nullptr;
+    for (const auto& expr : expressions)
+        if (expr.isVisible && expr.valid && expr.kind == ExprKind::COMPLEX && !expr.complexProg.empty())
+            shown = &expr;
+    if (!shown || window.width <= 0 || window.height <= 0) {
+        drawnKey.clear();
+        return;
+    }
+
+    char bounds[128];
+    snprintf(bounds, sizeof(bounds), "|%.17g|%.17g|%.17g|%.17g|%dx%d", window.xMin, window.xMax, window.yMin,
+             window.yMax, window.width, window.height);
+    std::string key = CacheKey(*shown) + bounds;
+    EnsureLayer(complexLayer, window.width, window.height);
+    if (key != drawnKey) {
+        renderDomainColoring(shown->complexProg, window, complexPixels);
+        UpdateTexture(complexLayer, complexPixels.data());
+        drawnKey = key;
+    }
+    DrawTexture(complexLayer, viewport.screenX, viewport.screenY, WHITE);
+}
+
+// --- Loaded points ---
+static std::vector<Color> pointPixels;
+
+// Each point marks a 3x3 pixel square of one layer, so a million points
+// cost one pass over them and one texture upload
+void DrawPoints(const PlotWindow& window) {
+    int W = window.width, H = window.height;
+    if (dataX.empty() || W <= 0 || H <= 0) return;
+
+    EnsureLayer(pointLayer, W, H);
+    pointPixels.assign((size_t)W * H, BLANK);
+    const Color POINT_COLOR = {90, 90, 90, 200};
+    double sx = W / (window.xMax - window.xMin), sy = H / (window.yMax - window.yMin);
+    for (size_t i = 0; i < dataX.size(); ++i) {
+        double px = (dataX[i] - window.xMin) * sx, py = (window.yMax - dataY[i]) * sy;
+        if (!(px >= -1 && px < W + 1 && py >= -1 && py < H + 1)) continue;
+        int cx = (int)px, cy = (int)py;
+        for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, H - 1); ++y)
+            for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, W - 1); ++x)
+                pointPixels[(size_t)y * W + x] = POINT_COLOR;
+    }
+    UpdateTexture(pointLayer, pointPixels.data());
+    DrawTexture(pointLayer, viewport.screenX, viewport.screenY, WHITE);
+}
+
+// Replaces the loaded points and refits every regression to them
+void LoadPointFile(std::vector<Expression>& expressions, const char* path) {
+    std::vector<double> xs, ys;
+    if (!loadPoints(path, xs, ys)) {
+        std::cerr << "Could not read points from " << path << "\n";
+        return;
+    }
+    dataX = std::move(xs);
+    dataY = std::move(ys);
+    dataName = GetFileName(path);
+    for (auto& e : expressions)
+        if (e.kind == ExprKind::REGRESSION) parseExpression(e, expressions);
+}
+
+// --- Inequality regions ---
+static std::vector<Color> regionPixels;
+static std::vector<std::vector<Point2>> regionBoundaries;   // per region, empty unless explicit
+
+// Fills regionPixels and regionBoundaries for the given regions
+void RasterizeRegions(const std::vector<const Expression*>& regions, const PlotWindow& window, int numPoints) {
+    int W = window.width, H = window.height;
+    regionPixels.assign((size_t)W * H, BLANK);
+    regionBoundaries.assign(regions.size(), {});
+
+    std::vector<uint8_t> mask;
+    std::vector<double> ys;
+    for (size_t r = 0; r < regions.size(); ++r) {
+        const Expression& expr = *regions[r];
+        bool strict = expr.relation == Relation::LESS || expr.relation == Relation::GREATER;
+        if (IsExplicitRegion(expr)) {
+            sampleFunction(expr.compiled, window.xMin, window.xMax, numPoints, ys, plotPrecision(window));
+            fillRegionColumns(ys, expr.relation, window, mask);
+            buildExplicitPolyline(expr.compiled, ys, window, regionBoundaries[r]);
+        } else {
+            rasterizeRegion(expr.compiled, expr.relation, window, mask);
+        }
+
+        Color fill = Fade(expr.color, 0.25f);
+        for (int py = 0; py < H; ++py) {
+            for (int px = 0; px < W; ++px) {
+                size_t i = (size_t)py * W + px;
+                if (!mask[i]) continue;
+                bool edge = !IsExplicitRegion(expr) &&
+                            ((px > 0 && !mask[i - 1]) || (px + 1 < W && !mask[i + 1]) ||
+                             (py > 0 && !mask[i - W]) || (py + 1 < H && !mask[i + W]));
+                bool dash = strict && ((px + py) / 4) % 2 == 1;
+                BlendPixel(regionPixels[i], edge && !dash ? expr.color : fill);
+            }
+        }
+    }
+}
+
+// Every visible inequality is filled into one translucent layer, uploaded
+// as a texture and drawn under the curves. Boundaries are solid for <= and
+// >=, dashed for < and >; explicit regions draw theirs as a polyline from
+// the same samples that filled them, split at jumps and poles like the
+// explicit curves. The layer and the boundaries are only
+// recomputed when the regions, their colors, the window or the precision
+// change.
+void DrawRegions(const std::vector<Expression>& expressions, const PlotWindow& window, int numPoints) {
+    static std::string drawnKey;
+    int W = window.width, H = window.height;
+    std::vector<const Expression*> regions;
+    for (const auto& expr : expressions)
+        if (expr.isVisible && expr.valid && !expr.compiled.empty() && expr.kind == ExprKind::INEQUALITY)
+            regions.push_back(&expr);
+    if (regions.empty() || W <= 0 || H <= 0) {
+        drawnKey.clear();
+        return;
+    }
+
+    char bounds[160];
+    snprintf(bounds, sizeof(bounds), "|%.17g|%.17g|%.17g|%.17g|%dx%d|%d|%d", window.xMin, window.xMax, window.yMin,
+             window.yMax, W, H, numPoints, (int)plotPrecision(window));
+    std::string key = bounds;
+    for (const Expression* expr : regions) {
+        char color[32];
+        snprintf(color, sizeof(color), "|%d,%d,%d,%d|", expr->color.r, expr->color.g, expr->color.b, expr->color.a);
+        key += color + CacheKey(*expr);
+    }
+    EnsureLayer(regionLayer, W, H);
+    if (key != drawnKey) {
+        RasterizeRegions(regions, window, numPoints);
+        UpdateTexture(regionLayer, regionPixels.data());
+        drawnKey = key;
+    }
+    DrawTexture(regionLayer, viewport.screenX, viewport.screenY, WHITE);
+
+    const double DASH_PX = 6;
+    BeginScissorMode(viewport.screenX, viewport.screenY, W, H);
+    for (size_t r = 0; r < regions.size(); ++r) {
+        bool strict = regions[r]->relation == Relation::LESS || regions[r]->relation == Relation::GREATER;
+        DrawCurve(regionBoundaries[r], regions[r]->color, strict ? DASH_PX : 0);
+    }
+    EndScissorMode();
 }
 
 // --- Full DrawGraphArea with domain clipping and grid labels ---
-void DrawGraphArea(const std::vector<Expression>& expressions) {
+void DrawGraphArea(const std::vector<Expression>& expressions, FrameProfile& profile) {
     int graphX = LEFT_PANEL_WIDTH + 20;
     int graphY = HEADER_HEIGHT + 20;
     int graphW = WINDOW_WIDTH - LEFT_PANEL_WIDTH - 40;
@@ -340,50 +1142,83 @@ void DrawGraphArea(const std::vector<Expression>& expressions) {
         char label[16]; snprintf(label,16,"%.0f",y);
         DrawText(label, zeroX + LABEL_OFFSET, sy - LABEL_FONT/2, LABEL_FONT, TEXT_COLOR);
     }
+    profile.mark("grid");
 
     // Plot expressions
     const int numPoints = 1000;
-    double step = (viewport.xMax - viewport.xMin) / numPoints;
+    PlotWindow window{viewport.xMin, viewport.xMax, viewport.yMin, viewport.yMax, graphW, graphH, fastPlotting};
+    std::vector<Point2> curve;
+    DrawDomainColoring(expressions, window);
+    profile.mark("complex");
+    DrawHeatmaps(expressions, window);
+    profile.mark("heatmaps");
+    DrawRegions(expressions, window, numPoints);
+    profile.mark("regions");
+    DrawAreaShading(expressions, numPoints);
+    DrawPoints(window);
+    profile.mark("shading");
+
+    // Explicit curves are sampled together, sharing common subexpressions
+    auto plotted = [](const Expression& expr) {
+        return expr.isVisible && !expr.compiled.empty() && expr.valid &&
+               expr.kind != ExprKind::INEQUALITY && expr.kind != ExprKind::HEATMAP;   // layers
+    };
+    std::vector<const CompiledExpr*> explicitPrograms;
+    for (const auto& expr : expressions)
+        if (plotted(expr) && expr.kind != ExprKind::PARAMETRIC && expr.kind != ExprKind::POLAR)
+            explicitPrograms.push_back(&expr.compiled);
+    const auto& explicitYs = sharedSampler.update(explicitPrograms, viewport.xMin, viewport.xMax, numPoints,
+                                                  plotPrecision(window));
+    size_t nextExplicit = 0;
+
     for (const auto& expr : expressions) {
-        if (!expr.isVisible || expr.ast == nullptr || !expr.valid) continue;
-        bool hasPrev = false;
-        int pX=0, pY=0;
-        for (int i=0; i <= numPoints; i++) {
-            double wx = viewport.xMin + i * step;
-            double wy;
-            try {
-                wy = evaluate(expr.ast, wx);
-                if (std::isnan(wy) || std::isinf(wy) || wy < viewport.yMin - 1 || wy > viewport.yMax + 1) {
-                    hasPrev = false;
-                    continue;
-                }
-            } catch (...) {
-                hasPrev = false;
-                continue;
-            }
-            int sx = viewport.worldToScreenX(wx);
-            int sy = viewport.worldToScreenY(wy);
-            if (hasPrev) {
-                for (int off = -1; off <= 1; off++) {
-                    DrawLine(pX + off, pY, sx + off, sy, expr.color);
-                    DrawLine(pX, pY + off, sx, sy + off, expr.color);
-                }
-            }
-            pX = sx; pY = sy; hasPrev = true;
+        if (!plotted(expr)) continue;
+
+        if (expr.kind == ExprKind::PARAMETRIC || expr.kind == ExprKind::POLAR) {
+            if (expr.kind == ExprKind::PARAMETRIC)
+                sampleParametric(expr.compiled, expr.compiledY, PARAMETRIC_T_MIN, PARAMETRIC_T_MAX, window, curve);
+            else
+                samplePolar(expr.compiled, POLAR_THETA_MIN, POLAR_THETA_MAX, window, curve);
+            BeginScissorMode(graphX, graphY, graphW, graphH);
+            DrawCurve(curve, expr.color);
+            EndScissorMode();
+            continue;
         }
+
+        // Split at jumps and poles, clipped to the window
+        PolylineStats stats;
+        buildExplicitPolyline(expr.compiled, explicitYs[nextExplicit++], window, curve, &stats);
+        DrawCurve(curve, expr.color);
+        countMetric(Metric::SAMPLES_UNDEFINED, stats.undefined);
+        countMetric(Metric::SAMPLES_OFFSCREEN, stats.offscreen);
+        countMetric(Metric::SAMPLES_PLOTTED, numPoints + 1 - stats.undefined - stats.offscreen);
     }
 
-    // Legend
-    if (!expressions.empty()) {
+    profile.mark("curves");
+
+    // Zeros, extrema and intersections as hoverable markers
+    DrawFeatureMarkers(expressions, numPoints);
+    profile.mark("features");
+
+    // Legend (at most MAX_LEGEND_ROWS visible entries)
+    const int MAX_LEGEND_ROWS = 12;
+    int visibleCount = 0;
+    for (const auto& expr : expressions)
+        if (expr.isVisible) visibleCount++;
+    if (visibleCount > 0) {
+        int rows = std::min(visibleCount, MAX_LEGEND_ROWS);
+        bool truncated = visibleCount > MAX_LEGEND_ROWS;
         int legendX = graphX + graphW - 310;
         int legendY = graphY + 10;
         int legendW = 300;
-        int legendH = (int)expressions.size() * (EXPRESSION_HEIGHT / 2) + 20;
+        int legendH = (rows + (truncated ? 1 : 0)) * (EXPRESSION_HEIGHT / 2) + 20;
         DrawRectangle(legendX, legendY, legendW, legendH, {240,240,240,200});
         DrawRectangleLines(legendX, legendY, legendW, legendH, BORDER_COLOR);
         int ty = legendY + 10;
+        int drawn = 0;
         for (const auto& expr : expressions) {
             if (!expr.isVisible) continue;
+            if (drawn++ == MAX_LEGEND_ROWS) break;
             DrawRectangle(legendX + 10, ty + 5, 20, 20, expr.color);
             const char* disp = expr.text.empty() ? "(empty)" : expr.text.c_str();
             char trunc[40];
@@ -396,6 +1231,11 @@ void DrawGraphArea(const std::vector<Expression>& expressions) {
             DrawText(disp, legendX + 40, ty + 10, 16, TEXT_COLOR);
             ty += EXPRESSION_HEIGHT / 2;
         }
+        if (truncated) {
+            char more[32];
+            snprintf(more, sizeof(more), "+%d more", visibleCount - MAX_LEGEND_ROWS);
+            DrawText(more, legendX + 40, ty + 10, 16, PLACEHOLDER_COLOR);
+        }
     }
 }
 
@@ -403,9 +1243,9 @@ void DrawGraphArea(const std::vector<Expression>& expressions) {
 void HandlePan(Viewport& vp) {
     static bool dragging = false;
     static Vector2 lastMouse = {0,0};
-    if (IsMouseButtonDown(MOUSE_MIDDLE_BUTTON)
-        || (IsMouseButtonDown(MOUSE_LEFT_BUTTON) && IsKeyDown(KEY_LEFT_CONTROL))) {
-        Vector2 m = GetMousePosition();
+    if (InputMouseDown(MOUSE_MIDDLE_BUTTON)
+        || (InputMouseDown(MOUSE_LEFT_BUTTON) && InputKeyDown(KEY_LEFT_CONTROL))) {
+        Vector2 m = InputMousePosition();
         if (!dragging) { dragging=true; lastMouse=m; }
         else {
             double dx = m.x - lastMouse.x;
@@ -419,10 +1259,81 @@ void HandlePan(Viewport& vp) {
     } else dragging = false;
 }
 
+// --- Session persistence ---
+const char* SESSION_PATH = "session.dsm";
+
+void SaveSessionFile(const std::vector<Expression>& expressions) {
+    Session session;
+    session.xMin = viewport.xMin; session.xMax = viewport.xMax;
+    session.yMin = viewport.yMin; session.yMax = viewport.yMax;
+    for (const auto& e : expressions) {
+        SessionEntry entry;
+        entry.text = e.text;
+        entry.color[0] = e.color.r; entry.color[1] = e.color.g;
+        entry.color[2] = e.color.b; entry.color[3] = e.color.a;
+        entry.visible = e.isVisible;
+        entry.kind = e.kind;
+        entry.compiledLoaded = false;
+        if (e.valid) {
+            entry.compiled = e.compiled;
+            entry.compiledY = e.compiledY;
+        }
+        session.entries.push_back(std::move(entry));
+    }
+    session.pointsName = dataName;
+    session.pointsX = dataX;
+    session.pointsY = dataY;
+    if (!saveSession(SESSION_PATH, session))
+        std::cerr << "Could not save session to " << SESSION_PATH << "\n";
+}
+
+// Restores the saved expressions and points. Entries whose compiled form
+// loaded are ready to plot as-is; the rest are reparsed from their text.
+// Regressions are always refitted, so they get their statistics back.
+bool LoadSessionFile(std::vector<Expression>& expressions) {
+    Session session;
+    if (!loadSession(SESSION_PATH, session)) return false;
+
+    viewport.xMin = session.xMin; viewport.xMax = session.xMax;
+    viewport.yMin = session.yMin; viewport.yMax = session.yMax;
+    dataName = std::move(session.pointsName);
+    dataX = std::move(session.pointsX);
+    dataY = std::move(session.pointsY);
+    expressions.reserve(session.entries.size());
+    for (auto& entry : session.entries) {
+        Color c = {entry.color[0], entry.color[1], entry.color[2], entry.color[3]};
+        expressions.emplace_back(entry.text, c);
+        Expression& e = expressions.back();
+        e.isVisible = entry.visible;
+        if (entry.compiledLoaded && entry.kind != ExprKind::REGRESSION) {
+            e.kind = entry.kind;
+            e.compiled = std::move(entry.compiled);
+            e.compiledY = std::move(entry.compiledY);
+            e.valid = true;
+            if (e.kind == ExprKind::INEQUALITY)
+                e.relation = RegionRelation(classifyExpression(e.text), IsExplicitRegion(e));
+        } else if (!e.text.empty()) {
+            parseExpression(e, expressions);
+        }
+    }
+    RefreshDerivatives(expressions);   // rows may refer to ones after them
+    return true;
+}
+
 // --- Main UI loop ---
-void runUI() {
+void runUI(const UIOptions& options) {
+    bool replay = !options.replayPath.empty();
+    bool scripted = replay || !options.recordPath.empty();
+    if (replay && options.headless) SetConfigFlags(FLAG_WINDOW_HIDDEN);
     InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Graphing Calculator");
-    SetTargetFPS(60);
+    SetTargetFPS(replay ? 0 : 60);   // replays run as fast as the frames allow
+
+    InputMode mode = replay ? InputMode::REPLAY : scripted ? InputMode::RECORD : InputMode::LIVE;
+    if (!StartInput(mode, replay ? options.replayPath : options.recordPath)) {
+        std::cerr << "Could not open " << (replay ? options.replayPath : options.recordPath) << "\n";
+        CloseWindow();
+        return;
+    }
 
     // Load icon textures
     eyeOpenTex = LoadTexture("assets/eye_open.png");
@@ -437,11 +1348,18 @@ void runUI() {
     std::vector<Expression> expressions;
     int activeExpression = -1;
 
-    expressions.emplace_back("", expressionColors[0]);
+    // Recordings start from an empty list and leave the saved session alone,
+    // so their replays start from the same state
+    if (scripted || !LoadSessionFile(expressions) || expressions.empty())
+        expressions.emplace_back("", expressionColors[0]);
     activeExpression = -1;
 
-    while (!WindowShouldClose()) {
-        Vector2 mp = GetMousePosition();
+    FrameProfile profile(scripted);
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point lastExport = Clock::now(), frameStart = lastExport;
+    while (PollInput() && !InputCloseRequested()) {
+        profile.beginFrame();
+        Vector2 mp = InputMousePosition();
         HandlePan(viewport);
 
         // Zoom tiles
@@ -449,7 +1367,8 @@ void runUI() {
         Rectangle zin = {80, (float)(sy+35),25,25};
         Rectangle zout = {110,(float)(sy+35),25,25};
         Rectangle reset = {140,(float)(sy+35),50,25};
-        if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)){
+        Rectangle fast = {20,(float)(sy+75),200,16};
+        if (InputMousePressed(MOUSE_LEFT_BUTTON)){
             if (CheckCollisionPointRec(mp, zin)) {
                 double xc=(viewport.xMin+viewport.xMax)/2;
                 double yc=(viewport.yMin+viewport.yMax)/2;
@@ -470,49 +1389,105 @@ void runUI() {
                 viewport.xMin=-10; viewport.xMax=10;
                 viewport.yMin=-10; viewport.yMax=10;
             }
+            else if (CheckCollisionPointRec(mp, fast)) {
+                fastPlotting = !fastPlotting;
+            }
+        }
+
+        // Points to fit regressions to, dropped onto the window
+        if (const char* dropped = InputDroppedFile()) LoadPointFile(expressions, dropped);
+
+        // Save with Ctrl+S (also saved on exit)
+        if (!scripted && (InputKeyDown(KEY_LEFT_CONTROL) || InputKeyDown(KEY_RIGHT_CONTROL)) && InputKeyPressed(KEY_S))
+            SaveSessionFile(expressions);
+
+        // Scroll the expression list
+        if (mp.x < LEFT_PANEL_WIDTH && mp.y >= LIST_TOP && mp.y < LIST_BOTTOM) {
+            listScroll -= InputWheelMove() * ROW_STRIDE;
+            ClampListScroll(expressions.size());
         }
 
-        // Visibility & delete click
-        int y2 = HEADER_HEIGHT+20;
-        for (size_t i=0;i<expressions.size();i++){
+        // Visibility & delete click: only the row under the mouse can be hit
+        int row = RowAt(mp, expressions.size());
+        if (row >= 0 && row < (int)expressions.size() && InputMousePressed(MOUSE_LEFT_BUTTON)) {
+            int y2 = RowTop(row);
             Rectangle eye = {(float)(LEFT_PANEL_WIDTH-40),(float)(y2+10),30,30};
             Rectangle del = {(float)(LEFT_PANEL_WIDTH-70),(float)(y2+10),25,30};
-            if (CheckCollisionPointRec(mp, eye) && IsMouseButtonPressed(MOUSE_LEFT_BUTTON)){
-                expressions[i].isVisible = !expressions[i].isVisible;
-                break;
+            Rectangle dot = {15, (float)(y2+EXPRESSION_HEIGHT/2-10), 20, 20};
+            if (CheckCollisionPointRec(mp, dot) && CanShade(expressions[row])) {
+                expressions[row].shadeWith = NextShadeTarget(expressions, row);
             }
-            if (CheckCollisionPointRec(mp, del) && IsMouseButtonPressed(MOUSE_LEFT_BUTTON)){
-                if (expressions[i].ast) freeAST(expressions[i].ast);
-                expressions.erase(expressions.begin()+i);
-                if (activeExpression == (int)i) activeExpression = expressions.empty() ? -1 : (int)i-1;
-                break;
+            else if (CheckCollisionPointRec(mp, dot) && expressions[row].kind == ExprKind::HEATMAP) {
+                expressions[row].showContours = !expressions[row].showContours;
+            }
+            else if (CheckCollisionPointRec(mp, eye)){
+                expressions[row].isVisible = !expressions[row].isVisible;
+            }
+            else if (CheckCollisionPointRec(mp, del)){
+                std::string removed = expressions[row].text;
+                freeAST(expressions[row].ast);
+                freeAST(expressions[row].astY);
+                expressions.erase(expressions.begin()+row);
+                for (auto& e : expressions) {
+                    if (e.shadeWith == row) e.shadeWith = SHADE_NONE;
+                    else if (e.shadeWith > row) e.shadeWith--;
+                }
+                RenumberDerivatives(expressions, row, removed);
+                if (activeExpression == row) activeExpression = expressions.empty() ? -1 : row-1;
+                else if (activeExpression > row) lastActive = --activeExpression;
             }
-            y2 += EXPRESSION_HEIGHT + EXPRESSION_MARGIN;
         }
 
         // Add expression
-        int buttonY = HEADER_HEIGHT + 20 + (int)expressions.size()*(EXPRESSION_HEIGHT+EXPRESSION_MARGIN);
-        if (buttonY < WINDOW_HEIGHT - 100 &&
-            IsMouseOverRect(10, buttonY, LEFT_PANEL_WIDTH - 20, EXPRESSION_HEIGHT) &&
-            IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
+        else if (row == (int)expressions.size() && InputMousePressed(MOUSE_LEFT_BUTTON)) {
             expressions.emplace_back("", expressionColors[expressions.size()%maxColors]);
             activeExpression = (int)expressions.size()-1;
+            ScrollToRow(expressions.size(), expressions.size());
         }
 
+        profile.mark("input");
+
         BeginDrawing();
         ClearBackground(RAYWHITE);
         DrawHeader();
         DrawLeftPanel(expressions, activeExpression);
-        DrawGraphArea(expressions);
+        profile.mark("panel");
+        DrawGraphArea(expressions, profile);
         EndDrawing();
+        profile.mark("present");
+        profile.endFrame();
+
+        // Frame to frame, so the time spent waiting for the next frame counts
+        Clock::time_point now = Clock::now();
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - frameStart).count();
+        frameStart = now;
+        countMetric(Metric::FRAMES);
+        countMetric(Metric::FRAME_NANOSECONDS, ns);
+        if (ns > 1000000000 / 30) countMetric(Metric::SLOW_FRAMES);
+        if (!options.metricsPath.empty() && now - lastExport >= std::chrono::seconds(METRICS_INTERVAL)) {
+            exportMetrics(options.metricsPath);
+            lastExport = now;
+        }
     }
+    StopInput();
+    if (!options.metricsPath.empty() && !exportMetrics(options.metricsPath))
+        std::cerr << "Could not write metrics to " << options.metricsPath << "\n";
 
-    for (auto& e : expressions)
-        if (e.ast) freeAST(e.ast);
+    if (scripted) profile.report(stdout);
+    else SaveSessionFile(expressions);
+
+    for (auto& e : expressions) {
+        freeAST(e.ast);
+        freeAST(e.astY);
+    }
 
     UnloadTexture(eyeOpenTex);
     UnloadTexture(eyeClosedTex);
     UnloadTexture(deleteTex);
+    if (heatmapLayer.id != 0) UnloadTexture(heatmapLayer);
+    if (regionLayer.id != 0) UnloadTexture(regionLayer);
+    if (pointLayer.id != 0) UnloadTexture(pointLayer);
+    if (complexLayer.id != 0) UnloadTexture(complexLayer);
 
     CloseWindow();
 }
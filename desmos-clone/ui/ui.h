@@ -5,7 +5,20 @@
 #include <vector>
 
 
-void runUI();
+// Input recording and replay, see ui/replay.h. Both start from an empty
+// expression list and never touch the saved session; at the end they print
+// frame time percentiles per stage.
+struct UIOptions {
+    std::string recordPath;   // log each frame's input here
+    std::string replayPath;   // take each frame's input from here instead of the devices
+    bool headless = false;    // replay in a hidden window
+    std::string metricsPath;  // append the counters of evaluator/metrics.h here, as JSON lines
+};
+
+// Seconds between metrics exports while the app runs (and once more on exit)
+const int METRICS_INTERVAL = 10;
+
+void runUI(const UIOptions& options = UIOptions());
 
 struct ExpressionEntry {
     std::string expr;